@@ -120,6 +120,8 @@ Object CallRPC(const string& strMethod, const Array& params)
     string strUserPass64 = EncodeBase64(mapArgs["-rpcuser"] + ":" + mapArgs["-rpcpassword"]);
     map<string, string> mapRequestHeaders;
     mapRequestHeaders["Authorization"] = string("Basic ") + strUserPass64;
+    if (RPCIsListMethod(strMethod))
+        mapRequestHeaders[HTTP_HEADER_RPC_STREAM] = "1";
 
     // Send request
     string strRequest = JSONRPCRequest(strMethod, params, 1);
@@ -0,0 +1,59 @@
+// Copyright (c) 2014-2016 The Gcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "undo.h"
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+static void AddScript(vector<vector<unsigned char> >& vElements, const CScript& script)
+{
+    vElements.push_back(vector<unsigned char>(script.begin(), script.end()));
+
+    // The wallet only knows the key hashes of the keys it holds.
+    txnouttype type;
+    vector<vector<unsigned char> > vSolutions;
+    if (!Solver(script, type, vSolutions))
+        return;
+    if (type == TX_PUBKEY) {
+        CScript scriptKey = GetScriptForDestination(CPubKey(vSolutions[0]).GetID());
+        vElements.push_back(vector<unsigned char>(scriptKey.begin(), scriptKey.end()));
+    } else if (type == TX_MULTISIG) {
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++) {
+            CScript scriptKey = GetScriptForDestination(CPubKey(vSolutions[i]).GetID());
+            vElements.push_back(vector<unsigned char>(scriptKey.begin(), scriptKey.end()));
+        }
+    }
+}
+
+CBloomFilter BuildBlockFilter(const CBlock& block, const CBlockUndo& blockundo)
+{
+    vector<vector<unsigned char> > vElements;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            AddScript(vElements, txout.scriptPubKey);
+    BOOST_FOREACH(const CTxUndo& txundo, blockundo.vtxundo)
+        BOOST_FOREACH(const CTxInUndo& txinundo, txundo.vprevout)
+            AddScript(vElements, txinundo.txout.scriptPubKey);
+
+    CBloomFilter filter(std::max((size_t)1, vElements.size()), BLOCK_FILTER_FP_RATE, (unsigned int)block.GetHash().GetCheapHash(), BLOOM_UPDATE_NONE);
+    BOOST_FOREACH(const vector<unsigned char>& vElement, vElements)
+        filter.insert(vElement);
+    return filter;
+}
+
+bool BlockFilterMatchAny(const CBloomFilter& filter, const vector<vector<unsigned char> >& vScripts)
+{
+    BOOST_FOREACH(const vector<unsigned char>& vScript, vScripts)
+        if (filter.contains(vScript))
+            return true;
+    return false;
+}
@@ -0,0 +1,30 @@
+// Copyright (c) 2014-2016 The Gcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "bloom.h"
+
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+class CScript;
+
+//! False positive rate of the block filters, for the number of scripts they hold
+static const double BLOCK_FILTER_FP_RATE = 0.00001;
+
+/**
+ * Build the filter of a block, holding the scripts of its outputs and of the
+ * outputs it spends, so that a wallet can tell from its own scripts whether it
+ * needs to read the block. The keys of pay-to-pubkey and bare multisig scripts
+ * are also added as pay-to-pubkey-hash scripts.
+ */
+CBloomFilter BuildBlockFilter(const CBlock& block, const CBlockUndo& blockundo);
+
+//! Whether any of the scripts may be in the block of the filter
+bool BlockFilterMatchAny(const CBloomFilter& filter, const std::vector<std::vector<unsigned char> >& vScripts);
+
+#endif // BITCOIN_BLOCKFILTER_H
@@ -3,8 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "cache.h"
+#include "base58.h"
 #include "main.h"
 #include "policy/licenseinfo.h"
+#include "script/standard.h"
+#include "txdb.h"
 #include "util.h"
 #include "utilerror.h"
 
@@ -22,6 +25,132 @@ block_miner::BlockMiner *pminer = NULL;
 activate_addr::ActivateAddr *pactivate = NULL;
 order_list::OrderList *porder = NULL;
 
+namespace
+{
+// Types of the entries in the cache database.
+const char DB_CACHE_MEMBER = 'm';
+const char DB_CACHE_LICENSE = 'l';
+const char DB_CACHE_MINER = 'b';
+const char DB_CACHE_ACTIVATE = 'a';
+const char DB_CACHE_ACTIVATE_COLOR = 'c';
+const char DB_CACHE_ORDER = 'o';
+const char DB_CACHE_VOTE = 'v';
+const char DB_CACHE_BANVOTE = 'x';
+}
+
+CAddressKey::CAddressKey(const string &addr) : type_(NONE)
+{
+    CTxDestination dest = CBitcoinAddress(addr).Get();
+    if (const CKeyID *keyID = boost::get<CKeyID>(&dest)) {
+        type_ = KEY_ID;
+        id_ = *keyID;
+    } else if (const CScriptID *scriptID = boost::get<CScriptID>(&dest)) {
+        type_ = SCRIPT_ID;
+        id_ = *scriptID;
+    }
+}
+
+CAddressKey::CAddressKey(const CScript &script) : type_(NONE)
+{
+    vector<CTxDestination> addresses;
+    txnouttype type;
+    int nRequired;
+
+    if (!ExtractDestinations(script, type, addresses, nRequired) || addresses.empty())
+        return;
+    if (const CKeyID *keyID = boost::get<CKeyID>(&addresses[0])) {
+        type_ = KEY_ID;
+        id_ = *keyID;
+    } else if (const CScriptID *scriptID = boost::get<CScriptID>(&addresses[0])) {
+        type_ = SCRIPT_ID;
+        id_ = *scriptID;
+    }
+}
+
+string CAddressKey::ToString() const
+{
+    switch (type_) {
+    case KEY_ID:
+        return CBitcoinAddress(CKeyID(id_)).ToString();
+    case SCRIPT_ID:
+        return CBitcoinAddress(CScriptID(id_)).ToString();
+    default:
+        return "";
+    }
+}
+
+CScript CAddressKey::GetScript() const
+{
+    switch (type_) {
+    case KEY_ID:
+        return GetScriptForDestination(CKeyID(id_));
+    case SCRIPT_ID:
+        return GetScriptForDestination(CScriptID(id_));
+    default:
+        return CScript();
+    }
+}
+
+// Namespace for cache of alliance member.
+namespace alliance_member
+{
+
+set<string> AllianceMember::ListMembers() const
+{
+    set<string> members;
+    for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++)
+        members.insert(it->ToString());
+    return members;
+}
+
+void AllianceMember::ReadLegacy(CDataStream &s)
+{
+    set<string> members;
+    s >> members;
+    for (set<string>::const_iterator it = members.begin(); it != members.end(); it++)
+        Add(*it);
+}
+
+bool AllianceMember::WriteChanges(CCacheDB &db, CLevelDBBatch &batch)
+{
+    if (fReplaced_) {
+        if (!db.EraseEntries<CAddressKey>(DB_CACHE_MEMBER, batch))
+            return false;
+        for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++)
+            batch.Write(make_pair(DB_CACHE_MEMBER, *it), true);
+    } else {
+        for (Tc_t::const_iterator it = changed_.begin(); it != changed_.end(); it++) {
+            if (IsMember(*it))
+                batch.Write(make_pair(DB_CACHE_MEMBER, *it), true);
+            else
+                batch.Erase(make_pair(DB_CACHE_MEMBER, *it));
+        }
+    }
+    return true;
+}
+
+void AllianceMember::ClearChanges()
+{
+    changed_.clear();
+    fReplaced_ = false;
+}
+
+bool AllianceMember::ReadEntries(CCacheDB &db, const int height)
+{
+    vector<pair<CAddressKey, bool> > entries;
+    if (!db.ReadEntries(DB_CACHE_MEMBER, entries))
+        return false;
+    RemoveAll();
+    for (vector<pair<CAddressKey, bool> >::const_iterator it = entries.begin(); it != entries.end(); it++)
+        pcontainer_->insert(it->first);
+    changed_.clear();
+    fReplaced_ = false;
+    backupheight_ = height;
+    return true;
+}
+
+}
+
 // Namespace for cache of license structure.
 namespace color_license
 {
@@ -35,17 +164,18 @@ bool ColorLicense::SetOwner(const type_Color &color, const string addr, const CL
             return false;
     } else {
         if (pinfo)
-            (*pcontainer_)[color].info_ = *pinfo;
+            Entry_(color).info_ = *pinfo;
         else
             return false;
     }
-    (*pcontainer_)[color].address_ = addr;
+    Entry_(color).address_ = CAddressKey(addr);
+    changed_.insert(color);
     return true;
 }
 
 string ColorLicense::GetOwner(const type_Color &color) const
 {
-    return (*pcontainer_)[color].address_;
+    return Find_(color).address_.ToString();
 }
 
 bool ColorLicense::IsColorExist(const type_Color &color) const
@@ -68,7 +198,7 @@ map<type_Color, pair<string, int64_t> > ColorLicense::ListLicense() const
 {
     map<type_Color, pair<string, int64_t> > list;
     for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++) {
-        list[it->first] = make_pair(it->second.address_, it->second.num_of_coins_);
+        list[it->first] = make_pair(it->second.address_.ToString(), it->second.num_of_coins_);
     }
     return list;
 }
@@ -83,6 +213,76 @@ bool ColorLicense::GetLicenseInfo(const type_Color &color, CLicenseInfo &info) c
         return false;
 }
 
+namespace
+{
+// The owner record as it was kept with base58 addresses.
+struct LegacyOwner_
+{
+    std::string address_;
+    int64_t num_of_coins_;
+    CLicenseInfo info_;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(address_);
+        READWRITE(num_of_coins_);
+        READWRITE(info_);
+    }
+};
+}
+
+void ColorLicense::ReadLegacy(CDataStream &s)
+{
+    map<type_Color, LegacyOwner_> owners;
+    s >> owners;
+    for (map<type_Color, LegacyOwner_>::const_iterator it = owners.begin(); it != owners.end(); it++) {
+        Owner_ &owner = (*pcontainer_)[it->first];
+        owner.address_ = CAddressKey(it->second.address_);
+        owner.num_of_coins_ = it->second.num_of_coins_;
+        owner.info_ = it->second.info_;
+    }
+}
+
+bool ColorLicense::WriteChanges(CCacheDB &db, CLevelDBBatch &batch)
+{
+    if (fReplaced_) {
+        if (!db.EraseEntries<type_Color>(DB_CACHE_LICENSE, batch))
+            return false;
+        for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++)
+            batch.Write(make_pair(DB_CACHE_LICENSE, it->first), it->second);
+    } else {
+        for (CHashSet<type_Color>::const_iterator it = changed_.begin(); it != changed_.end(); it++) {
+            Tc_t::const_iterator itOwner = pcontainer_->find(*it);
+            if (itOwner != pcontainer_->end())
+                batch.Write(make_pair(DB_CACHE_LICENSE, *it), itOwner->second);
+            else
+                batch.Erase(make_pair(DB_CACHE_LICENSE, *it));
+        }
+    }
+    return true;
+}
+
+void ColorLicense::ClearChanges()
+{
+    changed_.clear();
+    fReplaced_ = false;
+}
+
+bool ColorLicense::ReadEntries(CCacheDB &db, const int height)
+{
+    vector<pair<type_Color, Owner_> > entries;
+    if (!db.ReadEntries(DB_CACHE_LICENSE, entries))
+        return false;
+    RemoveAll();
+    pcontainer_->insert(entries.begin(), entries.end());
+    changed_.clear();
+    fReplaced_ = false;
+    backupheight_ = height;
+    return true;
+}
+
 }
 
 // Namespace for cache of block miners.
@@ -90,8 +290,12 @@ namespace block_miner
 {
 bool BlockMiner::Add(const string &addr)
 {
-    while (pcontainer_->size() >= 100) pcontainer_->pop_back();
+    while (pcontainer_->size() >= 100) {
+        changed_.insert(nextSeq_ - pcontainer_->size());
+        pcontainer_->pop_back();
+    }
     pcontainer_->push_front(make_pair(addr, palliance->NumOfMembers()));
+    changed_.insert(nextSeq_++);
     return true;
 }
 
@@ -105,115 +309,475 @@ unsigned int BlockMiner::NumOfMined(string addr, unsigned int nAlliance) const
     }
     return nSameMiner;
 }
+
+void BlockMiner::ReadLegacy(CDataStream &s)
+{
+    s >> *pcontainer_;
+    nextSeq_ = pcontainer_->size();
+}
+
+bool BlockMiner::WriteChanges(CCacheDB &db, CLevelDBBatch &batch)
+{
+    if (fReplaced_) {
+        if (!db.EraseEntries<uint64_t>(DB_CACHE_MINER, batch))
+            return false;
+        uint64_t seq = nextSeq_;
+        for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++)
+            batch.Write(make_pair(DB_CACHE_MINER, --seq), *it);
+    } else {
+        for (set<uint64_t>::const_iterator it = changed_.begin(); it != changed_.end(); it++) {
+            if (*it < nextSeq_ && nextSeq_ - 1 - *it < pcontainer_->size()) {
+                Tc_t::const_iterator itEntry = pcontainer_->begin();
+                std::advance(itEntry, nextSeq_ - 1 - *it);
+                batch.Write(make_pair(DB_CACHE_MINER, *it), *itEntry);
+            } else
+                batch.Erase(make_pair(DB_CACHE_MINER, *it));
+        }
+    }
+    return true;
+}
+
+void BlockMiner::ClearChanges()
+{
+    changed_.clear();
+    fReplaced_ = false;
+}
+
+bool BlockMiner::ReadEntries(CCacheDB &db, const int height)
+{
+    vector<pair<uint64_t, pair<string, unsigned int> > > entries;
+    if (!db.ReadEntries(DB_CACHE_MINER, entries))
+        return false;
+    RemoveAll();
+    // The keys do not sort by sequence on disk, the latest block goes first in the list.
+    sort(entries.begin(), entries.end());
+    for (vector<pair<uint64_t, pair<string, unsigned int> > >::const_iterator it = entries.begin(); it != entries.end(); it++)
+        pcontainer_->push_front(it->second);
+    nextSeq_ = entries.empty() ? 0 : entries.back().first + 1;
+    changed_.clear();
+    fReplaced_ = false;
+    backupheight_ = height;
+    return true;
+}
 }
 
 // Namespace for cache of activated addresses.
 namespace activate_addr
 {
 
-bool ActivateAddr::Activate(const type_Color &color, const std::string &addr)
+bool ActivateAddr::RemoveColor(const type_Color &color)
+{
+    for (Tc_t::Counters_t::iterator it = pcontainer_->counters.begin(); it != pcontainer_->counters.end(); ) {
+        if (it->first.first == color) {
+            changed_.insert(it->first);
+            it = pcontainer_->counters.erase(it);
+        } else
+            it++;
+    }
+    pcontainer_->colors.erase(color);
+    changedColors_.insert(color);
+    return true;
+}
+
+bool ActivateAddr::Activate(const type_Color &color, const CAddressKey &addr)
 {
     // Use a counter to justify whether the transaction is the one that activates the receiver.
-    if (IsActivated(color, addr))
-        (*pcontainer_)[color][addr]++;
-    else
+    Tc_t::Counters_t::iterator it = pcontainer_->counters.find(make_pair(color, addr));
+    if (it != pcontainer_->counters.end()) {
+        it->second++;
+        changed_.insert(it->first);
+    } else
         Add(make_pair(color, addr));
     return true;
 }
 
-bool ActivateAddr::Deactivate(const type_Color &color, const std::string &addr)
+bool ActivateAddr::Deactivate(const type_Color &color, const CAddressKey &addr)
 {
-    if (!IsActivated(color, addr))
+    Tc_t::Counters_t::iterator it = pcontainer_->counters.find(make_pair(color, addr));
+    if (it == pcontainer_->counters.end())
         return false;
-    (*pcontainer_)[color][addr]--;
-    if ((*pcontainer_)[color][addr] == 0)
+    changed_.insert(it->first);
+    if (--it->second == 0)
         Remove(make_pair(color, addr));
     else
         return false;
     return true;
 }
 
+void ActivateAddr::ReadLegacy(CDataStream &s)
+{
+    map<type_Color, map<string, int64_t> > table;
+    s >> table;
+    for (map<type_Color, map<string, int64_t> >::const_iterator it = table.begin(); it != table.end(); it++) {
+        pcontainer_->colors.insert(it->first);
+        for (map<string, int64_t>::const_iterator itAddr = it->second.begin(); itAddr != it->second.end(); itAddr++)
+            pcontainer_->counters[make_pair(it->first, CAddressKey(itAddr->first))] = itAddr->second;
+    }
+}
+
+bool ActivateAddr::WriteChanges(CCacheDB &db, CLevelDBBatch &batch)
+{
+    if (fReplaced_) {
+        if (!db.EraseEntries<Te_t>(DB_CACHE_ACTIVATE, batch) ||
+            !db.EraseEntries<type_Color>(DB_CACHE_ACTIVATE_COLOR, batch))
+            return false;
+        for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++)
+            batch.Write(make_pair(DB_CACHE_ACTIVATE, it->first), it->second);
+        for (CHashSet<type_Color>::const_iterator it = pcontainer_->colors.begin(); it != pcontainer_->colors.end(); it++)
+            batch.Write(make_pair(DB_CACHE_ACTIVATE_COLOR, *it), true);
+    } else {
+        for (CHashSet<Te_t>::const_iterator it = changed_.begin(); it != changed_.end(); it++) {
+            Tc_t::const_iterator itCounter = pcontainer_->counters.find(*it);
+            if (itCounter != pcontainer_->end())
+                batch.Write(make_pair(DB_CACHE_ACTIVATE, *it), itCounter->second);
+            else
+                batch.Erase(make_pair(DB_CACHE_ACTIVATE, *it));
+        }
+        for (CHashSet<type_Color>::const_iterator it = changedColors_.begin(); it != changedColors_.end(); it++) {
+            if (IsColorExist(*it))
+                batch.Write(make_pair(DB_CACHE_ACTIVATE_COLOR, *it), true);
+            else
+                batch.Erase(make_pair(DB_CACHE_ACTIVATE_COLOR, *it));
+        }
+    }
+    return true;
+}
+
+void ActivateAddr::ClearChanges()
+{
+    changed_.clear();
+    changedColors_.clear();
+    fReplaced_ = false;
+}
+
+bool ActivateAddr::ReadEntries(CCacheDB &db, const int height)
+{
+    vector<pair<Te_t, int64_t> > counters;
+    vector<pair<type_Color, bool> > colors;
+    if (!db.ReadEntries(DB_CACHE_ACTIVATE, counters) || !db.ReadEntries(DB_CACHE_ACTIVATE_COLOR, colors))
+        return false;
+    RemoveAll();
+    pcontainer_->counters.insert(counters.begin(), counters.end());
+    for (vector<pair<type_Color, bool> >::const_iterator it = colors.begin(); it != colors.end(); it++)
+        pcontainer_->colors.insert(it->first);
+    changed_.clear();
+    changedColors_.clear();
+    fReplaced_ = false;
+    backupheight_ = height;
+    return true;
+}
+
 }
 
 // Namespace for cache of orders
 namespace order_list
 {
 
-bool OrderList::Remove(const Te_t &txinfo)
+bool OrderBook_::Insert(const Pair_t &pair, const order_info_ &info)
 {
-    pair<type_Color, type_Color> order_color(txinfo.GetTxOutColorOfIndex(1), txinfo.GetTxOutColorOfIndex(0));
+    if (index_.count(info.hash))
+        return false;
+    Entry_ &entry = index_[info.hash];
+    entry.pair = pair;
+    entry.nSequence = nNextSequence_++;
+    entry.it = books_[pair].insert(make_pair(order_price_(info.buy_amount, info.sell_amount), info));
+    return true;
+}
 
-    if (pcontainer_->find(order_color) == pcontainer_->end())
-        return true;
+const order_info_ *OrderBook_::Find(const uint256 &hash, Pair_t *ppair, uint64_t *pnSequence) const
+{
+    boost::unordered_map<uint256, Entry_, TxidHasher_>::const_iterator it = index_.find(hash);
+    if (it == index_.end())
+        return NULL;
+    if (ppair)
+        *ppair = it->second.pair;
+    if (pnSequence)
+        *pnSequence = it->second.nSequence;
+    return &it->second.it->second;
+}
 
-    struct order_info_ order_info;
-    order_info.hash = txinfo.GetTxHash();
-    order_info.address = txinfo.GetTxOutAddressOfIndex(1);
-    order_info.buy_amount = txinfo.GetTxOutValueOfIndex(1);
-    order_info.sell_amount = txinfo.GetTxOutValueOfIndex(0);
+bool OrderBook_::Erase(const uint256 &hash)
+{
+    boost::unordered_map<uint256, Entry_, TxidHasher_>::iterator it = index_.find(hash);
+    if (it == index_.end())
+        return false;
+    Books_t::iterator itBook = books_.find(it->second.pair);
+    itBook->second.erase(it->second.it);
+    if (itBook->second.empty())
+        books_.erase(itBook);
+    index_.erase(it);
+    return true;
+}
 
-    Tc_t::iterator it_tmp = pcontainer_->find(order_color);
-    if (it_tmp == pcontainer_->end())
+const OrderBook_::Levels_t *OrderBook_::GetLevels(const Pair_t &pair) const
+{
+    Books_t::const_iterator it = books_.find(pair);
+    if (it == books_.end())
+        return NULL;
+    return &it->second;
+}
+
+namespace
+{
+// Build the book entry of the ORDER transaction, which sells vout[0] for vout[1].
+void GetOrderInfo(const TxInfo &txinfo, OrderBook_::Pair_t &pair, order_info_ &info)
+{
+    pair = make_pair(txinfo.GetTxOutColorOfIndex(1), txinfo.GetTxOutColorOfIndex(0));
+    info.hash = txinfo.GetTxHash();
+    info.address = txinfo.GetTxOutAddressOfIndex(1);
+    info.buy_amount = txinfo.GetTxOutValueOfIndex(1);
+    info.sell_amount = txinfo.GetTxOutValueOfIndex(0);
+}
+}
+
+bool OrderList::Remove(const Te_t &txinfo)
+{
+    if (!IsExist(txinfo))
         return true;
-    vector<order_info_> InfoVec = it_tmp->second;
-    for (vector<order_info_>::iterator it = InfoVec.begin(); it != InfoVec.end(); it++) {
-        if (*it != order_info)
-            continue;
-        InfoVec.erase(it);
-        break;
-    }
-    if (InfoVec.size() == 0)
-        pcontainer_->erase(order_color);
+    pcontainer_->Erase(txinfo.GetTxHash());
+    changed_.insert(txinfo.GetTxHash());
     return true;
 }
 
 void OrderList::AddOrder(const TxInfo &txinfo)
 {
-    pair<type_Color, type_Color> order_color(txinfo.GetTxOutColorOfIndex(1), txinfo.GetTxOutColorOfIndex(0));
-
-    struct order_info_ order_info;
-    order_info.hash = txinfo.GetTxHash();
-    order_info.address = txinfo.GetTxOutAddressOfIndex(1);
-    order_info.buy_amount = txinfo.GetTxOutValueOfIndex(1);
-    order_info.sell_amount = txinfo.GetTxOutValueOfIndex(0);
-
-    (*pcontainer_)[order_color].push_back(order_info);
+    OrderBook_::Pair_t order_color;
+    order_info_ order_info;
+    GetOrderInfo(txinfo, order_color, order_info);
+    pcontainer_->Insert(order_color, order_info);
+    changed_.insert(order_info.hash);
 }
 
 bool OrderList::IsExist(const TxInfo &txinfo) const
 {
-    pair<type_Color, type_Color> order_color(txinfo.GetTxOutColorOfIndex(1), txinfo.GetTxOutColorOfIndex(0));
+    OrderBook_::Pair_t pair;
+    const order_info_ *pinfo = pcontainer_->Find(txinfo.GetTxHash(), &pair);
+    if (!pinfo)
+        return false;
 
-    struct order_info_ order_info;
-    order_info.hash = txinfo.GetTxHash();
-    order_info.address = txinfo.GetTxOutAddressOfIndex(1);
-    order_info.buy_amount = txinfo.GetTxOutValueOfIndex(1);
-    order_info.sell_amount = txinfo.GetTxOutValueOfIndex(0);
+    OrderBook_::Pair_t order_color;
+    order_info_ order_info;
+    GetOrderInfo(txinfo, order_color, order_info);
+    return (pair == order_color && *pinfo == order_info);
+}
 
-    if (pcontainer_->find(order_color) == pcontainer_->end())
+bool OrderList::GetBest(const type_Color &sellcolor, const type_Color &buycolor, order_info_ &info) const
+{
+    const OrderBook_::Levels_t *plevels = pcontainer_->GetLevels(make_pair(buycolor, sellcolor));
+    if (!plevels)
         return false;
+    info = plevels->begin()->second;
+    return true;
+}
+
+vector<order_info_> OrderList::GetBook(const type_Color &sellcolor, const type_Color &buycolor, size_t depth) const
+{
+    vector<order_info_> book;
+    const OrderBook_::Levels_t *plevels = pcontainer_->GetLevels(make_pair(buycolor, sellcolor));
+    if (!plevels)
+        return book;
+    for (OrderBook_::Levels_t::const_iterator it = plevels->begin(); it != plevels->end() && book.size() < depth; it++)
+        book.push_back(it->second);
+    return book;
+}
 
-    for (vector<order_info_>::iterator it = (*pcontainer_)[order_color].begin(); it != (*pcontainer_)[order_color].end(); it++) {
-        if (*it == order_info)
-            return true;
+vector<pair<uint256, uint256> > OrderList::FindMatches(const type_Color &colorA, const type_Color &colorB,
+                                                       bool (*fExclude)(const uint256 &hash), size_t max) const
+{
+    vector<pair<uint256, uint256> > matches;
+    const OrderBook_::Levels_t *plevelsA = pcontainer_->GetLevels(make_pair(colorB, colorA));
+    const OrderBook_::Levels_t *plevelsB = pcontainer_->GetLevels(make_pair(colorA, colorB));
+    if (!plevelsA || !plevelsB)
+        return matches;
+
+    set<uint256> matched;
+    for (OrderBook_::Levels_t::const_iterator itA = plevelsA->begin(); itA != plevelsA->end() && matches.size() < max; itA++) {
+        const order_info_ &a = itA->second;
+        if (fExclude && fExclude(a.hash))
+            continue;
+        for (OrderBook_::Levels_t::const_iterator itB = plevelsB->begin(); itB != plevelsB->end(); itB++) {
+            const order_info_ &b = itB->second;
+            // Crossing needs b.buy / b.sell <= a.sell / a.buy, which no order past this one meets
+            if (arith_uint256((uint64_t)b.buy_amount) * arith_uint256((uint64_t)a.buy_amount) >
+                arith_uint256((uint64_t)a.sell_amount) * arith_uint256((uint64_t)b.sell_amount))
+                break;
+            if (a.sell_amount < b.buy_amount || a.buy_amount > b.sell_amount)
+                continue;
+            if (matched.count(b.hash) || (fExclude && fExclude(b.hash)))
+                continue;
+            matched.insert(b.hash);
+            matches.push_back(make_pair(a.hash, b.hash));
+            break;
+        }
     }
+    return matches;
+}
 
-    return false;
+namespace
+{
+// The database entry of an order, its arrival sequence, pair and information.
+typedef pair<uint64_t, pair<OrderBook_::Pair_t, order_info_> > DiskOrder_;
+
+bool CompareDiskOrder(const pair<uint256, DiskOrder_> &a, const pair<uint256, DiskOrder_> &b)
+{
+    return a.second.first < b.second.first;
+}
 }
 
-vector<string> OrderList::GetList() const
+bool OrderList::WriteChanges(CCacheDB &db, CLevelDBBatch &batch)
 {
-    vector<string> List;
-    for (Tc_t::const_iterator it = pcontainer_->begin();
-         it != pcontainer_->end(); it++) {
-        for (vector<order_info_>::const_iterator itvec = it->second.begin(); itvec != it->second.end(); itvec++) {
-            std::stringstream out;
-            out << "hash: " << itvec->hash.ToString() << " color:" << it->first.second << " amount:" << itvec->sell_amount << " for color:" << it->first.first <<" amount:"<< itvec->buy_amount;
-            List.push_back(out.str());
+    DiskOrder_ order;
+    if (fReplaced_) {
+        if (!db.EraseEntries<uint256>(DB_CACHE_ORDER, batch))
+            return false;
+        for (Tc_t::const_iterator it = pcontainer_->begin(); it != pcontainer_->end(); it++) {
+            for (OrderBook_::Levels_t::const_iterator itLevel = it->second.begin(); itLevel != it->second.end(); itLevel++) {
+                pcontainer_->Find(itLevel->second.hash, NULL, &order.first);
+                order.second = make_pair(it->first, itLevel->second);
+                batch.Write(make_pair(DB_CACHE_ORDER, itLevel->second.hash), order);
+            }
+        }
+    } else {
+        for (set<uint256>::const_iterator it = changed_.begin(); it != changed_.end(); it++) {
+            const order_info_ *pinfo = pcontainer_->Find(*it, &order.second.first, &order.first);
+            if (pinfo) {
+                order.second.second = *pinfo;
+                batch.Write(make_pair(DB_CACHE_ORDER, *it), order);
+            } else
+                batch.Erase(make_pair(DB_CACHE_ORDER, *it));
         }
     }
-    return List;
+    return true;
+}
 
+void OrderList::ClearChanges()
+{
+    changed_.clear();
+    fReplaced_ = false;
 }
 
+bool OrderList::ReadEntries(CCacheDB &db, const int height)
+{
+    vector<pair<uint256, DiskOrder_> > entries;
+    if (!db.ReadEntries(DB_CACHE_ORDER, entries))
+        return false;
+    RemoveAll();
+    // Insert in arrival order, so that orders on the same price keep their priority.
+    sort(entries.begin(), entries.end(), CompareDiskOrder);
+    for (vector<pair<uint256, DiskOrder_> >::const_iterator it = entries.begin(); it != entries.end(); it++)
+        pcontainer_->Insert(it->second.second.first, it->second.second.second);
+    changed_.clear();
+    fReplaced_ = false;
+    backupheight_ = height;
+    return true;
+}
+
+}
+
+namespace
+{
+typedef map<string, vector<map<string, bool> > > VoteList_t;
+
+// True if the vote lists are replaced as a whole since the last written batch.
+bool fVoteListsReplaced = true;
+
+bool WriteVoteListChanges(CCacheDB &db, CLevelDBBatch &batch, const char chType,
+                          const VoteList_t &lists, const set<string> &changed)
+{
+    if (fVoteListsReplaced) {
+        if (!db.EraseEntries<string>(chType, batch))
+            return false;
+        for (VoteList_t::const_iterator it = lists.begin(); it != lists.end(); it++)
+            batch.Write(make_pair(chType, it->first), it->second);
+    } else {
+        for (set<string>::const_iterator it = changed.begin(); it != changed.end(); it++) {
+            VoteList_t::const_iterator itList = lists.find(*it);
+            if (itList != lists.end())
+                batch.Write(make_pair(chType, *it), itList->second);
+            else
+                batch.Erase(make_pair(chType, *it));
+        }
+    }
+    return true;
+}
+
+bool ReadVoteList(CCacheDB &db, const char chType, VoteList_t &lists)
+{
+    vector<pair<string, vector<map<string, bool> > > > entries;
+    if (!db.ReadEntries(chType, entries))
+        return false;
+    lists.clear();
+    lists.insert(entries.begin(), entries.end());
+    return true;
+}
+}
+
+void ClearAllCaches()
+{
+    palliance->RemoveAll();
+    plicense->RemoveAll();
+    pminer->RemoveAll();
+    pactivate->RemoveAll();
+    porder->RemoveAll();
+    VoteList.clear();
+    BanVoteList.clear();
+    VoteListChanged.clear();
+    BanVoteListChanged.clear();
+    fVoteListsReplaced = true;
+}
+
+bool WriteCacheState(CCacheDB &db, const int height, const uint256 &hashBlock, size_t &nBytes)
+{
+    CLevelDBBatch batch;
+    if (!palliance->WriteChanges(db, batch) ||
+        !plicense->WriteChanges(db, batch) ||
+        !pminer->WriteChanges(db, batch) ||
+        !pactivate->WriteChanges(db, batch) ||
+        !porder->WriteChanges(db, batch) ||
+        !WriteVoteListChanges(db, batch, DB_CACHE_VOTE, VoteList, VoteListChanged) ||
+        !WriteVoteListChanges(db, batch, DB_CACHE_BANVOTE, BanVoteList, BanVoteListChanged))
+        return error("%s: Failed to collect the cache changes", __func__);
+    db.WriteBestBlock(batch, height, hashBlock);
+    nBytes = batch.SizeEstimate();
+    try {
+        if (!db.WriteBatch(batch, true))
+            return error("%s: Failed to write the cache changes", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: Failed to write the cache changes - %s", __func__, e.what());
+    }
+    // Only forget the changes once they are on disk, a failed batch is queued again
+    palliance->ClearChanges();
+    plicense->ClearChanges();
+    pminer->ClearChanges();
+    pactivate->ClearChanges();
+    porder->ClearChanges();
+    VoteListChanged.clear();
+    BanVoteListChanged.clear();
+    fVoteListsReplaced = false;
+    return true;
+}
+
+bool ReadCacheState(CCacheDB &db, int &height, uint256 &hashBlock)
+{
+    try {
+        if (!db.ReadBestBlock(height, hashBlock))
+            return false;
+        if (!palliance->ReadEntries(db, height) ||
+            !plicense->ReadEntries(db, height) ||
+            !pminer->ReadEntries(db, height) ||
+            !pactivate->ReadEntries(db, height) ||
+            !porder->ReadEntries(db, height) ||
+            !ReadVoteList(db, DB_CACHE_VOTE, VoteList) ||
+            !ReadVoteList(db, DB_CACHE_BANVOTE, BanVoteList)) {
+            ClearAllCaches();
+            return error("%s: Failed to read the cache database", __func__);
+        }
+        VoteListChanged.clear();
+        BanVoteListChanged.clear();
+        fVoteListsReplaced = false;
+    } catch (const std::exception& e) {
+        ClearAllCaches();
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
 }
@@ -5,11 +5,13 @@
 #ifndef GCOIN_CACHE_H
 #define GCOIN_CACHE_H
 
+#include "arith_uint256.h"
 #include "chainparams.h"
 #include "clientversion.h"
 #include "hash.h"
 #include "policy/licenseinfo.h"
 #include "random.h"
+#include "serialize.h"
 #include "uint256.h"
 #include "util.h"
 
@@ -18,16 +20,171 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <string.h>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 
+class CCacheDB;
+class CLevelDBBatch;
+class CScript;
 class TxInfo;
 
+/*!
+ * @brief   The binary form of an address, used as the key of the caches.
+ * It keeps the key id or script id behind a base58 address, so looking up
+ * an address neither encodes nor compares strings.
+ */
+class CAddressKey
+{
+public:
+    CAddressKey() : type_(NONE) {}
+
+    /*!
+     * @brief   Decode a base58 address, an invalid one gives the null key.
+     */
+    explicit CAddressKey(const std::string &addr);
+
+    /*!
+     * @brief   Take the first destination of the script, the same one GetDestination() encodes.
+     */
+    explicit CAddressKey(const CScript &script);
+
+    /*!
+     * @brief   Encode the key back to its base58 address, the null key gives "".
+     */
+    std::string ToString() const;
+
+    /*!
+     * @brief   Build the standard script paying to the key, the null key gives an empty script.
+     */
+    CScript GetScript() const;
+
+    inline bool IsNull() const
+    {
+        return type_ == NONE;
+    }
+
+    friend inline bool operator==(const CAddressKey &a, const CAddressKey &b)
+    {
+        return a.type_ == b.type_ && a.id_ == b.id_;
+    }
+
+    friend inline bool operator!=(const CAddressKey &a, const CAddressKey &b)
+    {
+        return !(a == b);
+    }
+
+    friend inline bool operator<(const CAddressKey &a, const CAddressKey &b)
+    {
+        return a.type_ < b.type_ || (a.type_ == b.type_ && a.id_ < b.id_);
+    }
+
+    friend inline std::size_t hash_value(const CAddressKey &key)
+    {
+        // The ids are hash outputs already, any slice of them is evenly spread.
+        std::size_t h;
+        memcpy(&h, key.id_.begin(), sizeof(h));
+        return h ^ key.type_;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(type_);
+        READWRITE(id_);
+    }
+
+private:
+    enum { NONE = 0, KEY_ID = 1, SCRIPT_ID = 2 };
+
+    unsigned char type_;
+    uint160 id_;
+};
+
+/*!
+ * @brief   Hash set which serializes as the sequence of its elements.
+ */
+template <class K>
+class CHashSet : public boost::unordered_set<K>
+{
+public:
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(this->size());
+        for (typename CHashSet::const_iterator it = this->begin(); it != this->end(); ++it)
+            nSize += ::GetSerializeSize(*it, nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, this->size());
+        for (typename CHashSet::const_iterator it = this->begin(); it != this->end(); ++it)
+            ::Serialize(s, *it, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion)
+    {
+        this->clear();
+        unsigned int nSize = ReadCompactSize(s);
+        this->reserve(nSize);
+        for (unsigned int i = 0; i < nSize; i++) {
+            K key;
+            ::Unserialize(s, key, nType, nVersion);
+            this->insert(key);
+        }
+    }
+};
+
+/*!
+ * @brief   Hash map which serializes as the sequence of its key-value pairs.
+ */
+template <class K, class V>
+class CHashMap : public boost::unordered_map<K, V>
+{
+public:
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(this->size());
+        for (typename CHashMap::const_iterator it = this->begin(); it != this->end(); ++it)
+            nSize += ::GetSerializeSize(it->first, nType, nVersion) + ::GetSerializeSize(it->second, nType, nVersion);
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, this->size());
+        for (typename CHashMap::const_iterator it = this->begin(); it != this->end(); ++it) {
+            ::Serialize(s, it->first, nType, nVersion);
+            ::Serialize(s, it->second, nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion)
+    {
+        this->clear();
+        unsigned int nSize = ReadCompactSize(s);
+        this->reserve(nSize);
+        for (unsigned int i = 0; i < nSize; i++) {
+            std::pair<K, V> item;
+            ::Unserialize(s, item, nType, nVersion);
+            this->insert(item);
+        }
+    }
+};
+
 /*!
  * @brief The interface for all kinds of cache.
  */
@@ -35,7 +192,7 @@ template <class Tc, class Te>
 class CacheInterface
 {
 public:
-    CacheInterface()
+    CacheInterface() : backupheight_(0), fReplaced_(true)
     {
         pcontainer_ = new Tc();
     }
@@ -82,54 +239,6 @@ public:
         return backupheight_;
     }
 
-    /*!
-     * @brief   Write the current cache status into disk.
-     * @param   height  The backing up height to be recorded.
-     * @return  True if the writing process is successful.
-     */
-    bool WriteDisk(const int height)
-    {
-        boost::filesystem::path pathAddr = GetDataDir() / filename_;
-        // Generate random temporary filename
-        unsigned short randv = 0;
-        GetRandBytes((unsigned char*)&randv, sizeof(randv));
-        std::string tmpfn = strprintf("%s.%04x", filename_, randv);
-        backupheight_ = height;
-
-        // serialize addresses, checksum data up to that point, then append csum
-        CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
-        ssPeers << FLATDATA(Params().MessageStart());
-        ssPeers << backupheight_;
-        ssPeers << *pcontainer_;
-        uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
-        ssPeers << hash;
-
-        // open temp output file, and associate with CAutoFile
-        boost::filesystem::path pathTmp = GetDataDir() / tmpfn;
-        FILE *file = fopen(pathTmp.string().c_str(), "wb");
-        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-        if (fileout.IsNull())
-            //return error("%s: Failed to open file %s", __func__, pathTmp.string());
-            return false;
-
-        // Write and commit header, data
-        try {
-            fileout << ssPeers;
-        } catch (const std::exception& e) {
-            //return error("%s: Serialize or I/O error - %s", __func__, e.what());
-            return false;
-        }
-        FileCommit(fileout.Get());
-        fileout.fclose();
-
-        // replace existing peers.dat, if any, with new peers.dat.XXXX
-        if (!RenameOver(pathTmp, pathAddr))
-            //return error("%s: Rename-into-place failed", __func__);i
-            return false;
-
-        return true;
-    }
-
     /*!
      * @brief   Read the disk data into cache.
      * @return  True if the reading process is successful.
@@ -183,9 +292,9 @@ public:
                 //return error("%s: Invalid network magic number", __func__);
                 return false;
 
-            // de-serialize address data into one CAddrMan object
+            // de-serialize the height and the string keyed content
             ssPeers >> backupheight_;
-            ssPeers >> *pcontainer_;
+            ReadLegacy(ssPeers);
         } catch (const std::exception& e) {
             //return error("%s: Deserialize or I/O error - %s", __func__, e.what());
             return false;
@@ -194,6 +303,32 @@ public:
         return true;
     }
 
+    /*!
+     * @brief   Queue the entries changed since the last written batch into a batch of the cache database.
+     * If the whole content was replaced since then, every entry is rewritten.
+     * @param   db      The cache database.
+     * @param   batch   The batch to be written.
+     * @return  True if the changes are queued successfully.
+     */
+    virtual bool WriteChanges(CCacheDB &db, CLevelDBBatch &batch) = 0;
+
+    /*!
+     * @brief   Forget the changes queued by WriteChanges(), once their batch is written.
+     * Until then they are kept, so that a batch which fails is queued again by the next call.
+     */
+    virtual void ClearChanges()
+    {
+        fReplaced_ = false;
+    }
+
+    /*!
+     * @brief   Replace the cache content with the entries of the cache database.
+     * @param   db      The cache database.
+     * @param   height  The block height the database was written at.
+     * @return  True if the entries are read successfully.
+     */
+    virtual bool ReadEntries(CCacheDB &db, const int height) = 0;
+
     typedef typename Tc::const_iterator CIterator;
 
     inline CIterator IteratorBegin()
@@ -207,10 +342,22 @@ public:
     }
 
 protected:
+    /*!
+     * @brief   Read the container in the string keyed layout of the .dat files.
+     * Caches whose container has changed since then convert the content here.
+     * @param   s   The stream to be read.
+     */
+    virtual void ReadLegacy(CDataStream &s)
+    {
+        s >> *pcontainer_;
+    }
+
     // The pointer to the container.
     Tc *pcontainer_;
     // Disk backed up height.
     int backupheight_;
+    // True if the whole content is replaced since the last written batch.
+    bool fReplaced_;
     // Filename on the disk.
     std::string filename_;
 };
@@ -221,8 +368,8 @@ namespace alliance_member
 
 namespace
 {
-typedef std::set<std::string> Tc_t;
-typedef std::string Te_t;
+typedef CHashSet<CAddressKey> Tc_t;
+typedef CAddressKey Te_t;
 }
 
 /*!
@@ -244,18 +391,32 @@ public:
     inline bool Add(const Te_t &addr)
     {
         pcontainer_->insert(addr);
+        changed_.insert(addr);
         return true;
     }
 
+    inline bool Add(const std::string &addr)
+    {
+        return Add(CAddressKey(addr));
+    }
+
     inline bool Remove(const Te_t &addr)
     {
         pcontainer_->erase(addr);
+        changed_.insert(addr);
         return true;
     }
 
+    inline bool Remove(const std::string &addr)
+    {
+        return Remove(CAddressKey(addr));
+    }
+
     inline bool RemoveAll()
     {
         pcontainer_->clear();
+        changed_.clear();
+        fReplaced_ = true;
         return true;
     }
 
@@ -264,11 +425,16 @@ public:
      * @param   addr    The address to be checked.
      * @return  True if the address is an alliance member.
      */
-    inline bool IsMember(const std::string &addr) const
+    inline bool IsMember(const Te_t &addr) const
     {
         return (pcontainer_->find(addr) != pcontainer_->end());
     }
 
+    inline bool IsMember(const std::string &addr) const
+    {
+        return IsMember(CAddressKey(addr));
+    }
+
     /*!
      * @brief   Check the amount of alliance member.
      */
@@ -276,6 +442,24 @@ public:
     {
         return pcontainer_->size();
     }
+
+    /*!
+     * @brief   List the addresses of the alliance members in sorted order.
+     */
+    std::set<std::string> ListMembers() const;
+
+    bool WriteChanges(CCacheDB &db, CLevelDBBatch &batch);
+
+    void ClearChanges();
+
+    bool ReadEntries(CCacheDB &db, const int height);
+
+protected:
+    void ReadLegacy(CDataStream &s);
+
+private:
+    // Members added or removed since the last written batch.
+    CHashSet<CAddressKey> changed_;
 };
 }
 
@@ -288,12 +472,12 @@ namespace color_license
 struct Owner_
 {
     // Owner address for the color.
-    std::string address_;
+    CAddressKey address_;
     // Minted amount for the color.
     int64_t num_of_coins_;
     // License information for the color.
     CLicenseInfo info_;
-    Owner_() : address_(""), num_of_coins_(0) {}
+    Owner_() : num_of_coins_(0) {}
 
     ADD_SERIALIZE_METHODS;
 
@@ -307,7 +491,7 @@ struct Owner_
 
 namespace
 {
-typedef std::map<type_Color, Owner_> Tc_t;
+typedef CHashMap<type_Color, Owner_> Tc_t;
 typedef std::pair<type_Color, Owner_> Te_t;
 }
 
@@ -334,6 +518,7 @@ public:
     inline bool RemoveColor(const type_Color &color)
     {
         pcontainer_->erase(color);
+        changed_.insert(color);
         return true;
     }
 
@@ -343,13 +528,16 @@ public:
      */
     inline bool RemoveOwner(const type_Color &color)
     {
-        (*pcontainer_)[color].address_ = "";
+        Entry_(color).address_ = CAddressKey();
+        changed_.insert(color);
         return true;
     }
 
     inline bool RemoveAll()
     {
         pcontainer_->clear();
+        changed_.clear();
+        fReplaced_ = true;
         return true;
     }
 
@@ -377,7 +565,8 @@ public:
      */
     inline void AddNumOfCoins(const type_Color &color, int64_t num_of_coins)
     {
-        (*pcontainer_)[color].num_of_coins_ += num_of_coins;
+        Entry_(color).num_of_coins_ += num_of_coins;
+        changed_.insert(color);
     }
 
     /*!
@@ -395,7 +584,7 @@ public:
     inline bool HasColorOwner(const type_Color &color) const
     {
         Tc_t::iterator it = pcontainer_->find(color);
-        return (it != pcontainer_->end() && it->second.address_ != "");
+        return (it != pcontainer_->end() && !it->second.address_.IsNull());
     }
 
     /*!
@@ -404,12 +593,17 @@ public:
      * @param   addr    The address to be checked.
      * @return  True of the address is the owner of the given color.
      */
-    inline bool IsColorOwner(const type_Color &color, std::string &addr) const
+    inline bool IsColorOwner(const type_Color &color, const CAddressKey &addr) const
     {
         Tc_t::iterator it = pcontainer_->find(color);
         return (it != pcontainer_->end() && it->second.address_ == addr);
     }
 
+    inline bool IsColorOwner(const type_Color &color, const std::string &addr) const
+    {
+        return IsColorOwner(color, CAddressKey(addr));
+    }
+
     /*!
      * @brief   Return the minted amount of coin of the given color.
      * @param   The color to be checked.
@@ -438,7 +632,7 @@ public:
      */
     inline bool IsMemberOnly(const type_Color &color) const
     {
-        return (*pcontainer_)[color].info_.fMemberControl;
+        return Find_(color).info_.fMemberControl;
     }
 
     /*!
@@ -448,8 +642,45 @@ public:
      */
     inline int64_t GetUpperLimit(const type_Color &color) const
     {
-        return (*pcontainer_)[color].info_.nLimit;
+        return Find_(color).info_.nLimit;
     }
+
+    bool WriteChanges(CCacheDB &db, CLevelDBBatch &batch);
+
+    void ClearChanges();
+
+    bool ReadEntries(CCacheDB &db, const int height);
+
+protected:
+    void ReadLegacy(CDataStream &s);
+
+private:
+    /*!
+     * @brief   Get the entry of the color, a missing one is created like operator[] does.
+     * The created entry is recorded as a change as well.
+     */
+    inline Owner_ &Entry_(const type_Color &color)
+    {
+        Tc_t::iterator it = pcontainer_->find(color);
+        if (it != pcontainer_->end())
+            return it->second;
+        changed_.insert(color);
+        return (*pcontainer_)[color];
+    }
+
+    /*!
+     * @brief   Get the entry of the color without creating it, an unknown color reads as an empty entry.
+     * The read path runs on the type check threads, so it must leave the container untouched.
+     */
+    inline const Owner_ &Find_(const type_Color &color) const
+    {
+        static const Owner_ empty;
+        Tc_t::const_iterator it = pcontainer_->find(color);
+        return it != pcontainer_->end() ? it->second : empty;
+    }
+
+    // Colors changed since the last written batch.
+    CHashSet<type_Color> changed_;
 };
 }
 
@@ -468,7 +699,7 @@ typedef std::string Te_t;
 class BlockMiner : public CacheInterface<Tc_t, Te_t>
 {
 public:
-    BlockMiner()
+    BlockMiner() : nextSeq_(0)
     {
         filename_ = "miner.dat";
     }
@@ -482,14 +713,19 @@ public:
 
     inline bool Remove()
     {
-        if (!pcontainer_->empty())
+        if (!pcontainer_->empty()) {
             pcontainer_->pop_front();
+            changed_.insert(--nextSeq_);
+        }
         return true;
     }
 
     inline bool RemoveAll()
     {
         pcontainer_->clear();
+        nextSeq_ = 0;
+        changed_.clear();
+        fReplaced_ = true;
         return true;
     }
 
@@ -501,6 +737,20 @@ public:
      */
     unsigned int NumOfMined(std::string addr, unsigned int nAlliance) const;
 
+    bool WriteChanges(CCacheDB &db, CLevelDBBatch &batch);
+
+    void ClearChanges();
+
+    bool ReadEntries(CCacheDB &db, const int height);
+
+protected:
+    void ReadLegacy(CDataStream &s);
+
+private:
+    // Sequence number of the next block added, the i-th entry of the list has nextSeq_ - 1 - i.
+    uint64_t nextSeq_;
+    // Sequence numbers of the entries added or removed since the last written batch.
+    std::set<uint64_t> changed_;
 };
 }
 
@@ -508,10 +758,48 @@ public:
 namespace activate_addr
 {
 
+/*!
+ * @brief   The flat activation table, one counter for each pair of color and address.
+ */
+struct ActivateTable_
+{
+    typedef CHashMap<std::pair<type_Color, CAddressKey>, int64_t> Counters_t;
+    typedef Counters_t::const_iterator const_iterator;
+
+    // Activation counter of each color and address.
+    Counters_t counters;
+    // Colors with an activation record, kept after all their addresses are removed.
+    CHashSet<type_Color> colors;
+
+    inline const_iterator begin() const
+    {
+        return counters.begin();
+    }
+
+    inline const_iterator end() const
+    {
+        return counters.end();
+    }
+
+    inline void clear()
+    {
+        counters.clear();
+        colors.clear();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(counters);
+        READWRITE(colors);
+    }
+};
+
 namespace
 {
-typedef std::map<type_Color, std::map<std::string, int64_t> > Tc_t;
-typedef std::pair<type_Color, std::string> Te_t;
+typedef ActivateTable_ Tc_t;
+typedef std::pair<type_Color, CAddressKey> Te_t;
 }
 
 /*!
@@ -532,19 +820,28 @@ public:
 
     inline bool Add(const Te_t &e)
     {
-        (*pcontainer_)[e.first][e.second] = 1;
+        pcontainer_->counters[e] = 1;
+        pcontainer_->colors.insert(e.first);
+        changed_.insert(e);
+        changedColors_.insert(e.first);
         return true;
     }
 
-    inline bool Remove(const std::pair<type_Color, std::string> &e)
+    inline bool Remove(const Te_t &e)
     {
-        (*pcontainer_)[e.first].erase(e.second);
+        pcontainer_->counters.erase(e);
+        pcontainer_->colors.insert(e.first);
+        changed_.insert(e);
+        changedColors_.insert(e.first);
         return true;
     }
 
     inline bool RemoveAll()
     {
         pcontainer_->clear();
+        changed_.clear();
+        changedColors_.clear();
+        fReplaced_ = true;
         return true;
     }
 
@@ -553,11 +850,7 @@ public:
      * @param   color   The color to be removed.
      * @return  True if the remove process is successful.
      */
-    inline bool RemoveColor(const type_Color &color)
-    {
-        pcontainer_->erase(color);
-        return true;
-    }
+    bool RemoveColor(const type_Color &color);
 
     /*!
      * @brief   Activate the given address with specific color.
@@ -565,7 +858,12 @@ public:
      * @param   addr    The address to be activated.
      * @return  True if the activation is successful.
      */
-    bool Activate(const type_Color &color, const std::string &addr);
+    bool Activate(const type_Color &color, const CAddressKey &addr);
+
+    inline bool Activate(const type_Color &color, const std::string &addr)
+    {
+        return Activate(color, CAddressKey(addr));
+    }
 
     /*!
      * @brief   Deactivate the given address which was activated with specific color.
@@ -573,7 +871,12 @@ public:
      * @param   addr    The address to be deactivated.
      * @return  True if the deactivation is successful.
      */
-    bool Deactivate(const type_Color &color, const std::string &addr);
+    bool Deactivate(const type_Color &color, const CAddressKey &addr);
+
+    inline bool Deactivate(const type_Color &color, const std::string &addr)
+    {
+        return Deactivate(color, CAddressKey(addr));
+    }
 
     /*!
      * @brief   Check if the color exists in the activation list.
@@ -582,7 +885,7 @@ public:
      */
     inline bool IsColorExist(const type_Color &color) const
     {
-        return (pcontainer_->find(color) != pcontainer_->end());
+        return (pcontainer_->colors.find(color) != pcontainer_->colors.end());
     }
 
     /*!
@@ -591,13 +894,29 @@ public:
      * @param   addr    The address to be checked.
      * @return  True if the address is activated with the given color.
      */
+    inline bool IsActivated(const type_Color &color, const CAddressKey &addr) const
+    {
+        return (pcontainer_->counters.find(std::make_pair(color, addr)) != pcontainer_->counters.end());
+    }
+
     inline bool IsActivated(const type_Color &color, const std::string &addr) const
     {
-        Tc_t::iterator it;
-        it = pcontainer_->find(color);
-        return (IsColorExist(color) &&
-                it->second.find(addr) != it->second.end());
+        return IsActivated(color, CAddressKey(addr));
     }
+
+    bool WriteChanges(CCacheDB &db, CLevelDBBatch &batch);
+
+    void ClearChanges();
+
+    bool ReadEntries(CCacheDB &db, const int height);
+
+protected:
+    void ReadLegacy(CDataStream &s);
+
+private:
+    // Counters and colors changed since the last written batch.
+    CHashSet<Te_t> changed_;
+    CHashSet<type_Color> changedColors_;
 };
 
 }
@@ -644,9 +963,149 @@ struct order_info_
     }
 };
 
+/*!
+ * @brief   The price of an order, the amount it buys for the amount it sells.
+ * Prices are compared by cross multiplication, so no precision is lost.
+ */
+struct order_price_
+{
+    int64_t buy_amount, sell_amount;
+
+    order_price_(int64_t buy, int64_t sell) : buy_amount(buy), sell_amount(sell) {}
+
+    bool operator<(const order_price_ &b) const
+    {
+        return arith_uint256((uint64_t)buy_amount) * arith_uint256((uint64_t)b.sell_amount) <
+               arith_uint256((uint64_t)b.buy_amount) * arith_uint256((uint64_t)sell_amount);
+    }
+};
+
+/*!
+ * @brief   The order book of all the resting orders.
+ * Each pair of (buy color, sell color) has a price-level tree with the
+ * cheapest order first and the older one first on the same price, and
+ * every order is indexed by its txid.
+ * It serializes in the same layout as the order vectors it replaces.
+ */
+class OrderBook_
+{
+public:
+    typedef std::pair<type_Color, type_Color> Pair_t;
+    typedef std::multimap<order_price_, order_info_> Levels_t;
+    typedef std::map<Pair_t, Levels_t> Books_t;
+    typedef Books_t::const_iterator const_iterator;
+
+    OrderBook_() : nNextSequence_(0) {}
+
+    /*!
+     * @brief   Add an order to the book of the pair.
+     * @return  False if an order with the same txid is already in the book.
+     */
+    bool Insert(const Pair_t &pair, const order_info_ &info);
+
+    /*!
+     * @brief   Find the order with the given txid.
+     * @param   ppair       Set to the pair of the order if not NULL.
+     * @param   pnSequence  Set to the arrival sequence of the order if not NULL.
+     * @return  The order, or NULL if it is not in the book.
+     */
+    const order_info_ *Find(const uint256 &hash, Pair_t *ppair = NULL, uint64_t *pnSequence = NULL) const;
+
+    /*!
+     * @brief   Remove the order with the given txid.
+     * @return  False if the order is not in the book.
+     */
+    bool Erase(const uint256 &hash);
+
+    /*!
+     * @brief   Get the book of the given pair, NULL if it has no order.
+     */
+    const Levels_t *GetLevels(const Pair_t &pair) const;
+
+    inline size_t size() const
+    {
+        return index_.size();
+    }
+
+    inline const_iterator begin() const
+    {
+        return books_.begin();
+    }
+
+    inline const_iterator end() const
+    {
+        return books_.end();
+    }
+
+    inline void clear()
+    {
+        books_.clear();
+        index_.clear();
+        nNextSequence_ = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSize = GetSizeOfCompactSize(books_.size());
+        for (const_iterator it = books_.begin(); it != books_.end(); ++it) {
+            nSize += ::GetSerializeSize(it->first, nType, nVersion) + GetSizeOfCompactSize(it->second.size());
+            for (Levels_t::const_iterator itLevel = it->second.begin(); itLevel != it->second.end(); ++itLevel)
+                nSize += ::GetSerializeSize(itLevel->second, nType, nVersion);
+        }
+        return nSize;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, books_.size());
+        for (const_iterator it = books_.begin(); it != books_.end(); ++it) {
+            ::Serialize(s, it->first, nType, nVersion);
+            WriteCompactSize(s, it->second.size());
+            for (Levels_t::const_iterator itLevel = it->second.begin(); itLevel != it->second.end(); ++itLevel)
+                ::Serialize(s, itLevel->second, nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion)
+    {
+        clear();
+        unsigned int nBooks = ReadCompactSize(s);
+        for (unsigned int i = 0; i < nBooks; i++) {
+            Pair_t pair;
+            ::Unserialize(s, pair, nType, nVersion);
+            unsigned int nOrders = ReadCompactSize(s);
+            for (unsigned int j = 0; j < nOrders; j++) {
+                order_info_ info;
+                ::Unserialize(s, info, nType, nVersion);
+                Insert(pair, info);
+            }
+        }
+    }
+
+private:
+    struct TxidHasher_
+    {
+        size_t operator()(const uint256 &hash) const { return hash.GetCheapHash(); }
+    };
+
+    struct Entry_
+    {
+        Pair_t pair;
+        Levels_t::iterator it;
+        uint64_t nSequence;
+    };
+
+    Books_t books_;
+    boost::unordered_map<uint256, Entry_, TxidHasher_> index_;
+    // Arrival sequence of the next order, so that the database can restore the arrival order.
+    uint64_t nNextSequence_;
+};
+
 namespace
 {
-typedef map<pair<type_Color, type_Color>, vector<order_info_> > Tc_t;
+typedef OrderBook_ Tc_t;
 typedef TxInfo Te_t;
 }
 
@@ -668,6 +1127,8 @@ public:
     inline bool RemoveAll()
     {
         pcontainer_->clear();
+        changed_.clear();
+        fReplaced_ = true;
         return true;
     }
 
@@ -675,8 +1136,49 @@ public:
 
     bool IsExist(const TxInfo &txinfo) const;
 
-    std::vector<std::string> GetList() const;
+    bool WriteChanges(CCacheDB &db, CLevelDBBatch &batch);
 
+    void ClearChanges();
+
+    bool ReadEntries(CCacheDB &db, const int height);
+
+    /*!
+     * @brief   Get the cheapest resting order which sells one color for another.
+     * @param   sellcolor   The color the order sells.
+     * @param   buycolor    The color the order buys.
+     * @param   info        The referenced order information.
+     * @return  False if no order sells the color for the other.
+     */
+    bool GetBest(const type_Color &sellcolor, const type_Color &buycolor, order_info_ &info) const;
+
+    /*!
+     * @brief   List the resting orders which sell one color for another, cheapest first.
+     * @param   sellcolor   The color the orders sell.
+     * @param   buycolor    The color the orders buy.
+     * @param   depth       The maximum amount of orders to be listed.
+     * @return  The orders in price order, the older one first on the same price.
+     */
+    std::vector<order_info_> GetBook(const type_Color &sellcolor, const type_Color &buycolor, size_t depth) const;
+
+    /*!
+     * @brief   Find the pairs of resting orders which cross, as the MATCH handler checks them:
+     *          the first order sells at least what the second buys, and buys at most what it sells.
+     *          Orders selling the first color are taken in price order, the older one first on the
+     *          same price, and each is paired with the best order of the other side it crosses.
+     *          An order is in one pair at most.
+     * @param   colorA      The color sold by the first order of each pair.
+     * @param   colorB      The color sold by the second order of each pair.
+     * @param   fExclude    Tells the orders to be left out, e.g. ones already spent in the mempool, NULL for none.
+     *                      It is only asked about the orders which are reached.
+     * @param   max         The maximum amount of pairs.
+     * @return  The txids of the paired orders.
+     */
+    std::vector<std::pair<uint256, uint256> > FindMatches(const type_Color &colorA, const type_Color &colorB,
+                                                          bool (*fExclude)(const uint256 &hash), size_t max) const;
+
+private:
+    // Orders added or removed since the last written batch.
+    std::set<uint256> changed_;
 };
 }
 
@@ -686,4 +1188,29 @@ extern block_miner::BlockMiner *pminer;
 extern activate_addr::ActivateAddr *pactivate;
 extern order_list::OrderList *porder;
 
+/*!
+ * @brief   Clear all the caches and the vote lists.
+ */
+void ClearAllCaches();
+
+/*!
+ * @brief   Write the cache entries changed since the last write into the cache database.
+ * The changes and the block they belong to are written in one synced batch.
+ * @param   db          The cache database.
+ * @param   height      The height of the block the caches correspond to.
+ * @param   hashBlock   The hash of that block.
+ * @param   nBytes      Set to the approximate amount of bytes written.
+ * @return  True if the batch is written.
+ */
+bool WriteCacheState(CCacheDB &db, const int height, const uint256 &hashBlock, size_t &nBytes);
+
+/*!
+ * @brief   Load the caches and the vote lists from the cache database.
+ * @param   db          The cache database.
+ * @param   height      The height recorded in the database.
+ * @param   hashBlock   The block hash recorded in the database.
+ * @return  True if the database holds a complete state and it is loaded.
+ */
+bool ReadCacheState(CCacheDB &db, int &height, uint256 &hashBlock);
+
 #endif // GCOIN_CACHE_H
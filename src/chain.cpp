@@ -12,14 +12,21 @@ using namespace std;
  */
 void CChain::SetTip(CBlockIndex *pindex) {
     if (pindex == NULL) {
+        if (!vChain.empty())
+            nDisconnectEpoch++;
         vChain.clear();
         return;
     }
+    bool fDisconnect = (int)vChain.size() > pindex->nHeight + 1;
     vChain.resize(pindex->nHeight + 1);
     while (pindex && vChain[pindex->nHeight] != pindex) {
+        if (vChain[pindex->nHeight])
+            fDisconnect = true;
         vChain[pindex->nHeight] = pindex;
         pindex = pindex->pprev;
     }
+    if (fDisconnect)
+        nDisconnectEpoch++;
 }
 
 CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const {
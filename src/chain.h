@@ -87,11 +87,14 @@ enum BlockStatus {
 
     BLOCK_HAVE_DATA          =    8, //! full block available in blk*.dat
     BLOCK_HAVE_UNDO          =   16, //! undo data available in rev*.dat
-    BLOCK_HAVE_MASK          =   BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO,
+    BLOCK_HAVE_GCOIN_UNDO    =  128, //! undo data for the gcoin caches follows the undo data in rev*.dat
+    BLOCK_HAVE_MASK          =   BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_HAVE_GCOIN_UNDO,
 
     BLOCK_FAILED_VALID       =   32, //! stage after last reached validness failed
     BLOCK_FAILED_CHILD       =   64, //! descends from failed block
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
+
+    BLOCK_HAVE_MINER         =  256, //! minerKeyId is known
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -138,6 +141,9 @@ public:
     //! Verification status of this block. See enum BlockStatus
     unsigned int nStatus;
 
+    //! Key id of the address the coinbase of this block pays to (only if BLOCK_HAVE_MINER)
+    uint160 minerKeyId;
+
     //! block header
     int nVersion;
     uint256 hashMerkleRoot;
@@ -161,6 +167,7 @@ public:
         nTx = 0;
         nChainTx = 0;
         nStatus = 0;
+        minerKeyId = uint160();
         nSequenceId = 0;
 
         nVersion       = 0;
@@ -320,6 +327,22 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nNonce);
+
+        // Last, so that older versions read the rest of the record and ignore it.
+        // They keep the status bit but drop the key when they write the record
+        // again, in which case the key is looked up again.
+        if (nStatus & BLOCK_HAVE_MINER) {
+            if (ser_action.ForRead()) {
+                try {
+                    READWRITE(minerKeyId);
+                } catch (const std::ios_base::failure&) {
+                    nStatus &= ~BLOCK_HAVE_MINER;
+                    minerKeyId = uint160();
+                }
+            } else {
+                READWRITE(minerKeyId);
+            }
+        }
     }
 
     uint256 GetBlockHash() const
@@ -350,8 +373,11 @@ public:
 class CChain {
 private:
     std::vector<CBlockIndex*> vChain;
+    unsigned int nDisconnectEpoch;
 
 public:
+    CChain() : nDisconnectEpoch(1) {}
+
     /** Returns the index entry for the genesis block of this chain, or NULL if none. */
     CBlockIndex *Genesis() const {
         return vChain.size() > 0 ? vChain[0] : NULL;
@@ -396,6 +422,11 @@ public:
     /** Set/initialize a chain with a given tip. */
     void SetTip(CBlockIndex *pindex);
 
+    /** Return a counter advanced each time blocks are taken off the chain, extending it leaves the counter as it is. */
+    unsigned int GetDisconnectEpoch() const {
+        return nDisconnectEpoch;
+    }
+
     /** Return a CBlockLocator that refers to a block in this chain (by default the tip). */
     CBlockLocator GetLocator(const CBlockIndex *pindex = NULL) const;
 
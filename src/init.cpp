@@ -21,6 +21,7 @@
 #include "miner.h"
 #include "net.h"
 #include "rpcserver.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "txdb.h"
@@ -188,6 +189,8 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete pcachedb;
+        pcachedb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -287,7 +290,6 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-keypoolnotify=<cmd>", _("Execute command when keypool size is lower than the amount defined by keypoolnotifysize (%d in cmd is replaced by the amount of remaining keys)"));
     strUsage += HelpMessageOpt("-keypoolnotifysize=<n>", _("Specify the size of keypool to be notified (default: 100)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288));
-    strUsage += HelpMessageOpt("-cachebackupfreq=<n>", strprintf(_("How frequent should the cache be backed up by height (default: %u, 0 = never)"), 200));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "gcoin.conf"));
     if (mode == HMM_BITCOIND) {
@@ -301,6 +303,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parchecks=<n>", strprintf(_("Set the number of transaction type verification threads, and of block signature verification threads (0 to %d, 0 = verify on the validating thread, default: %d)"),
+        MAX_SCRIPTCHECK_THREADS, DEFAULT_CHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "gcoind.pid"));
 #endif
@@ -393,7 +397,8 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 1));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachemb=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", "Deprecated, limit size of signature cache to about <n> entries, unless -maxsigcachemb is set");
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in BTC/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-printtoconsole", _("Send trace/debug info to console instead of debug.log file"));
@@ -813,6 +818,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    nCheckThreads = std::max(0, std::min(MAX_SCRIPTCHECK_THREADS, (int)GetArg("-parchecks", DEFAULT_CHECK_THREADS)));
 
     fServer = GetBoolArg("-server", false);
 
@@ -950,11 +956,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    InitSignatureCache();
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
-    if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
-            threadGroup.create_thread(&ThreadScriptCheck);
-    }
+    LogPrintf("Using %u threads each for transaction type and block signature verification\n", nCheckThreads);
+    StartCheckThreads(threadGroup);
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1101,10 +1107,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     porder = new order_list::OrderList();
 
     fReindex = GetBoolArg("-reindex", false);
+    // The cache database is left alone when the caches are disabled
+    if (!fDisableCache)
+        pcachedb = new CCacheDB(nCacheStateDbCache, false, fReindex);
 
     // When reindex, ignore all the cache
     if (fDisableCache || fReindex) {
         LogPrintf("Cache from disk disabled!\n");
+    } else if (LoadCacheSnapshot()) {
+        LogPrintf("Cache loaded from the cache database\n");
     } else {
         if (!palliance->ReadDisk()) {
             uiInterface.InitMessage(_("Error loading member.dat: Backup corrupted"));
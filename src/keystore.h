@@ -83,6 +83,14 @@ public:
             }
         }
     }
+    //! Ids of at most nMax keys following keyAfter, in order
+    virtual void GetKeysAfter(const CKeyID &keyAfter, unsigned int nMax, std::vector<CKeyID> &vKeyOut) const
+    {
+        vKeyOut.clear();
+        LOCK(cs_KeyStore);
+        for (KeyMap::const_iterator mi = mapKeys.upper_bound(keyAfter); mi != mapKeys.end() && vKeyOut.size() < nMax; mi++)
+            vKeyOut.push_back((*mi).first);
+    }
     bool GetKey(const CKeyID &address, CKey &keyOut) const
     {
         {
@@ -31,8 +31,14 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    size_t nSize;
 
 public:
+    CLevelDBBatch() : nSize(0) {}
+
+    //! Approximate amount of bytes of the keys and values queued in the batch.
+    size_t SizeEstimate() const { return nSize; }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +53,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nSize += ssKey.size() + ssValue.size();
     }
 
     template <typename K>
@@ -58,6 +65,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nSize += ssKey.size();
     }
 };
 
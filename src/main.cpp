@@ -9,6 +9,7 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockfilter.h"
 #include "cache.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -60,6 +61,7 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
@@ -74,9 +76,125 @@ uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 unsigned int nCoinCacheSize = 5000;
 static bool fJustStart = false;
+/** Whether the gcoin caches match the chainstate, i.e. may be snapshotted to disk. */
+static bool fCacheStateReady = false;
+/** The block the cache snapshot loaded at startup was taken at (-1 if none). */
+static int nCacheSnapshotHeight = -1;
+static uint256 hashCacheSnapshotBlock;
+/** Inputs of the block being disconnected, taken from its undo data (NULL if none). */
+static const map<uint256, TxInfo> *pmapUndoInputs = NULL;
+
+/** Make the fUndo lookups of the handlers use the given inputs while in scope. */
+class CUndoInputsScope
+{
+public:
+    CUndoInputsScope(const map<uint256, TxInfo> *pmapInputs)
+    {
+        pmapUndoInputs = pmapInputs;
+    }
+
+    ~CUndoInputsScope()
+    {
+        pmapUndoInputs = NULL;
+    }
+};
+
+/** The output spent by a transaction input, as the handlers look at it. */
+struct CSpentOutput
+{
+    type_Color color;
+    int64_t nValue;
+    tx_type type;
+    CAddressKey address;
+};
+
+/** The outputs spent by the block, or the transaction, being checked, resolved once for all the handlers. */
+struct CSpentOutputs
+{
+    const CBlock *pblock;
+    map<COutPoint, CSpentOutput> mapOutputs;
+
+    CSpentOutputs(const CBlock *pblockIn) : pblock(pblockIn) {}
+};
+
+/**
+ * Outputs spent by the block or transaction being checked or applied (NULL if none).
+ * Only set under cs_main, the type check threads read them while the block is checked.
+ */
+static const CSpentOutputs *pSpentOutputs = NULL;
+
+/** Make the lookups of the handlers use the given spent outputs while in scope. */
+class CSpentOutputsScope
+{
+public:
+    CSpentOutputsScope(const CSpentOutputs *pOutputs) : pPrevious(pSpentOutputs)
+    {
+        pSpentOutputs = pOutputs;
+    }
+
+    ~CSpentOutputsScope()
+    {
+        pSpentOutputs = pPrevious;
+    }
+
+private:
+    const CSpentOutputs *pPrevious;
+};
+
+/** Take the output of the given index, the accessors throw for an index out of range. */
+static void GetSpentOutputOfIndex(const TxInfo &txinfo, unsigned int n, CSpentOutput &output)
+{
+    output.color = txinfo.GetTxOutColorOfIndex(n);
+    output.nValue = txinfo.GetTxOutValueOfIndex(n);
+    output.type = txinfo.GetTxType();
+    output.address = txinfo.GetTxOutAddressKeyOfIndex(n);
+}
+
+/** Get the output spent by the input, from the spent outputs in scope if they have it. */
+static bool GetSpentOutput(const COutPoint &prevout, const CBlock *pblock, bool fUndo, CSpentOutput &output)
+{
+    if (!fUndo && pSpentOutputs && pSpentOutputs->pblock == pblock) {
+        map<COutPoint, CSpentOutput>::const_iterator it = pSpentOutputs->mapOutputs.find(prevout);
+        if (it != pSpentOutputs->mapOutputs.end()) {
+            output = it->second;
+            return true;
+        }
+    }
+    TxInfo txinfo;
+    if (!txinfo.init(prevout, pblock, fUndo))
+        return false;
+    GetSpentOutputOfIndex(txinfo, prevout.n, output);
+    return true;
+}
+
+/**
+ * Resolve the outputs spent by the transaction. The ones which fail are left to the
+ * handlers, which report the failure as they always did.
+ */
+static void ResolveSpentOutputs(const CTransaction &tx, CSpentOutputs &outputs)
+{
+    if (tx.IsCoinBase())
+        return;
+    BOOST_FOREACH(const CTxIn &txin, tx.vin) {
+        if (outputs.mapOutputs.count(txin.prevout))
+            continue;
+        TxInfo txinfo;
+        if (txinfo.init(txin.prevout, outputs.pblock) && txin.prevout.n < txinfo.GetTxOutSize())
+            GetSpentOutputOfIndex(txinfo, txin.prevout.n, outputs.mapOutputs[txin.prevout]);
+    }
+}
+
+/** Resolve the outputs spent by the transactions of the block. */
+static void ResolveSpentOutputs(const CBlock &block, CSpentOutputs &outputs)
+{
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+        ResolveSpentOutputs(tx, outputs);
+}
 
 map<string, vector<map<string, bool> > > VoteList;
 map<string, vector<map<string, bool> > > BanVoteList;
+set<string> VoteListChanged;
+set<string> BanVoteListChanged;
 
 bool (*AlternateFunc_GetTransaction)(const uint256 &transaction_hash,
                                      CTransaction &result,
@@ -554,6 +672,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CCacheDB *pcachedb = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -952,6 +1071,41 @@ string GetDestination(const CScript& tx_scriptPubKey)
     return CBitcoinAddress(addresses[0]).ToString();
 }
 
+/** Return the key id of the address the coinbase of the block pays to */
+static uint160 GetBlockMinerKeyId(const CBlock& block)
+{
+    vector<CTxDestination> addresses;
+    txnouttype type;
+    int nRequired;
+
+    if (block.vtx.empty() || block.vtx[0].vout.empty() ||
+        !ExtractDestinations(block.vtx[0].vout[0].scriptPubKey, type, addresses, nRequired) || addresses.empty())
+        return uint160();
+    if (const CKeyID *keyID = boost::get<CKeyID>(&addresses[0]))
+        return *keyID;
+    if (const CScriptID *scriptID = boost::get<CScriptID>(&addresses[0]))
+        return *scriptID;
+    return uint160();
+}
+
+/**
+ * Return the miner key id of an indexed block. Blocks indexed before it was
+ * recorded are read from disk once, and the result is kept in the index.
+ */
+static bool GetIndexMinerKeyId(CBlockIndex* pindex, uint160& minerKeyId)
+{
+    if (!(pindex->nStatus & BLOCK_HAVE_MINER)) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex))
+            return false;
+        pindex->minerKeyId = GetBlockMinerKeyId(block);
+        pindex->nStatus |= BLOCK_HAVE_MINER;
+        setDirtyBlockIndex.insert(pindex);
+    }
+    minerKeyId = pindex->minerKeyId;
+    return true;
+}
+
 // Handler for different types of transactions.
 namespace type_transaction_handler
 {
@@ -1019,23 +1173,22 @@ public:
             // Collect the colors might appear in the transaction.
             set<type_Color> Activating;
             BOOST_FOREACH(const CTxIn txin, tx.vin) {
-                TxInfo txinfo;
-                if (!txinfo.init(txin.prevout, pblock)) {
+                CSpentOutput output;
+                if (!GetSpentOutput(txin.prevout, pblock, false, output)) {
                     return RejectInvalidTypeTx(
                             "Fetch input fail",
                             state, 10,
                             std::string(BAD_TXNS_TYPE_) + "not-exist");
                 }
-                string senderAddr = txinfo.GetTxOutAddressOfIndex(txin.prevout.n);
-                type_Color color = txinfo.GetTxOutColorOfIndex(txin.prevout.n);
-                if (plicense->IsColorOwner(color, senderAddr)) {
+                CAddressKey sender = output.address;
+                type_Color color = output.color;
+                if (plicense->IsColorOwner(color, sender)) {
                     Activating.insert(color);
                 }
             }
 
             // Check if receiving address is activated if the color is member-only.
-            unsigned int index = 0;
-            BOOST_FOREACH(const CTxOut txout, tx.vout) {
+            BOOST_FOREACH(const CTxOut &txout, tx.vout) {
                 if (!IsValidColor(txout.color)) {
                     return RejectInvalidTypeTx("color invalid", state, 100);
                 }
@@ -1044,18 +1197,17 @@ public:
                             strprintf("no license for color %u", txout.color),
                             state, 100);
                 }
-                string receiverAddr = GetTxOutputAddr(tx, index);
-                index++;
                 // Only process with the member-only colors.
                 if (!plicense->IsMemberOnly(txout.color))
                     continue;
-                if (!plicense->IsColorOwner(txout.color, receiverAddr) && Activating.find(txout.color) == Activating.end()) {
+                CAddressKey receiver(txout.scriptPubKey);
+                if (!plicense->IsColorOwner(txout.color, receiver) && Activating.find(txout.color) == Activating.end()) {
                     if (!pactivate->IsColorExist(txout.color)) {
                         string error_msg = strprintf(
                                 "no activate record for color %u", txout.color);
                         return RejectInvalidTypeTx(error_msg, state, 100);
                     }
-                    if (!pactivate->IsActivated(txout.color, receiverAddr)) {
+                    if (!pactivate->IsActivated(txout.color, receiver)) {
                         return RejectInvalidTypeTx(
                                 "receiver not record in blockchain",
                                 state, 10,
@@ -1118,17 +1270,16 @@ private:
         LOCK(cs_main);
         set<type_Color> ActivateColor;
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            TxInfo txinfo;
-            if (!txinfo.init(txin.prevout, pblock)) {
+            CSpentOutput output;
+            if (!GetSpentOutput(txin.prevout, pblock, false, output)) {
 
                 return error("%s() : Fetch input fail", __func__);
             }
-            string senderAddr = txinfo.GetTxOutAddressOfIndex(txin.prevout.n);
-            type_Color color = txinfo.GetTxOutColorOfIndex(txin.prevout.n);
+            type_Color color = output.color;
 
             if (!plicense->IsMemberOnly(color))
                 continue;
-            if (plicense->IsColorOwner(color, senderAddr)) {
+            if (plicense->IsColorOwner(color, output.address)) {
                 ActivateColor.insert(color);
             }
         }
@@ -1139,8 +1290,7 @@ private:
             if (ActivateColor.find(tx.vout[i].color) == ActivateColor.end())
                 continue;
 
-            string receiverAddr = GetTxOutputAddr(tx, i);
-            pactivate->Activate(tx.vout[i].color, receiverAddr);
+            pactivate->Activate(tx.vout[i].color, CAddressKey(tx.vout[i].scriptPubKey));
         }
         return true;
     }
@@ -1150,17 +1300,16 @@ private:
         LOCK(cs_main);
         set<type_Color> DeactivateColor;
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            TxInfo txinfo;
-            if (!txinfo.init(txin.prevout, pblock, true)) {
+            CSpentOutput output;
+            if (!GetSpentOutput(txin.prevout, pblock, true, output)) {
 
                 return error("%s() : Fetch input fail", __func__);
             }
-            string senderAddr = txinfo.GetTxOutAddressOfIndex(txin.prevout.n);
-            type_Color color = txinfo.GetTxOutColorOfIndex(txin.prevout.n);
+            type_Color color = output.color;
 
             if (!plicense->IsMemberOnly(color))
                 continue;
-            if (plicense->IsColorOwner(color, senderAddr)) {
+            if (plicense->IsColorOwner(color, output.address)) {
                 DeactivateColor.insert(color);
             }
         }
@@ -1171,8 +1320,7 @@ private:
             if (DeactivateColor.find(tx.vout[i].color) == DeactivateColor.end())
                 continue;
 
-            string receiverAddr = GetTxOutputAddr(tx, i);
-            pactivate->Deactivate(tx.vout[i].color, receiverAddr);
+            pactivate->Deactivate(tx.vout[i].color, CAddressKey(tx.vout[i].scriptPubKey));
         }
         return true;
     }
@@ -1445,15 +1593,13 @@ public:
                 return RejectInvalidTypeTx("no sender address", state, 100);
             if (itVLVM->second) {
                 if (itVList->second.back().size() == palliance->NumOfMembers()) {
+                    // Same size, so the billing matches the alliance if all its voters are members.
                     map<string, bool>::const_iterator it_v, it_v_end;
-                    AllianceMember::CIterator it_m, it_m_end;
                     it_v = itVList->second.back().begin();
                     it_v_end = itVList->second.back().end();
-                    it_m = palliance->IteratorBegin();
-                    it_m_end = palliance->IteratorEnd();
                     bool fDiff = false;
-                    for ( ; it_m != it_m_end && it_v != it_v_end; ++it_v, ++it_m) {
-                        if (*it_m != it_v->first) {
+                    for ( ; it_v != it_v_end; ++it_v) {
+                        if (!palliance->IsMember(it_v->first)) {
                             fDiff = true;
                             break;
                         }
@@ -1525,6 +1671,7 @@ public:
         }
 
         itVLVM->second = true;
+        VoteListChanged.insert(candidates);
         // check if vote pass
         size_t agree_cnt = 0;
         for (map<string, bool>::iterator it = itVList->second.back().begin(); it != itVList->second.back().end(); it++) {
@@ -1559,6 +1706,7 @@ public:
 
         // undo the vote in VoteList
         itVLVM->second = false;
+        VoteListChanged.insert(candidate);
 
         // see how many votes the candidate has received now.
         size_t agree_cnt = 0;
@@ -1602,10 +1750,11 @@ private:
         for (AllianceMember::CIterator it = palliance->IteratorBegin();
              it != palliance->IteratorEnd();
              ++it) {
-            List.insert(make_pair(*it, false));
+            List.insert(make_pair(it->ToString(), false));
         }
 
         itRet->second.push_back(List);
+        VoteListChanged.insert(candidates);
         return itRet;
     }
 };
@@ -1631,15 +1780,13 @@ public:
                 return RejectInvalidTypeTx("no sender address", state, 100);
             if (itVLVM->second) {
                 if (itVList->second.back().size() == palliance->NumOfMembers()) {
+                    // Same size, so the billing matches the alliance if all its voters are members.
                     map<string, bool>::const_iterator it_v, it_v_end;
-                    AllianceMember::CIterator it_m, it_m_end;
                     it_v = itVList->second.back().begin();
                     it_v_end = itVList->second.back().end();
-                    it_m = palliance->IteratorBegin();
-                    it_m_end = palliance->IteratorEnd();
                     bool fDiff = false;
-                    for ( ; it_m != it_m_end && it_v != it_v_end; ++it_v, ++it_m) {
-                        if (*it_m != it_v->first) {
+                    for ( ; it_v != it_v_end; ++it_v) {
+                        if (!palliance->IsMember(it_v->first)) {
                             fDiff = true;
                             break;
                         }
@@ -1711,6 +1858,7 @@ public:
         }
 
         itVLVM->second = true;
+        BanVoteListChanged.insert(candidates);
         // check if vote pass
         size_t agree_cnt = 0;
         for (map<string, bool>::iterator it = itVList->second.back().begin(); it != itVList->second.back().end(); it++) {
@@ -1746,6 +1894,7 @@ public:
 
         // undo the ban-vote in BanVoteList
         itVLVM->second = false;
+        BanVoteListChanged.insert(candidate);
 
         // see how many votes the candidate has received now.
         size_t agree_cnt = 0;
@@ -1789,10 +1938,11 @@ private:
         for (AllianceMember::CIterator it = palliance->IteratorBegin();
                 it != palliance->IteratorEnd();
                 ++it) {
-            List.insert(make_pair(*it, false));
+            List.insert(make_pair(it->ToString(), false));
         }
 
         itRet->second.push_back(List);
+        (&VList == &VoteList ? VoteListChanged : BanVoteListChanged).insert(candidates);
         return itRet;
     }
 
@@ -1837,7 +1987,7 @@ public:
     bool CheckValid(const CTransaction &tx, CValidationState &state,
                     const CBlock *pblock)
     {
-        TxInfo txinfo(tx);
+        TxInfo txinfo = TxInfo::View(tx);
         if (txinfo.GetTxOutSize() < 2) {
             return RejectInvalidTypeTx("Vout size of txinfo < 2", state, 80);
         }
@@ -1858,7 +2008,7 @@ public:
 
     bool Apply(const CTransaction &tx, const CBlock *pblock)
     {
-        TxInfo txinfo(tx);
+        TxInfo txinfo = TxInfo::View(tx);
         if (txinfo.GetTxOutSize() < 2) {
             LogPrintf("Handler_Order_::%s : %s Vout size of txinfo < 2\n", __func__, tx.GetHash().ToString());
             return false;
@@ -1869,7 +2019,7 @@ public:
 
     bool Undo(const CTransaction &tx, const CBlock *pblock)
     {
-        TxInfo txinfo(tx);
+        TxInfo txinfo = TxInfo::View(tx);
         if (txinfo.GetTxOutSize() < 2) {
             LogPrintf("Handler_Order_::%s : %s Vout size of txinfo < 2\n", __func__, tx.GetHash().ToString());
             return false;
@@ -1878,7 +2028,8 @@ public:
             LogPrintf("%s () fail : %s order tx not exist\n", __func__, tx.GetHash().ToString());
             return false;
         }
-            return true;
+        porder->Remove(txinfo);
+        return true;
     }
 };
 
@@ -2202,23 +2353,11 @@ string GetTxInputAddr(const CTransaction& tx, const CBlock *pblock, bool fUndo)
     if (cache.get()->tx_hash != tx.GetHash()) {
         cache.get()->tx_hash = tx.GetHash();
 
-        if (fJustStart || fUndo) {
-            CTransaction preTx;
-            uint256 hashBlock;
-            hashBlock.SetNull();
-            if (!GetTransaction(tx.vin[0].prevout.hash, preTx, hashBlock, pblock)) {
-                cache.get()->address = "";
-            } else {
-                cache.get()->address = GetDestination(
-                        preTx.vout[tx.vin[0].prevout.n].scriptPubKey);
-            }
+        CSpentOutput output;
+        if (!GetSpentOutput(tx.vin[0].prevout, pblock, fUndo, output)) {
+            cache.get()->address = "";
         } else {
-            TxInfo txinfo;
-            if (!txinfo.init(tx.vin[0].prevout, pblock)) {
-                cache.get()->address = "";
-            } else {
-                cache.get()->address = txinfo.GetTxOutAddressOfIndex(tx.vin[0].prevout.n);
-            }
+            cache.get()->address = output.address.ToString();
         }
     }
 
@@ -2253,16 +2392,96 @@ bool CheckTransactionType(const CTransaction& tx, CValidationState &state,
     return true;
 }
 
+CTypeCheckCache typecheckcache(MAX_TYPECHECK_CACHE_ENTRIES);
+
+uint64_t CTypeCheckCache::GetEpoch(const type_Color &color) const
+{
+    map<type_Color, uint64_t>::const_iterator it = mapColorEpochs.find(color);
+    return (it == mapColorEpochs.end() ? 0 : it->second);
+}
+
+void CTypeCheckCache::Add(const uint256 &hash, const set<type_Color> &colors)
+{
+    if (mapEntries.size() >= nMaxEntries && !mapEntries.empty() && !mapEntries.count(hash)) {
+        // Evict a random entry, like the signature cache does
+        map<uint256, CEntry>::iterator it = mapEntries.lower_bound(GetRandHash());
+        if (it == mapEntries.end())
+            it = mapEntries.begin();
+        mapEntries.erase(it);
+    }
+    CEntry &entry = mapEntries[hash];
+    entry.vColorEpochs.clear();
+    BOOST_FOREACH(const type_Color &color, colors)
+        entry.vColorEpochs.push_back(make_pair(color, GetEpoch(color)));
+}
+
+bool CTypeCheckCache::Contains(const uint256 &hash) const
+{
+    map<uint256, CEntry>::const_iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return false;
+    for (unsigned int i = 0; i < it->second.vColorEpochs.size(); i++) {
+        if (GetEpoch(it->second.vColorEpochs[i].first) != it->second.vColorEpochs[i].second)
+            return false;
+    }
+    return true;
+}
+
+void CTypeCheckCache::Erase(const uint256 &hash)
+{
+    mapEntries.erase(hash);
+}
+
+void CTypeCheckCache::Touch(const CTransaction &tx)
+{
+    // The handlers only change the caches for the colors of the outputs
+    nLastEpoch++;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout)
+        mapColorEpochs[txout.color] = nLastEpoch;
+}
+
+void CTypeCheckCache::Clear()
+{
+    mapEntries.clear();
+}
+
+bool CTypeCheck::operator()() {
+    try {
+        return CheckTransactionType(*ptx, *pstate, pblock, false);
+    } catch (const std::exception& e) {
+        // Not a verdict on the transaction, the block is not marked invalid for it
+        return pstate->Error(strprintf("type check of %s: %s", ptx->GetHash().ToString(), e.what()));
+    }
+}
+
+bool CBlockSignatureCheck::operator()() {
+    try {
+        CDataStream vRecv(pvRecv->begin(), pvRecv->end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        vRecv >> block;
+        // The least work a block of any miner needs, so that a peer cannot have
+        // the threads check headers for nothing
+        if (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus(), 0))
+            return true;
+        if (!block.vtx.empty() && !block.vtx[0].vout.empty())
+            VerifyScript(block.scriptSig, block.vtx[0].vout[0].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingBlockHeaderSignatureChecker(&block, true, true));
+    } catch (const std::exception&) {
+        // A malformed message is rejected when it is processed
+    }
+    // The other checks of the batch go on whatever the result
+    return true;
+}
+
 bool CheckRepeatedTypeTransactionInPool(
         CTxMemPool& pool, CValidationState &state, const CTransaction &tx)
 {
-    typedef map<uint256, CTxMemPoolEntry>::value_type CMapTxIter;
-    BOOST_FOREACH(CMapTxIter it, pool.mapTx) {
-        if (tx.type != it.second.GetTx().type) {
-            continue;
-        }
+    // Only licenses of the same color and votes for the same candidate can
+    // repeat each other, the pool indexes them so that the rest is skipped.
+    vector<CTransaction> vPoolTx;
+    pool.queryRepeatedTypeTx(tx, vPoolTx);
+    BOOST_FOREACH(const CTransaction &pool_tx, vPoolTx) {
         if (!type_transaction_handler::GetHandler(tx.type)->CheckNotRepeated(
-                tx, it.second.GetTx(), state)) {
+                tx, pool_tx, state)) {
             return false;
         }
     }
@@ -2280,13 +2499,13 @@ bool CheckTxFeeAndColor(const CTransaction tx, const CBlock *pblock, bool fCheck
     // fee = vin - vout
     map<type_Color, int64_t> Input;
     BOOST_FOREACH(const CTxIn txin, tx.vin) {
-        TxInfo txinfo;
-        if (!txinfo.init(txin.prevout, pblock)) {
+        CSpentOutput output;
+        if (!GetSpentOutput(txin.prevout, pblock, false, output)) {
             LogPrintf("%s : Fetch inputs fail\n", __func__);
             return false;
         }
-        type_Color color = txinfo.GetTxOutColorOfIndex(txin.prevout.n);
-        int64_t value = txinfo.GetTxOutValueOfIndex(txin.prevout.n);
+        type_Color color = output.color;
+        int64_t value = output.nValue;
         map<type_Color, int64_t>::iterator it = Input.find(color);
         if (it == Input.end()) {
             Input.insert(make_pair(color, value));
@@ -2346,32 +2565,47 @@ bool IsValidColor(const type_Color &color) {
 
 // Use to initial Tx via COutPoint
 bool TxInfo::init(const COutPoint &outpoint, const CBlock *pblock, bool fUndo) {
+    SetNull();
     hash = outpoint.hash;
-    if (fJustStart || fUndo) {
+    map<uint256, TxInfo>::const_iterator itUndo;
+    if (fUndo && pmapUndoInputs && (itUndo = pmapUndoInputs->find(hash)) != pmapUndoInputs->end()) {
+        if (itUndo->second.GetTxOutSize() <= outpoint.n) {
+            LogPrintf("TxInfo::%s() : initial fail(undo)\n", __func__);
+            return false;
+        }
+        pvout = &itUndo->second.GetTxOuts();
+        type = itUndo->second.GetTxType();
+    } else if (fJustStart || fUndo) {
+        // Inputs missing from the undo data are read back from disk
+        CDiskTxOutputs outputs;
         CTransaction preTx;
         uint256 hashBlock;
         hashBlock.SetNull();
-        if (!GetTransaction(hash, preTx, hashBlock, pblock)) {
+        if (pblocktree->ReadTxOutputs(hash, outputs)) {
+            outputs.GetTxOuts(vout);
+            type = outputs.type;
+        } else if (GetTransaction(hash, preTx, hashBlock, pblock)) {
+            vout = preTx.vout;
+            type = preTx.type;
+        } else {
             LogPrintf("TxInfo::%s() : initial fail(fJustStart)\n", __func__);
             return false;
         }
-        vout = preTx.vout;
-        type = preTx.type;
     } else {
         CCoins coins;
         if (GetCoinsFromCache(outpoint, coins, pblock == NULL)) {
-            vout = coins.vout;
+            vout.swap(coins.vout);
             type = coins.type;
         } else if (pblock) {
-            bool fFind = false;
+            // The outputs stay in the block, which outlives the handlers looking at them
             BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
                 if (tx.GetHash() == hash) {
-                    vout = tx.vout;
+                    pvout = &tx.vout;
                     type = tx.type;
-                    fFind = true;
+                    break;
                 }
             }
-            if (!fFind) {
+            if (pvout == &vout) {
                 LogPrintf("TxInfo::%s() : initial fail(block)\n", __func__);
                 return false;
             }
@@ -2384,21 +2618,27 @@ bool TxInfo::init(const COutPoint &outpoint, const CBlock *pblock, bool fUndo) {
 }
 
 string TxInfo::GetTxOutAddressOfIndex(unsigned int index) const {
-    if (index >= vout.size())
+    if (index >= pvout->size())
         throw runtime_error("GetTxOutAddressOfIndex : invalid index.");
-    return GetDestination(vout[index].scriptPubKey);
+    return GetDestination((*pvout)[index].scriptPubKey);
+}
+
+CAddressKey TxInfo::GetTxOutAddressKeyOfIndex(unsigned int index) const {
+    if (index >= pvout->size())
+        throw runtime_error("GetTxOutAddressKeyOfIndex : invalid index.");
+    return CAddressKey((*pvout)[index].scriptPubKey);
 }
 
 type_Color TxInfo::GetTxOutColorOfIndex(unsigned int index) const {
-    if (index >= vout.size())
+    if (index >= pvout->size())
         throw runtime_error("GetTxOutColorOfIndex : invalid index.");
-    return vout[index].color;
+    return (*pvout)[index].color;
 }
 
 int64_t TxInfo::GetTxOutValueOfIndex(unsigned int index) const {
-    if (index >= vout.size())
+    if (index >= pvout->size())
         throw runtime_error("GetTxOutValueOfIndex : invalid index.");
-    return vout[index].nValue;
+    return (*pvout)[index].nValue;
 }
 
 tx_type TxInfo::GetTxType() const {
@@ -2409,8 +2649,12 @@ uint256 TxInfo::GetTxHash() const {
     return hash;
 }
 
+const std::vector<CTxOut> &TxInfo::GetTxOuts() const {
+    return *pvout;
+}
+
 size_t TxInfo::GetTxOutSize() const {
-    return vout.size();
+    return pvout->size();
 }
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
@@ -2479,6 +2723,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         CCoinsViewCache view(&dummy);
 
         CAmount nValueIn = 0;
+        set<type_Color> setCheckedColors;
         {
         LOCK(pool.cs);
         CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
@@ -2521,8 +2766,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
             return state.Invalid(error("AcceptToMemoryPool: inputs already spent"),
                                  REJECT_DUPLICATE, "bad-txns-inputs-spent");
 
-        if (!CheckTransactionType(tx, state))
-            return error("%s: CheckTransactionType failed, txid : %s", __func__, tx.GetHash().ToString());
+        {
+            // The handlers look at the spent outputs a few times each
+            CSpentOutputs spentOutputs(NULL);
+            ResolveSpentOutputs(tx, spentOutputs);
+            CSpentOutputsScope spentOutputsScope(&spentOutputs);
+            if (!CheckTransactionType(tx, state))
+                return error("%s: CheckTransactionType failed, txid : %s", __func__, tx.GetHash().ToString());
+
+            // The colors the checks of a NORMAL transaction looked at, of its outputs and inputs
+            BOOST_FOREACH(const CTxOut &txout, tx.vout)
+                setCheckedColors.insert(txout.color);
+            for (map<COutPoint, CSpentOutput>::const_iterator it = spentOutputs.mapOutputs.begin(); it != spentOutputs.mapOutputs.end(); ++it)
+                setCheckedColors.insert(it->second.color);
+        }
 
 
         // Bring the best block into scope
@@ -2589,7 +2846,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
 
         // Store transaction in memory
-        pool.addUnchecked(hash, entry);
+        pool.addUnchecked(hash, entry, true, &view);
+
+        // Connecting it in a block does not check its type again, unless its colors change before
+        if (tx.type == NORMAL)
+            typecheckcache.Add(hash, setCheckedColors);
     }
 
     SyncWithWallets(tx, NULL);
@@ -2612,16 +2873,22 @@ bool GetCoinsFromCache(const COutPoint &outpoint, CCoins &coins, bool fUseMempoo
 
     CCoinsView dummy;
     CCoinsViewCache view(&dummy);
-    {
+    if (fUseMempool) {
         LOCK(mempool.cs);
 
         // setup uxto database and mempool for view and switch view's backend.
         CCoinsViewMemPool viewMempoolAndDatabase(pcoinsTip, mempool);
+        view.SetBackend(viewMempoolAndDatabase);
+
+        if (!view.GetCoins(outpoint.hash, coins) || !coins.IsAvailable(outpoint.n))
+            return false;
+
+        view.SetBackend(dummy); // switch back.
+    } else {
+        // The database only lookups of the block checks do not need the mempool lock,
+        // they may run on the type checking threads.
         CCoinsViewCache viewDatabaseOnly(pcoinsTip);
-        if (fUseMempool)
-            view.SetBackend(viewMempoolAndDatabase);
-        else
-            view.SetBackend(viewDatabaseOnly);
+        view.SetBackend(viewDatabaseOnly);
 
         if (!view.GetCoins(outpoint.hash, coins) || !coins.IsAvailable(outpoint.n))
             return false;
@@ -2632,7 +2899,26 @@ bool GetCoinsFromCache(const COutPoint &outpoint, CCoins &coins, bool fUseMempoo
     return true;
 }
 
-/** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
+/** Read the transaction at the given position of a block file */
+static bool ReadTransactionFromDisk(const CDiskTxPos &postx, const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
+{
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> txOut;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    if (txOut.GetHash() != hash)
+        return error("%s: txid mismatch", __func__);
+    return true;
+}
+
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock, const CBlock *pblock, bool fAllowSlow)
 {
     if (AlternateFunc_GetTransaction != NULL) {
@@ -2661,23 +2947,17 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         }
         if (fTxIndex) {
             CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s: txid mismatch", __func__);
-                return true;
-            }
+            if (pblocktree->ReadTxIndex(hash, postx))
+                return ReadTransactionFromDisk(postx, hash, txOut, hashBlock);
+        }
+
+        // the colored output index also knows where the transaction is
+        int64_t nTimeStart = GetTimeMicros();
+        CDiskTxOutputs outputs;
+        if (pblocktree->ReadTxOutputs(hash, outputs)) {
+            bool fRead = ReadTransactionFromDisk(outputs.pos, hash, txOut, hashBlock);
+            LogPrint("bench", "%s: %s read through the output index in %.2fms\n", __func__, hash.ToString(), 0.001 * (GetTimeMicros() - nTimeStart));
+            return fRead;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -2705,7 +2985,8 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
             }
         }
     } else {
-        // search from whole chain
+        // search from whole chain, for transactions connected before the output index was kept
+        int64_t nTimeStart = GetTimeMicros();
         for (CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
             CBlock block;
             if (ReadBlockFromDisk(block, pindex)) {
@@ -2713,6 +2994,7 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
                     if (tx.GetHash() == hash) {
                         txOut = tx;
                         hashBlock = pindex->GetBlockHash();
+                        LogPrint("bench", "%s: %s found by scanning %d blocks in %.2fms\n", __func__, hash.ToString(), pindex->nHeight + 1, 0.001 * (GetTimeMicros() - nTimeStart));
                         return true;
                     }
                 }
@@ -2729,21 +3011,45 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
 // Cache
 //
 
-bool WriteCacheToDisk(const int nHeight)
-{
-    if(!palliance->WriteDisk(nHeight))
-        return error("%s() : alliance_member cache writing fail", __func__);
-    if(!plicense->WriteDisk(nHeight))
-        return error("%s() : color_license cache writing fail", __func__);
-    if(!pminer->WriteDisk(nHeight))
-        return error("%s() : block_miner cache writing fail", __func__);
-    if(!pactivate->WriteDisk(nHeight))
-        return error("%s() : activate_address_with_color cache writing fail", __func__);
-    if(!porder->WriteDisk(nHeight))
-        return error("%s() : order_list cache writing fail", __func__);
+bool LoadCacheSnapshot()
+{
+    int nHeight;
+    uint256 hashBlock;
+    typecheckcache.Clear();
+    if (!pcachedb || !ReadCacheState(*pcachedb, nHeight, hashBlock))
+        return false;
+    LogPrintf("%s: loaded cache database at height %d (%s)\n", __func__, nHeight, hashBlock.ToString());
+    nCacheSnapshotHeight = nHeight;
+    hashCacheSnapshotBlock = hashBlock;
     return true;
 }
 
+/**
+ * Return the height up to which the caches loaded at startup are valid for
+ * chainActive. A snapshot taken at a block that is no longer in the active
+ * chain is dropped, so that the caches get rebuilt from the genesis block.
+ */
+static int GetCacheReplayHeight()
+{
+    if (nCacheSnapshotHeight >= 0) {
+        if (nCacheSnapshotHeight <= chainActive.Height() &&
+            chainActive[nCacheSnapshotHeight]->GetBlockHash() == hashCacheSnapshotBlock)
+            return nCacheSnapshotHeight;
+        LogPrintf("%s: cache snapshot at height %d is not in the active chain, rebuilding caches\n", __func__, nCacheSnapshotHeight);
+        ClearAllCaches();
+        nCacheSnapshotHeight = -1;
+        return 0;
+    }
+
+    set<int> lheight;
+    lheight.insert(palliance->BackupHeight());
+    lheight.insert(plicense->BackupHeight());
+    lheight.insert(pminer->BackupHeight());
+    lheight.insert(pactivate->BackupHeight());
+    lheight.insert(porder->BackupHeight());
+    return std::min(*lheight.begin(), chainActive.Height());
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
@@ -3004,6 +3310,20 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
     UpdateCoins(tx, state, inputs, txundo, nHeight);
 }
 
+void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, CGcoinBlockUndo &gcoinundo, int nHeight)
+{
+    // keep the whole order a MATCH or CANCEL removes from the order list
+    if (tx.type == MATCH || tx.type == CANCEL) {
+        unsigned int nOrders = std::min(tx.vin.size(), (size_t)(tx.type == MATCH ? 2 : 1));
+        for (unsigned int j = 0; j < nOrders; j++) {
+            const CCoins *coins = inputs.AccessCoins(tx.vin[j].prevout.hash);
+            if (coins)
+                gcoinundo.mapOrders[tx.vin[j].prevout.hash] = coins->vout;
+        }
+    }
+    UpdateCoins(tx, state, inputs, txundo, nHeight);
+}
+
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
@@ -3161,7 +3481,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+bool UndoWriteToDisk(const CBlockUndo& blockundo, const CGcoinBlockUndo& gcoinundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
@@ -3185,10 +3505,17 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     hasher << blockundo;
     fileout << hasher.GetHash();
 
+    // write the undo data of the gcoin caches right after it, with its own checksum
+    fileout << gcoinundo;
+    CHashWriter hasherGcoin(SER_GETHASH, PROTOCOL_VERSION);
+    hasherGcoin << hashBlock;
+    hasherGcoin << gcoinundo;
+    fileout << hasherGcoin.GetHash();
+
     return true;
 }
 
-bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock, CGcoinBlockUndo* pgcoinundo = NULL)
 {
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
@@ -3197,9 +3524,14 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
 
     // Read block
     uint256 hashChecksum;
+    uint256 hashGcoinChecksum;
     try {
         filein >> blockundo;
         filein >> hashChecksum;
+        if (pgcoinundo) {
+            filein >> *pgcoinundo;
+            filein >> hashGcoinChecksum;
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
@@ -3211,6 +3543,13 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     hasher << blockundo;
     if (hashChecksum != hasher.GetHash())
         return error("%s: Checksum mismatch", __func__);
+    if (pgcoinundo) {
+        CHashWriter hasherGcoin(SER_GETHASH, PROTOCOL_VERSION);
+        hasherGcoin << hashBlock;
+        hasherGcoin << *pgcoinundo;
+        if (hashGcoinChecksum != hasherGcoin.GetHash())
+            return error("%s: Gcoin undo checksum mismatch", __func__);
+    }
 
     return true;
 }
@@ -3269,6 +3608,55 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const CO
     return fClean;
 }
 
+/**
+ * Rebuild the inputs of a block from its undo data: the spent outputs from
+ * the CTxUndo entries and the complete orders from the gcoin undo data.
+ * The undo data only keeps the type of a transaction along with its last
+ * output, the type of the others is taken from their coins in view, which
+ * must not have been disconnected yet. Inputs whose type is not found are
+ * left out, so the handlers read them back from disk.
+ */
+static void GetUndoInputs(const CBlock& block, const CBlockUndo& blockUndo, const CGcoinBlockUndo& gcoinUndo, const CCoinsViewCache& view, map<uint256, TxInfo>& mapInputs)
+{
+    map<uint256, pair<vector<CTxOut>, tx_type> > mapOutputs;
+    set<uint256> setTyped;
+    for (map<uint256, vector<CTxOut> >::const_iterator it = gcoinUndo.mapOrders.begin(); it != gcoinUndo.mapOrders.end(); it++) {
+        mapOutputs[it->first] = make_pair(it->second, (tx_type)ORDER);
+        setTyped.insert(it->first);
+    }
+
+    unsigned int nTxUndo = 0;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        if (nTxUndo >= blockUndo.vtxundo.size())
+            break;
+        const CTxUndo &txundo = blockUndo.vtxundo[nTxUndo++];
+        for (unsigned int j = 0; j < tx.vin.size() && j < txundo.vprevout.size(); j++) {
+            const COutPoint &out = tx.vin[j].prevout;
+            const CTxInUndo &undo = txundo.vprevout[j];
+            pair<vector<CTxOut>, tx_type> &outputs = mapOutputs[out.hash];
+            if (outputs.first.size() < out.n + 1)
+                outputs.first.resize(out.n + 1);
+            outputs.first[out.n] = undo.txout;
+            if (undo.nHeight != 0) {
+                outputs.second = undo.type;
+                setTyped.insert(out.hash);
+            }
+        }
+    }
+
+    for (map<uint256, pair<vector<CTxOut>, tx_type> >::iterator it = mapOutputs.begin(); it != mapOutputs.end(); it++) {
+        if (!setTyped.count(it->first)) {
+            const CCoins *coins = view.AccessCoins(it->first);
+            if (!coins)
+                continue;
+            it->second.second = coins->type;
+        }
+        mapInputs.insert(make_pair(it->first, TxInfo(it->first, it->second.first, it->second.second)));
+    }
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -3279,12 +3667,21 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     bool fClean = true;
 
     CBlockUndo blockUndo;
+    CGcoinBlockUndo gcoinUndo;
+    bool fGcoinUndo = pindex->nStatus & BLOCK_HAVE_GCOIN_UNDO;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull())
         return error("DisconnectBlock(): no undo data available");
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash()))
+    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash(), fGcoinUndo ? &gcoinUndo : NULL))
         return error("DisconnectBlock(): failure reading undo data");
 
+    // Serve the inputs the handlers look up to undo the transactions from the
+    // undo data. Blocks connected before it was recorded fall back to disk.
+    map<uint256, TxInfo> mapInputs;
+    if (fGcoinUndo)
+        GetUndoInputs(block, blockUndo, gcoinUndo, view, mapInputs);
+    CUndoInputsScope undoInputs(fGcoinUndo ? &mapInputs : NULL);
+
     int CoinBaseCount = 0;
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         if (block.vtx[i].IsCoinBase())
@@ -3311,6 +3708,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (!type_transaction_handler::GetHandler(tx.type)->Undo(tx, &block)) {
             return false;
         }
+        typecheckcache.Touch(tx);
 
         CCoins outsBlock(tx, pindex->nHeight);
         // The CCoins serialization does not serialize negative numbers.
@@ -3385,6 +3783,96 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CTypeCheck> typecheckqueue(128);
+
+void ThreadTypeCheck()
+{
+    RenameThread("gcoin-typech");
+    typecheckqueue.Thread();
+}
+
+static CCheckQueue<CBlockSignatureCheck> blocksigcheckqueue(128);
+
+void ThreadBlockSignatureCheck()
+{
+    RenameThread("gcoin-blocksig");
+    blocksigcheckqueue.Thread();
+}
+
+void StartCheckThreads(boost::thread_group& threadGroup)
+{
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadScriptCheck);
+    // The type and block signature checks are set by -parchecks, so -par still
+    // starts only the script check threads it asks for
+    for (int i = 0; i < nCheckThreads; i++) {
+        threadGroup.create_thread(&ThreadTypeCheck);
+        threadGroup.create_thread(&ThreadBlockSignatureCheck);
+    }
+}
+
+void PreverifyBlockHeaderSignatures(const std::vector<const CDataStream*>& vpvRecv)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    CCheckQueueControl<CBlockSignatureCheck> control(&blocksigcheckqueue);
+    std::vector<CBlockSignatureCheck> vChecks;
+    vChecks.reserve(vpvRecv.size());
+    BOOST_FOREACH(const CDataStream *pvRecv, vpvRecv)
+        vChecks.push_back(CBlockSignatureCheck(*pvRecv));
+    control.Add(vChecks);
+    control.Wait();
+    LogPrint("bench", "    - Preverify %u block header signatures: %.2fms\n", (unsigned int)vpvRecv.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+}
+
+bool CheckBlockTransactionTypes(const CBlock& block, CValidationState &state, bool fParallel)
+{
+    // The checks of the other types may change the caches, so they still run in order,
+    // each one after the NORMAL transactions before it are checked.
+    // Resolving the spent outputs fetches the inputs into the tip as well, so the threads only read it
+    CSpentOutputs spentOutputs(&block);
+    const CSpentOutputs *pOutputs = pSpentOutputs;
+    if (!pOutputs || pOutputs->pblock != &block) {
+        ResolveSpentOutputs(block, spentOutputs);
+        pOutputs = &spentOutputs;
+    }
+    CSpentOutputsScope spentOutputsScope(pOutputs);
+
+    CCheckQueueControl<CTypeCheck> control(fParallel ? &typecheckqueue : NULL);
+    vector<CTypeCheck> vChecks;
+    vector<CValidationState> vStates(fParallel ? block.vtx.size() : 0);
+    unsigned int nQueued = 1;
+    for (unsigned int i = 1; i <= block.vtx.size(); i++) {
+        if (i < block.vtx.size() && block.vtx[i].type == NORMAL) {
+            // Checked when it was accepted to the mempool, against the same state of its colors
+            if (typecheckcache.Contains(block.vtx[i].GetHash()))
+                continue;
+            if (fParallel) {
+                vChecks.push_back(CTypeCheck(block.vtx[i], block, vStates[i]));
+                continue;
+            }
+        }
+        if (!vChecks.empty()) {
+            control.Add(vChecks);
+            vChecks.clear();
+            if (!control.Wait()) {
+                // The threads stop at the first failure they see, report the first queued
+                // transaction whose check set its state
+                for (; nQueued < i; nQueued++) {
+                    if (!vStates[nQueued].IsValid()) {
+                        state = vStates[nQueued];
+                        return error("%s() : CheckTransactionType failed, txid : %s", __func__, block.vtx[nQueued].GetHash().ToString());
+                    }
+                }
+                return error("%s() : CheckTransactionType failed on a check thread, block %s", __func__, block.GetHash().ToString());
+            }
+        }
+        nQueued = i + 1;
+        if (i < block.vtx.size() && !CheckTransactionType(block.vtx[i], state, &block, false))
+            return error("%s() : CheckTransactionType failed, txid : %s", __func__, block.vtx[i].GetHash().ToString());
+    }
+    return true;
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -3446,6 +3934,7 @@ void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const
 
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
+static int64_t nTimeCheckTypes = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
@@ -3535,6 +4024,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     CBlockUndo blockundo;
+    CGcoinBlockUndo gcoinundo;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
@@ -3544,6 +4034,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     vector<pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    vector<pair<uint256, CDiskTxOutputs> > vOutputs;
+    vOutputs.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -3579,21 +4071,26 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         } else if (!ExistInPool(tx) && !CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
             return false;
 
-        if (i != 0 && !CheckTransactionType(tx, state, &block, false))
-            return error("%s() : CheckTransactionType failed", __func__, tx.GetHash().ToString());
-
-        CTxUndo undoDummy;
-        if (!tx.IsCoinBase()) {
+        if (tx.IsCoinBase()) {
+            UpdateCoins(tx, state, view, pindex->nHeight);
+        } else {
             blockundo.vtxundo.push_back(CTxUndo());
+            UpdateCoins(tx, state, view, blockundo.vtxundo.back(), gcoinundo, pindex->nHeight);
         }
-        UpdateCoins(tx, state, view, tx.IsCoinBase() ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
+        vOutputs.push_back(std::make_pair(tx.GetHash(), CDiskTxOutputs(pos, tx)));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
 
+    // The type checks see the caches as of before the block, as Apply only runs once it is connected
+    if (!CheckBlockTransactionTypes(block, state, nCheckThreads && !fJustStart))
+        return false;
+    int64_t nTimeTypes1 = GetTimeMicros(); nTimeCheckTypes += nTimeTypes1 - nTime1;
+    LogPrint("bench", "      - Check %u transaction types: %.2fms (%.3fms/tx) [%.2fs]\n", (unsigned)block.vtx.size() - 1, 0.001 * (nTimeTypes1 - nTime1), block.vtx.size() <= 1 ? 0 : 0.001 * (nTimeTypes1 - nTime1) / (block.vtx.size() - 1), nTimeCheckTypes * 0.000001);
+
     // Check if coin base transaction meet the transaction fees of each color
     if (!CheckCoinBaseTransactions(block))
         return state.DoS(100, error("%s() : CheckCoinBaseTransactions", __func__));
@@ -3606,19 +4103,27 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    // Blocks indexed before the miner was recorded get it here, rather than read again later
+    if (!(pindex->nStatus & BLOCK_HAVE_MINER)) {
+        pindex->minerKeyId = GetBlockMinerKeyId(block);
+        pindex->nStatus |= BLOCK_HAVE_MINER;
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
         if (pindex->GetUndoPos().IsNull()) {
             CDiskBlockPos pos;
-            if (!FindUndoPos(state, pindex->nFile, pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            if (!FindUndoPos(state, pindex->nFile, pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40 +
+                                                        ::GetSerializeSize(gcoinundo, SER_DISK, CLIENT_VERSION) + 32))
                 return error("ConnectBlock(): FindUndoPos failed");
-            if (!UndoWriteToDisk(blockundo, pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+            if (!UndoWriteToDisk(blockundo, gcoinundo, pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
                 return AbortNode(state, "Failed to write undo data");
 
             // update nUndoPos in block index
             pindex->nUndoPos = pos.nPos;
-            pindex->nStatus |= BLOCK_HAVE_UNDO;
+            pindex->nStatus |= BLOCK_HAVE_UNDO | BLOCK_HAVE_GCOIN_UNDO;
         }
 
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
@@ -3628,6 +4133,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
+    if (!pblocktree->WriteBlockOutputs(vOutputs, pindex->GetBlockHash(), BuildBlockFilter(block, blockundo)))
+        return AbortNode(state, "Failed to write transaction output index and block filter");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -3742,6 +4249,24 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        // Write the cache changes at the block of the flushed chainstate, so
+        // that startup only needs to replay the blocks above it. A failure here
+        // is not fatal: the previous state stays in place and is replayed from,
+        // and the changes are kept to be written with the next flush.
+        if (fCacheStateReady && pcachedb) {
+            BlockMap::iterator mi = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+            if (mi != mapBlockIndex.end()) {
+                static int nLastCacheHeight = -1;
+                size_t nBytes = 0;
+                int64_t nTimeStart = GetTimeMicros();
+                if (WriteCacheState(*pcachedb, mi->second->nHeight, mi->first, nBytes)) {
+                    int nBlocks = std::max(1, mi->second->nHeight - nLastCacheHeight);
+                    LogPrint("bench", "  - Cache state: %u bytes for %d blocks (%u bytes/block) in %.2fms\n",
+                        nBytes, nBlocks, nBytes / nBlocks, (GetTimeMicros() - nTimeStart) * 0.001);
+                    nLastCacheHeight = mi->second->nHeight;
+                }
+            }
+        }
         nLastFlush = nNow;
     }
     if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
@@ -3824,6 +4349,12 @@ bool static DisconnectTip(CValidationState &state) {
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    // The output index only points into the active chain
+    vector<uint256> vTxid;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+        vTxid.push_back(tx.GetHash());
+    if (!pblocktree->EraseTxOutputs(vTxid))
+        return AbortNode(state, "Failed to erase transaction output index");
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -3852,6 +4383,7 @@ bool static DisconnectTip(CValidationState &state) {
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimeResolve = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -3879,6 +4411,12 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     {
         CCoinsViewCache view(pcoinsTip);
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
+        // Resolve the spent outputs once, for both the checks and the Apply of the handlers
+        CSpentOutputs spentOutputs(pblock);
+        ResolveSpentOutputs(*pblock, spentOutputs);
+        CSpentOutputsScope spentOutputsScope(&spentOutputs);
+        int64_t nTimeResolved = GetTimeMicros(); nTimeResolve += nTimeResolved - nTime2;
+        LogPrint("bench", "  - Resolve %u spent outputs: %.2fms [%.2fs]\n", (unsigned)spentOutputs.mapOutputs.size(), (nTimeResolved - nTime2) * 0.001, nTimeResolve * 0.000001);
         bool rv = ConnectBlock(*pblock, state, pindexNew, view);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
@@ -3893,6 +4431,10 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
                         tx, pblock))  {
                     return false;
                 }
+                // Applying a NORMAL transaction only activates addresses, which fails no passed check
+                typecheckcache.Erase(tx.GetHash());
+                if (tx.type != NORMAL)
+                    typecheckcache.Touch(tx);
             }
         }
         mapBlockSource.erase(inv.hash);
@@ -3926,11 +4468,6 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, CBlock *
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
-    // Update the cache disk backup
-    int nBackup = GetArg("-cachebackupfreq", 200);
-    if (nBackup != 0 && pindexNew->nHeight % nBackup == 0)
-        if (!WriteCacheToDisk(pindexNew->nHeight))
-            return error("%s(): Write cache failed at height %d", __func__, pindexNew->nHeight);
     return true;
 }
 
@@ -4234,6 +4771,8 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos)
 {
     pindexNew->nTx = block.vtx.size();
+    pindexNew->minerKeyId = GetBlockMinerKeyId(block);
+    pindexNew->nStatus |= BLOCK_HAVE_MINER;
     pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
@@ -4365,7 +4904,7 @@ bool CheckBlockHeaderSignature(const CBlock& block, CValidationState& state)
             return state.DoS(50, error("%s() : no block vtx[0] or no block vtx[0] vout[0]", __func__),
                              REJECT_INVALID, "high-hash");
 
-        if (!VerifyScript(block.scriptSig, block.vtx[0].vout[0].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, BlockHeaderSignatureChecker(&block))) {
+        if (!VerifyScript(block.scriptSig, block.vtx[0].vout[0].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingBlockHeaderSignatureChecker(&block, true))) {
             return state.DoS(50, error("%s() : verify blockheader signature error", __func__),
                              REJECT_INVALID, "high-hash");
         }
@@ -4392,9 +4931,8 @@ bool EnableMining(const CBlock& block, bool& fMissPreBlock) {
     LogPrintf("%s\n",block.GetHash().ToString());
     LOCK(cs_main);
 
-    CBlock Block;
     BlockMap::const_iterator it = mapBlockIndex.find(block.hashPrevBlock);
-    if (it == mapBlockIndex.end() || !ReadBlockFromDisk(Block, it->second)) {
+    if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
         fMissPreBlock = true;
         LogPrintf("ERROR : %s() can't fetch preindex of block hash %s\n", __func__, block.GetHash().ToString());
         return false;
@@ -4407,13 +4945,12 @@ bool EnableMining(const CBlock& block, bool& fMissPreBlock) {
     if (pindex->nHeight == 0)
         return true;
     for (int i = 0; i < COINBASE_MATURITY && pindex; i++) {
-        CBlock BLOCK;
-        if (!ReadBlockFromDisk(BLOCK, pindex)) {
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
             fMissPreBlock = true;
-            LogPrintf("WARNING : %s() Read block fail at block hash %s\n", __func__, pindex->GetBlockHash().ToString());
+            LogPrintf("WARNING : %s() Missing block data at block hash %s\n", __func__, pindex->GetBlockHash().ToString());
             return false;
         }
-        if (BLOCK.vtx.size() > 1) {
+        if (pindex->nTx > 1) {
             LogPrintf("%s() have transaction at block hash %s\n", __func__, pindex->GetBlockHash().ToString());
             return true;
         }
@@ -4427,18 +4964,19 @@ bool EnableMining(const CBlock& block, bool& fMissPreBlock) {
 unsigned int NumOfMined(const CBlock& block, unsigned int nAlliance)
 {
     unsigned int nSameMiner = 0;
-    string addr = GetTxOutputAddr(block.vtx[0], 0);
+    uint160 minerKeyId = GetBlockMinerKeyId(block);
     if (block.hashPrevBlock.IsNull())
         return 0;
+    LOCK(cs_main);
     BlockMap::const_iterator it = mapBlockIndex.find(block.hashPrevBlock);
-    const CBlockIndex* pindex = it->second;
+    CBlockIndex* pindex = it->second;
     for (unsigned int i = 0; pindex && i < Params().DynamicMiner() && i < nAlliance - 1; i++) {
-        CBlock BLOCK;
-        if (!ReadBlockFromDisk(BLOCK, pindex)) {
+        uint160 prevMinerKeyId;
+        if (!GetIndexMinerKeyId(pindex, prevMinerKeyId)) {
             LogPrintf("Error : %s() Read block fail at block hash %s\n", __func__, pindex->GetBlockHash().ToString());
             return nSameMiner;
         }
-        if (addr == GetTxOutputAddr(BLOCK.vtx[0], 0)) {
+        if (minerKeyId == prevMinerKeyId) {
             nSameMiner++;
         }
         pindex = pindex->pprev;
@@ -4450,6 +4988,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 {
     // These are checks that are independent of context
     // that can be verified before saving an orphan block.
+    int64_t nTimeStart = GetTimeMicros();
     bool fMissPreBlock = false;
     if (!block.hashPrevBlock.IsNull()) {
         if (!EnableMining(block, fMissPreBlock)) {
@@ -4468,6 +5007,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     if (!CheckBlockHeader(block, state, fCheckPOW,
                 fJustStart? pminer->NumOfMined(addr, nAlliance): NumOfMined(block, nAlliance)))
         return false;
+    LogPrint("bench", "  - Check block miner: %.2fms\n", 0.001 * (GetTimeMicros() - nTimeStart));
     // add creater of first block to AE member List
     // TODO : erase if this first block fail.
     if (GetHeight() >= 0) {
@@ -4886,6 +5426,7 @@ void PruneOneBlockFile(const int fileNumber)
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~BLOCK_HAVE_GCOIN_UNDO;
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -5148,19 +5689,11 @@ bool static LoadBlockIndexDB()
     return true;
 }
 
-// Reconstruct MemberList, VoteList, BanVoteList and LicenseList.
-// it needed when we restart gcoind
-bool UpdateList(const CBlockIndex *pindex)
+/** Apply the effects of a connected block on the caches. */
+static bool ApplyBlockToCache(const CBlock& block, int nHeight)
 {
-    LogPrintf("UpdateList\n");
-    // scan the best_chain's block
-    CBlock block;
-    // Question: if ReadBlockFromDisk fail, should we put error message and reject?
-    // Now: ignore ReadFail Block and continue checking.
-    if (!ReadBlockFromDisk(block, pindex))
-        return true;
     // creater of first block must be AE
-    if (pindex->nHeight == 1 && palliance->NumOfMembers() == 0) {
+    if (nHeight == 1 && palliance->NumOfMembers() == 0) {
         string addr = GetTxOutputAddr(block.vtx[0], 0);
         palliance->Add(addr);
     }
@@ -5172,11 +5705,25 @@ bool UpdateList(const CBlockIndex *pindex)
                 block.vtx[i], &block)) {
             return false;
         }
+        typecheckcache.Touch(block.vtx[i]);
     }
-
     return true;
 }
 
+// Reconstruct MemberList, VoteList, BanVoteList and LicenseList.
+// it needed when we restart gcoind
+bool UpdateList(const CBlockIndex *pindex)
+{
+    LogPrintf("UpdateList\n");
+    // scan the best_chain's block
+    CBlock block;
+    // Question: if ReadBlockFromDisk fail, should we put error message and reject?
+    // Now: ignore ReadFail Block and continue checking.
+    if (!ReadBlockFromDisk(block, pindex))
+        return true;
+    return ApplyBlockToCache(block, pindex->nHeight);
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -5190,10 +5737,15 @@ CVerifyDB::~CVerifyDB()
 bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
-    if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
+    if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL) {
+        if (GetCacheReplayHeight() > 0)
+            ClearAllCaches();
+        fCacheStateReady = true;
         return true;
+    }
 
     fJustStart = true;
+    int64_t nTimeStart = GetTimeMillis();
     // Verify blocks in the best chain
     if (nCheckDepth <= 0)
         nCheckDepth = 1000000000; // suffices until the year 19000
@@ -5207,18 +5759,16 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     int nGoodTransactions = 0;
     CValidationState state;
     bool fCheck = false;
-    // TODO: Cache mechanism refinement
-    set<int> lheight;
-    lheight.insert(palliance->BackupHeight());
-    lheight.insert(plicense->BackupHeight());
-    lheight.insert(pminer->BackupHeight());
-    lheight.insert(pactivate->BackupHeight());
-    lheight.insert(porder->BackupHeight());
-    int backupHeight = *lheight.begin();
-    for (CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex))
+    // Blocks at or below the backup height are already in the caches, so
+    // only the blocks above it or within the check depth have to be read.
+    int backupHeight = GetCacheReplayHeight();
+    int nStartHeight = std::max(1, std::min(backupHeight + 1, chainActive.Height() - nCheckDepth));
+    int64_t nTimeReplay = 0;
+    int nReplayed = 0;
+    for (CBlockIndex* pindex = chainActive[nStartHeight]; pindex; pindex = chainActive.Next(pindex))
     {
-        if (pindex == chainActive.Genesis()) continue;
         boost::this_thread::interruption_point();
+        int64_t nTimeBlock = GetTimeMicros();
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight >= chainActive.Height() - nCheckDepth)
             fCheck = true;
@@ -5229,9 +5779,12 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
         // check level 1: verify block validity
         if (fCheck && nCheckLevel >= 1 && !CheckBlock(block, state, false, true))
             return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        if (pindex->nHeight > backupHeight)
-            if (!UpdateList(pindex))
+        if (pindex->nHeight > backupHeight) {
+            if (!ApplyBlockToCache(block, pindex->nHeight))
                 return false;
+            nTimeReplay += GetTimeMicros() - nTimeBlock;
+            nReplayed++;
+        }
         // check level 2: verify undo validity
         if (fCheck && nCheckLevel >= 2 && pindex) {
             CBlockUndo undo;
@@ -5246,6 +5799,9 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            // DisconnectBlock also undid the block on the caches, which have to stay at the tip.
+            if (!ApplyBlockToCache(block, pindex->nHeight))
+                return false;
             pindexState = pindex->pprev;
             if (!fClean) {
                 nGoodTransactions = 0;
@@ -5275,6 +5831,13 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     }
 
     fJustStart = false;
+    fCacheStateReady = true;
+    LogPrintf("%s: caches ready at height %d, replayed %d blocks above height %d in %dms\n", __func__,
+              chainActive.Height(), chainActive.Height() - backupHeight, backupHeight, GetTimeMillis() - nTimeStart);
+    // The cost per replayed block estimates what a replay from genesis, without the snapshot, would take
+    double dReplayPerBlock = nReplayed ? 0.001 * nTimeReplay / nReplayed : 0;
+    LogPrint("bench", "    - Cache replay: %d blocks in %.2fms (%.3fms/block), %d blocks from the snapshot, about %.2fms to replay all %d blocks\n",
+             nReplayed, 0.001 * nTimeReplay, dReplayPerBlock, chainActive.Height() - nReplayed, dReplayPerBlock * chainActive.Height(), chainActive.Height());
 
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
 
@@ -6696,6 +7259,24 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // Check the header signatures of the blocks waiting to be processed together
+    // on the block signature checking threads, rather than one per message
+    if (nCheckThreads && !fImporting && !fReindex) {
+        std::vector<CNetMessage*> vpmsg;
+        for (std::deque<CNetMessage>::iterator itBlock = pfrom->vRecvMsg.begin(); itBlock != pfrom->vRecvMsg.end() && itBlock->complete(); itBlock++) {
+            if (!itBlock->fPreverified && itBlock->hdr.GetCommand() == "block")
+                vpmsg.push_back(&*itBlock);
+        }
+        if (vpmsg.size() > 1) {
+            std::vector<const CDataStream*> vpvRecv;
+            BOOST_FOREACH(CNetMessage *pmsg, vpmsg) {
+                pmsg->fPreverified = true;
+                vpvRecv.push_back(&pmsg->vRecv);
+            }
+            PreverifyBlockHeaderSignatures(vpvRecv);
+        }
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
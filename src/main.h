@@ -41,9 +41,12 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCacheDB;
+class CGcoinBlockUndo;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CTxUndo;
 class CValidationInterface;
 class CValidationState;
 class CLicenseInfo;
@@ -65,6 +68,8 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** The maximum number of transactions whose passed type checks are kept for connecting blocks */
+static const unsigned int MAX_TYPECHECK_CACHE_ENTRIES = 100000;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -75,6 +80,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parchecks default (number of transaction type and of block signature checking threads each) */
+static const int DEFAULT_CHECK_THREADS = 1;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -114,6 +121,7 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
@@ -195,6 +203,12 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the transaction type checking thread */
+void ThreadTypeCheck();
+/** Run an instance of the block header signature checking thread */
+void ThreadBlockSignatureCheck();
+/** Start nScriptCheckThreads-1 script checking threads and nCheckThreads threads for each of the transaction type and block header signature checks */
+void StartCheckThreads(boost::thread_group& threadGroup);
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -292,6 +306,12 @@ std::string GetTxInputAddr(const CTransaction& tx, const CBlock *pblock, bool fU
  */
 bool CheckTransactionType(const CTransaction& tx, CValidationState &state, const CBlock *pblock = NULL, bool fNCheckFork = false);
 
+/**
+ * Run CheckTransactionType on the transactions of a block but the coinbase.
+ * With fParallel the checks of NORMAL transactions run on the type checking threads.
+ */
+bool CheckBlockTransactionTypes(const CBlock& block, CValidationState &state, bool fParallel);
+
 
 /*!
  * @brief Checks whether the transaction is already in the mempool.
@@ -375,28 +395,62 @@ bool GeneralCheckValid(const CTransaction& tx, CValidationState &state,
 
 }  // namespace type_transaction_handler
 
-// An interface to fetch transaction
+/**
+ * An interface to fetch transaction.
+ * It is a view over the outputs of a transaction in a block or in the undo inputs, which
+ * have to outlive it, and only holds a copy of the outputs read from the coins or the disk.
+ */
 class TxInfo
 {
 public:
     TxInfo() {
         SetNull();
     }
-    TxInfo(const CTransaction& tx) : hash(tx.GetHash()), vout(tx.vout), type(tx.type) {}
+    explicit TxInfo(const CTransaction& tx) : hash(tx.GetHash()), vout(tx.vout), pvout(&vout), type(tx.type) {}
+    //! A TxInfo looking at the outputs of tx in place, tx has to outlive it
+    static TxInfo View(const CTransaction& tx) {
+        TxInfo txinfo;
+        txinfo.hash = tx.GetHash();
+        txinfo.pvout = &tx.vout;
+        txinfo.type = tx.type;
+        return txinfo;
+    }
+    TxInfo(const uint256 &hashIn, const std::vector<CTxOut> &voutIn, const tx_type &typeIn) : hash(hashIn), vout(voutIn), pvout(&vout), type(typeIn) {}
+    TxInfo(const TxInfo &other) {
+        *this = other;
+    }
+    TxInfo &operator=(const TxInfo &other) {
+        hash = other.hash;
+        type = other.type;
+        if (other.pvout == &other.vout) {
+            vout = other.vout;
+            pvout = &vout;
+        } else {
+            vout.clear();
+            pvout = other.pvout;
+        }
+        return *this;
+    }
     bool init(const COutPoint &outpoint, const CBlock *block = NULL, bool fUndo = false);
     std::string GetTxOutAddressOfIndex(unsigned int index) const;
+    CAddressKey GetTxOutAddressKeyOfIndex(unsigned int index) const;
     type_Color GetTxOutColorOfIndex(unsigned int index) const;
     int64_t GetTxOutValueOfIndex(unsigned int index) const;
     tx_type GetTxType() const;
     uint256 GetTxHash() const;
+    const std::vector<CTxOut> &GetTxOuts() const;
     size_t GetTxOutSize() const;
 private:
     uint256 hash;
+    //! The outputs read from the coins or the disk
     std::vector<CTxOut> vout;
+    //! The outputs, vout or the ones of the transaction viewed
+    const std::vector<CTxOut> *pvout;
     tx_type type;
     void SetNull() {
         hash.SetNull();
         vout.clear();
+        pvout = &vout;
         type = 0;
     }
 };
@@ -433,6 +487,68 @@ struct CDiskTxPos : public CDiskBlockPos {
     }
 };
 
+/** The color, value and address of an output, as kept by the colored output index */
+struct CDiskTxOut {
+    type_Color color;
+    CAmount nValue;
+    CAddressKey address;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(color));
+        if (!ser_action.ForRead()) {
+            uint64_t nVal = CTxOutCompressor::CompressAmount(nValue);
+            READWRITE(VARINT(nVal));
+        } else {
+            uint64_t nVal = 0;
+            READWRITE(VARINT(nVal));
+            nValue = CTxOutCompressor::DecompressAmount(nVal);
+        }
+        READWRITE(address);
+    }
+
+    explicit CDiskTxOut(const CTxOut &txout) : color(txout.color), nValue(txout.nValue), address(txout.scriptPubKey) {}
+
+    CDiskTxOut() : color(0), nValue(0) {}
+};
+
+/**
+ * Position, type and outputs of a transaction in the active chain, as kept by the colored output index.
+ * Only the color, value and address of each output are kept, the scripts stay in the block files.
+ */
+struct CDiskTxOutputs {
+    CDiskTxPos pos;
+    tx_type type;
+    std::vector<CDiskTxOut> vout;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(pos);
+        READWRITE(VARINT(type));
+        READWRITE(vout);
+    }
+
+    CDiskTxOutputs(const CDiskTxPos &posIn, const CTransaction &tx) : pos(posIn), type(tx.type) {
+        vout.reserve(tx.vout.size());
+        for (unsigned int i = 0; i < tx.vout.size(); i++)
+            vout.push_back(CDiskTxOut(tx.vout[i]));
+    }
+
+    CDiskTxOutputs() : type(0) {}
+
+    /** The outputs, each paying its value to the standard script of its address */
+    void GetTxOuts(std::vector<CTxOut> &voutOut) const {
+        voutOut.clear();
+        voutOut.reserve(vout.size());
+        for (unsigned int i = 0; i < vout.size(); i++)
+            voutOut.push_back(CTxOut(vout[i].nValue, vout[i].address.GetScript(), vout[i].color));
+    }
+};
+
 
 CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree);
 
@@ -483,6 +599,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
 
+/**
+ * Apply the effects of this transaction on the UTXO set as ConnectBlock does, keeping what
+ * DisconnectBlock needs to undo it in txundo and, for a MATCH or CANCEL, in gcoinundo
+ */
+void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, CTxUndo &txundo, CGcoinBlockUndo &gcoinundo, int nHeight);
+
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state);
 
@@ -510,6 +632,9 @@ bool CheckFinalTx(const CTransaction &tx);
  */
 extern std::map<std::string, std::vector<std::map<std::string, bool> > > VoteList;
 extern std::map<std::string, std::vector<std::map<std::string, bool> > > BanVoteList;
+/** Candidates whose voting changed since the lists were written to the cache database */
+extern std::set<std::string> VoteListChanged;
+extern std::set<std::string> BanVoteListChanged;
 
 bool CheckTxFeeAndColor(const CTransaction tx, const CBlock *pblock, bool fCheckFee = true);
 
@@ -551,8 +676,103 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
-/** Functions for disk access for cache */
-bool WriteCacheToDisk(const int nHeight);
+/**
+ * Closure representing the type check of a NORMAL transaction of a block.
+ * Its checks only read the caches and the coins of the tip, which do not
+ * change while the block is checked. The result is left in a state of the
+ * transaction's own, for the caller to report.
+ */
+class CTypeCheck
+{
+private:
+    const CTransaction *ptx;
+    const CBlock *pblock;
+    CValidationState *pstate;
+
+public:
+    CTypeCheck(): ptx(0), pblock(0), pstate(0) {}
+    CTypeCheck(const CTransaction& txIn, const CBlock& blockIn, CValidationState& stateIn) :
+        ptx(&txIn), pblock(&blockIn), pstate(&stateIn) {}
+
+    bool operator()();
+
+    void swap(CTypeCheck &check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(pblock, check.pblock);
+        std::swap(pstate, check.pstate);
+    }
+};
+
+/**
+ * Closure representing the header signature check of a block still serialized
+ * in a received message. The block is deserialized on the checking thread, and
+ * a valid signature is only recorded in the cache of preverified headers: the
+ * check of the block in AcceptBlock is the one that counts, and moves it to the
+ * signature cache.
+ */
+class CBlockSignatureCheck
+{
+private:
+    const CDataStream *pvRecv;
+
+public:
+    CBlockSignatureCheck(): pvRecv(0) {}
+    CBlockSignatureCheck(const CDataStream& vRecvIn) : pvRecv(&vRecvIn) {}
+
+    bool operator()();
+
+    void swap(CBlockSignatureCheck &check)
+    {
+        std::swap(pvRecv, check.pvRecv);
+    }
+};
+
+/**
+ * NORMAL transactions whose type checks passed when they were accepted to the
+ * mempool, so that connecting a block does not check them again. An entry keeps
+ * the epochs of the colors the checks looked at, and goes stale once the Apply or
+ * Undo of a transaction touches one of them. Guarded by cs_main.
+ */
+class CTypeCheckCache
+{
+public:
+    CTypeCheckCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn), nLastEpoch(0) {}
+
+    /** Record that the type checks of the transaction passed, looking at the given colors */
+    void Add(const uint256 &hash, const std::set<type_Color> &colors);
+
+    /** Whether the type checks of the transaction passed, and none of its colors changed since */
+    bool Contains(const uint256 &hash) const;
+
+    void Erase(const uint256 &hash);
+
+    /** Make the entries looking at the colors of the transaction stale, once it is applied or undone */
+    void Touch(const CTransaction &tx);
+
+    /** Drop every entry, once the caches are loaded again */
+    void Clear();
+
+    size_t Size() const { return mapEntries.size(); }
+
+private:
+    struct CEntry
+    {
+        std::vector<std::pair<type_Color, uint64_t> > vColorEpochs;
+    };
+
+    size_t nMaxEntries;
+    uint64_t nLastEpoch;
+    std::map<type_Color, uint64_t> mapColorEpochs;
+    std::map<uint256, CEntry> mapEntries;
+
+    uint64_t GetEpoch(const type_Color &color) const;
+};
+
+extern CTypeCheckCache typecheckcache;
+
+/** Load the state of all caches written at the last chainstate flush */
+bool LoadCacheSnapshot();
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -574,8 +794,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW, unsigned int nSameMiner);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fNCheckFork = false);
+/** Number of the last blocks before this one, within the alliance window, mined by its miner */
+unsigned int NumOfMined(const CBlock& block, unsigned int nAlliance);
 
 bool CheckBlockHeaderSignature(const CBlock& block, CValidationState& state);
+/**
+ * Check the header signatures of the blocks serialized in vpvRecv on the block
+ * signature checking threads, so that the valid ones are found in the signature
+ * cache when the blocks are processed.
+ */
+void PreverifyBlockHeaderSignatures(const std::vector<const CDataStream*>& vpvRecv);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
@@ -677,6 +905,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the cache database (protected by cs_main) */
+extern CCacheDB *pcachedb;
+
 static const type_Color FEE_COLOR = 1;
 static const int64_t FEE_VALUE = COIN;
 
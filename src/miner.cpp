@@ -487,12 +487,11 @@ bool EnableCreateBlock()
         return true;
 
     for (int i = 0; i < COINBASE_MATURITY && pindex; i++) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            LogPrintf("ERROR : %s() Read block fail at block hash %s\n", __func__, pindex->GetBlockHash().ToString());
+        if (pindex->nTx == 0) {
+            LogPrintf("ERROR : %s() Missing block data at block hash %s\n", __func__, pindex->GetBlockHash().ToString());
             return false;
         }
-        if (block.vtx.size() > 1) {
+        if (pindex->nTx > 1) {
             LogPrintf("%s() : height %d have transactions\n", __func__, pindex->nHeight);
             return true;
         }
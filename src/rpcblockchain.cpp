@@ -228,8 +228,8 @@ Value getaddrmempool(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 2 || params.size() < 1)
         throw std::runtime_error(
-            "getaddrmempool ( verbose )\n"
-            "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
+            "getaddrmempool \"address\" ( verbose )\n"
+            "\nReturns the ids of the transactions in memory pool that pay to or spend from the address.\n"
             "\nArguments:\n"
             "1. address           (string) Specific address\n"
             "2. verbose           (boolean, optional, default=false) true for a json object, false for array of transaction ids\n"
@@ -253,43 +253,40 @@ Value getaddrmempool(const Array& params, bool fHelp)
             "  }, ...\n"
             "]\n"
             "\nExamples\n"
-            + HelpExampleCli("getaddrmempool", "true")
-            + HelpExampleRpc("getaddrmempool", "true")
+            + HelpExampleCli("getaddrmempool", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" true")
+            + HelpExampleRpc("getaddrmempool", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", true")
         );
 
     bool fVerbose = false;
 
-    std::string addr = params[0].get_str();
+    CAddressKey address(params[0].get_str());
 
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
+    // The lookup only needs the mempool, the chain is locked just long enough to read the
+    // height the current priorities are reported at
+    int nHeight = 0;
+    if (fVerbose) {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+    }
+
+    LOCK(mempool.cs);
+
+    std::vector<uint256> vtxid;
+    if (!address.IsNull())
+        mempool.queryHashesByAddress(address, vtxid);
+
     Object o;
     Array a;
-    typedef std::pair<const uint256, const CTxMemPoolEntry> mapit_t;
-    BOOST_FOREACH(const mapit_t &it, mempool.mapTx)
+    BOOST_FOREACH(const uint256& hash, vtxid)
     {
-        LOCK(mempool.cs);
-        const uint256& hash = it.first;
-        const CTxMemPoolEntry& e = it.second;
-        const CTransaction& tx = e.GetTx();
-        bool fAddr = false;
-        TxInfo txinfo(tx);
-        for (unsigned int index = 0; !fAddr && index < txinfo.GetTxOutSize(); index++) {
-            if (addr == txinfo.GetTxOutAddressOfIndex(index))
-                fAddr = true;
-        }
-        BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (fAddr)
-                break;
-            TxInfo txinfoIn;
-            if (!txinfoIn.init(txin.prevout, NULL)) {
-                continue;
-            } else if (addr == txinfoIn.GetTxOutAddressOfIndex(txin.prevout.n))
-                fAddr = true;
-        }
-        if (!fAddr)
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end())
             continue;
+        const CTxMemPoolEntry& e = it->second;
+        const CTransaction& tx = e.GetTx();
         if (fVerbose) {
             Object info;
             info.push_back(Pair("size", (int)e.GetTxSize()));
@@ -297,7 +294,7 @@ Value getaddrmempool(const Array& params, bool fHelp)
             info.push_back(Pair("time", e.GetTime()));
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+            info.push_back(Pair("currentpriority", e.GetPriority(nHeight)));
             std::set<std::string> setDepends;
             BOOST_FOREACH(const CTxIn& txin, tx.vin) {
                 if (mempool.exists(txin.prevout.hash))
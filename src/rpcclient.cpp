@@ -42,6 +42,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "gettotalbandwidth", 0 },
     { "gettotalbandwidth", 1 },
     { "gettotalbandwidth", 2 },
+    { "getorderbook", 0 },
+    { "getorderbook", 1 },
+    { "getorderbook", 2 },
+    { "matchorders", 0 },
+    { "matchorders", 1 },
+    { "matchorders", 2 },
     { "sendtoaddress", 1 },
     { "sendtoaddress", 2 },
     { "sendtoaddress", 4 },
@@ -70,7 +76,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listtransactions", 1 },
     { "listtransactions", 2 },
     { "listtransactions", 3 },
+    { "listtransactions", 5 },
     { "listwalletaddress", 1 },
+    { "listwalletaddress", 3 },
     { "listonewalletaddress", 0 },
     { "getnewaddressamount", 0 },
     { "gennewaddress", 0 },
@@ -84,6 +92,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getlicenseinfo", 0 },
     { "encodelicenseinfo", 0 },
     { "sendlicensetoaddress", 1 },
+    { "sendbatch", 0 },
     { "sendmany", 2 },
     { "sendmany", 3 },
     { "sendmany", 4 },
@@ -101,6 +110,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listunspent", 1 },
     { "listunspent", 2 },
     { "listunspent", 3 },
+    { "listunspent", 5 },
     { "getblock", 1 },
     { "gettransaction", 1 },
     { "getrawtransaction", 1 },
@@ -120,6 +130,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "verifychain", 1 },
     { "keypoolrefill", 0 },
     { "hdkeypoolrefill", 0 },
+    { "hdgennewaddress", 0 },
     { "getrawmempool", 0 },
     { "getaddrmempool", 1 },
     { "estimatefee", 0 },
@@ -154,6 +165,23 @@ CRPCConvertTable::CRPCConvertTable()
 
 static CRPCConvertTable rpcCvtTable;
 
+/** List calls the server can write out page by page, see vRPCListCommands */
+static const char * const vRPCListMethods[] =
+{
+    "listunspent",
+    "listwalletaddress",
+    "listtransactions",
+};
+
+bool RPCIsListMethod(const std::string& strMethod)
+{
+    for (unsigned int i = 0; i < (sizeof(vRPCListMethods) / sizeof(vRPCListMethods[0])); i++) {
+        if (strMethod == vRPCListMethods[i])
+            return true;
+    }
+    return false;
+}
+
 /** Convert strings to command-specific RPC representation */
 Array RPCConvertValues(const std::string &strMethod, const std::vector<std::string> &strParams)
 {
@@ -11,5 +11,7 @@
 #include "json/json_spirit_writer_template.h"
 
 json_spirit::Array RPCConvertValues(const std::string& strMethod, const std::vector<std::string>& strParams);
+/** Whether the server may write the full result of the method out as a chunked reply */
+bool RPCIsListMethod(const std::string& strMethod);
 
 #endif // BITCOIN_RPCCLIENT_H
@@ -25,7 +25,6 @@
 
 using namespace json_spirit;
 using namespace std;
-using alliance_member::AllianceMember;
 
 Value getconnectioncount(const Array& params, bool fHelp)
 {
@@ -442,8 +441,8 @@ Value getmemberlist(const Array& params, bool fHelp)
 
     Object obj;
     Array a;
-    for (AllianceMember::CIterator it = palliance->IteratorBegin();
-         it != palliance->IteratorEnd(); ++it)
+    set<string> members = palliance->ListMembers();
+    for (set<string>::const_iterator it = members.begin(); it != members.end(); ++it)
         a.push_back((*it));
     obj.push_back(Pair("member_list", a));
     return obj;
@@ -539,27 +538,57 @@ Value gettotalbandwidth(const Array& params, bool fHelp)
     throw std::runtime_error(err_str);
 }
 
-Value getorderlist(const Array& params, bool fHelp)
+static Array OrderBookToJSON(const vector<order_list::order_info_> &orders)
 {
-    if (fHelp || params.size() != 0)
+    Array a;
+    for (vector<order_list::order_info_>::const_iterator it = orders.begin(); it != orders.end(); ++it) {
+        Object entry;
+        entry.push_back(Pair("txid", it->hash.GetHex()));
+        entry.push_back(Pair("address", it->address));
+        entry.push_back(Pair("sell_amount", ValueFromAmount(it->sell_amount)));
+        entry.push_back(Pair("buy_amount", ValueFromAmount(it->buy_amount)));
+        a.push_back(entry);
+    }
+    return a;
+}
+
+Value getorderbook(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 3)
         throw std::runtime_error(
-            _(__func__) + "\n"
-            "\nGet all order transaction's hash in the network.\n"
+            _(__func__) + " sellcolor buycolor depth\n"
+            "\nGet the resting orders between two colors in price order.\n"
+            "\nArguments:\n"
+            "1. sellcolor    (numeric, required) The color to be sold\n"
+            "2. buycolor     (numeric, required) The color to be bought\n"
+            "3. depth        (numeric, required) The maximum amount of orders on each side\n"
             "\nResult:\n"
-            "\n"
             "{\n"
-            "  \"order_list\":str,    (string) an information of an order\n"
+            "  \"asks\": [              (array) orders selling sellcolor for buycolor, cheapest first\n"
+            "    {\n"
+            "      \"txid\": \"hash\",     (string) the order transaction id\n"
+            "      \"address\": \"addr\",  (string) the address receiving the bought coins\n"
+            "      \"sell_amount\": n,    (numeric) the amount to be sold\n"
+            "      \"buy_amount\": n      (numeric) the amount to be bought\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"bids\": [ ... ]        (array) orders selling buycolor for sellcolor, best first\n"
             "}\n"
             "\nExamples:\n"
-            + HelpExampleCli("getorderlist", "")
-            + HelpExampleRpc("getorderlist", "")
+            + HelpExampleCli("getorderbook", "5 3 10")
+            + HelpExampleRpc("getorderbook", "5, 3, 10")
        );
 
-    Object obj;
-    std::vector<std::string> orders = porder->GetList();
-    for (unsigned int i = 0; i < orders.size(); i++)
-        obj.push_back(Pair("order_list", orders[i]));
+    const type_Color sellcolor = ColorFromValue(params[0]), buycolor = ColorFromValue(params[1]);
+    int depth = params[2].get_int();
+    if (depth < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative depth");
 
+    LOCK(cs_main);
+
+    Object obj;
+    obj.push_back(Pair("asks", OrderBookToJSON(porder->GetBook(sellcolor, buycolor, depth))));
+    obj.push_back(Pair("bids", OrderBookToJSON(porder->GetBook(buycolor, sellcolor, depth))));
     return obj;
 }
 
@@ -14,6 +14,7 @@
 #include "version.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <sstream>
@@ -134,6 +135,29 @@ std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive,
         return HTTPReplyHeader(nStatus, keepalive, strMsg.size(), contentType) + strMsg;
 }
 
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive, const char *contentType)
+{
+    return strprintf(
+            "HTTP/1.1 %d %s\r\n"
+            "Date: %s\r\n"
+            "Connection: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Content-Type: %s\r\n"
+            "Server: gcoin-json-rpc/%s\r\n"
+            "\r\n",
+        nStatus,
+        httpStatusDescription(nStatus),
+        rfc1123Time(),
+        keepalive ? "keep-alive" : "close",
+        contentType,
+        FormatFullVersion());
+}
+
+std::string HTTPChunk(const std::string& strData)
+{
+    return strprintf("%x\r\n", strData.size()) + strData + "\r\n";
+}
+
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
                          std::string& http_method, std::string& http_uri)
 {
@@ -223,7 +247,28 @@ int ReadHTTPMessage(std::basic_istream<char>& stream, std::map<std::string,
         return HTTP_INTERNAL_SERVER_ERROR;
 
     // Read message
-    if (nLen > 0) {
+    if (mapHeadersRet["transfer-encoding"] == "chunked") {
+        // Each chunk is preceded by its size in hex, an empty chunk ends the message
+        while (true) {
+            std::string str;
+            std::getline(stream, str);
+            if (!stream)
+                return HTTP_INTERNAL_SERVER_ERROR;
+            size_t nChunk = strtoul(str.c_str(), NULL, 16);
+            if (nChunk == 0)
+                break;
+            if (nChunk > max_size - strMessageRet.size())
+                return HTTP_INTERNAL_SERVER_ERROR;
+            size_t ptr = strMessageRet.size();
+            strMessageRet.resize(ptr + nChunk);
+            stream.read(&strMessageRet[ptr], nChunk);
+            std::getline(stream, str);
+            if (!stream) // Connection lost while reading
+                return HTTP_INTERNAL_SERVER_ERROR;
+        }
+        std::map<std::string, std::string> mapTrailers;
+        ReadHTTPHeaders(stream, mapTrailers);
+    } else if (nLen > 0) {
         std::vector<char> vch;
         size_t ptr = 0;
         while (ptr < (size_t)nLen) {
@@ -158,6 +158,13 @@ std::string HTTPReplyHeader(int nStatus, bool keepalive, size_t contentLength,
 std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive,
                       bool headerOnly = false,
                       const char *contentType = "application/json");
+/** Header of a reply whose body follows in chunks of HTTPChunk() */
+std::string HTTPReplyHeaderChunked(int nStatus, bool keepalive,
+                                   const char *contentType = "application/json");
+/** One chunk of a chunked reply, the empty string ends the reply */
+std::string HTTPChunk(const std::string& strData);
+/** Request header by which an HTTP/1.1 client asks for the full result of a list call as a chunked reply */
+static const char * const HTTP_HEADER_RPC_STREAM = "X-RPC-Stream";
 bool ReadHTTPRequestLine(std::basic_istream<char>& stream, int &proto,
                          std::string& http_method, std::string& http_uri);
 int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto);
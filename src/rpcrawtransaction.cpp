@@ -206,46 +206,8 @@ Value getrawtransaction(const Array& params, bool fHelp)
     return result;
 }
 
-Value listunspent(const Array& params, bool fHelp)
+void ListUnspentPage(const Array& params, std::string& strCursor, unsigned int nLimit, Array& results)
 {
-    if (fHelp || params.size() > 4)
-        throw std::runtime_error(
-        _(__func__) + " ( minconf maxconf  [\"address\",...] )\n"
-        "\nReturns array of unspent transaction outputs\n"
-        "with between minconf and maxconf (inclusive) confirmations.\n"
-        "Optionally filter to only include txouts paid to specified addresses.\n"
-        "Results are an array of Objects, each of which has:\n"
-        "{txid, vout, scriptPubKey, amount, confirmations}\n"
-        "\nArguments:\n"
-        "1. minconf          (numeric, optional, default=1) The minimum confirmationsi to filter\n"                "2. maxconf          (numeric, optional, default=9999999) The maximum confirmations to filter\n"
-        "3. \"addresses\"    (string) A json array of gcoin addresses to filter\n"
-        "    [\n"
-        "      \"address\"   (string) gcoin address\n"
-        "      ,...\n"
-        "    ]\n"
-        "4. color          (numeric, optional) If specified, looks for UTXOs with this color\n"
-        "\nResult\n"
-        "[                   (array of json object)\n"
-        "  {\n"
-        "    \"txid\" : \"txid\",        (string) the transaction id \n"
-        "    \"vout\" : n,               (numeric) the vout value\n"
-        "    \"address\" : \"address\",  (string) the gcoin address\n"
-        "    \"account\" : \"account\",  (string) The associated account, or \"\" for the default account\n"
-        "    \"scriptPubKey\" : \"key\", (string) the script key\n"
-        "    \"amount\" : x.xxx,         (numeric) the transaction amount in btc\n"
-        "    \"color\" : color_type      (numeric) The currency type (color) of the transaction\n"
-        "    \"confirmations\" : n       (numeric) The number of confirmations\n"
-        "  }\n"
-        "  ,...\n"
-        "]\n"
-
-        "\nExamples\n"
-        + HelpExampleCli(__func__, "")
-        + HelpExampleCli(__func__, "6 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"")
-        + HelpExampleRpc(__func__, "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"")
-        + HelpExampleRpc(__func__, "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\" 1")
-        );
-
     RPCTypeCheck(params, boost::assign::list_of(int_type)(int_type)(array_type));
 
     int nMinDepth = 1;
@@ -276,62 +238,114 @@ Value listunspent(const Array& params, bool fHelp)
         color_filter = ColorFromValue(params[3]);
     }
 
-    Array results;
-    std::vector<COutput> vecOutputs;
     assert(pwalletMain != NULL);
 
-    // scan distinct colors in the wallet
-    std::set<type_Color> colors;
-    for (std::map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
-        BOOST_FOREACH(const CTxOut txout, it->second.vout)
-            if (colors.count(txout.color) == 0)
-                colors.insert(txout.color);
-
-    // get all UTXOs for every color
-    for (std::set<type_Color>::const_iterator it = colors.begin(); it != colors.end(); ++it) {
-        pwalletMain->AvailableCoins(vecOutputs, *it, false);
-        if (fColor && *it != color_filter) continue;
-        BOOST_FOREACH(const COutput& out, vecOutputs) {
-            if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
+    // The pages follow the coin index of the wallet, by color
+    std::pair<type_Color, CWalletCoinIndex::Coin> pos(color_filter, CWalletCoinIndex::Coin(std::numeric_limits<CAmount>::min(), COutPoint()));
+    if (!strCursor.empty())
+        DecodeRPCCursor(strCursor, pos);
+    strCursor.clear();
+
+    // The outputs point into the wallet transactions, which stay locked for the whole page
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    // Look at no more than a page of outputs, the page may come out short when they are filtered
+    std::vector<COutput> vecOutputs;
+    bool fMore = pwalletMain->AvailableCoinsAfter(vecOutputs, pos, nLimit, false);
+    BOOST_FOREACH(const COutput& out, vecOutputs) {
+        if (fColor && out.tx->vout[out.i].color != color_filter)
+            continue;
+        if (out.nDepth < nMinDepth || out.nDepth > nMaxDepth)
+            continue;
+        if (setAddress.size()) {
+            CTxDestination address;
+            if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
                 continue;
-            if (setAddress.size()) {
-                CTxDestination address;
-                if (!ExtractDestination(out.tx->vout[out.i].scriptPubKey, address))
-                    continue;
 
-                if (!setAddress.count(address))
-                    continue;
-            }
+            if (!setAddress.count(address))
+                continue;
+        }
 
-            int64_t nValue = out.tx->vout[out.i].nValue;
-            const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-            Object entry;
-            entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
-            entry.push_back(Pair("vout", out.i));
+        int64_t nValue = out.tx->vout[out.i].nValue;
+        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
+        Object entry;
+        entry.push_back(Pair("txid", out.tx->GetHash().GetHex()));
+        entry.push_back(Pair("vout", out.i));
+        CTxDestination address;
+        if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
+            entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
+            if (pwalletMain->mapAddressBook.count(address))
+                entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
+        }
+        entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
+        if (pk.IsPayToScriptHash()) {
             CTxDestination address;
-            if (ExtractDestination(out.tx->vout[out.i].scriptPubKey, address)) {
-                entry.push_back(Pair("address", CBitcoinAddress(address).ToString()));
-                if (pwalletMain->mapAddressBook.count(address))
-                    entry.push_back(Pair("account", pwalletMain->mapAddressBook[address].name));
-            }
-            entry.push_back(Pair("scriptPubKey", HexStr(pk.begin(), pk.end())));
-            if (pk.IsPayToScriptHash()) {
-                CTxDestination address;
-                if (ExtractDestination(pk, address)) {
-                    const CScriptID& hash = boost::get<CScriptID>(address);
-                    CScript redeemScript;
-                    if (pwalletMain->GetCScript(hash, redeemScript))
-                        entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
-                }
+            if (ExtractDestination(pk, address)) {
+                const CScriptID& hash = boost::get<CScriptID>(address);
+                CScript redeemScript;
+                if (pwalletMain->GetCScript(hash, redeemScript))
+                    entry.push_back(Pair("redeemScript", HexStr(redeemScript.begin(), redeemScript.end())));
             }
-            entry.push_back(Pair("amount", ValueFromAmount(nValue)));
-            entry.push_back(Pair("color", (int64_t)out.tx->vout[out.i].color));
-            entry.push_back(Pair("confirmations", out.nDepth));
-            entry.push_back(Pair("spendable", out.fSpendable));
-            results.push_back(entry);
         }
+        entry.push_back(Pair("amount", ValueFromAmount(nValue)));
+        entry.push_back(Pair("color", (int64_t)out.tx->vout[out.i].color));
+        entry.push_back(Pair("confirmations", out.nDepth));
+        entry.push_back(Pair("spendable", out.fSpendable));
+        results.push_back(entry);
     }
-    return results;
+    if (fMore && (!fColor || pos.first == color_filter))
+        strCursor = EncodeRPCCursor(pos);
+}
+
+Value listunspent(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 6)
+        throw std::runtime_error(
+        _(__func__) + " ( minconf maxconf  [\"address\",...] color \"cursor\" limit )\n"
+        "\nReturns array of unspent transaction outputs\n"
+        "with between minconf and maxconf (inclusive) confirmations.\n"
+        "Optionally filter to only include txouts paid to specified addresses.\n"
+        "Results are an array of Objects, each of which has:\n"
+        "{txid, vout, scriptPubKey, amount, confirmations}\n"
+        "\nArguments:\n"
+        "1. minconf          (numeric, optional, default=1) The minimum confirmationsi to filter\n"                "2. maxconf          (numeric, optional, default=9999999) The maximum confirmations to filter\n"
+        "3. \"addresses\"    (string) A json array of gcoin addresses to filter\n"
+        "    [\n"
+        "      \"address\"   (string) gcoin address\n"
+        "      ,...\n"
+        "    ]\n"
+        "4. color          (numeric, optional) If specified, looks for UTXOs with this color\n"
+        "5. \"cursor\"     (string, optional) Return a page of the list, starting at this cursor (\"\" for the first page)\n"
+        "6. limit          (numeric, optional, default=1000) The number of outputs to look at for the page\n"
+        "\nResult\n"
+        "[                   (array of json object)\n"
+        "  {\n"
+        "    \"txid\" : \"txid\",        (string) the transaction id \n"
+        "    \"vout\" : n,               (numeric) the vout value\n"
+        "    \"address\" : \"address\",  (string) the gcoin address\n"
+        "    \"account\" : \"account\",  (string) The associated account, or \"\" for the default account\n"
+        "    \"scriptPubKey\" : \"key\", (string) the script key\n"
+        "    \"amount\" : x.xxx,         (numeric) the transaction amount in btc\n"
+        "    \"color\" : color_type      (numeric) The currency type (color) of the transaction\n"
+        "    \"confirmations\" : n       (numeric) The number of confirmations\n"
+        "  }\n"
+        "  ,...\n"
+        "]\n"
+        "\nWith a cursor the result is an object {\"entries\" : [...], \"cursor\" : \"cursor\"}, where \"cursor\" is\n"
+        "to be passed for the next page and is \"\" after the last page.\n"
+        "Without a cursor the whole list is streamed back when the server allows it.\n"
+
+        "\nExamples\n"
+        + HelpExampleCli(__func__, "")
+        + HelpExampleCli(__func__, "6 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"")
+        + HelpExampleRpc(__func__, "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\"")
+        + HelpExampleRpc(__func__, "6, 9999999 \"[\\\"1PGFqEzfmQch1gKD3ra4k18PNj3tTUUSqg\\\",\\\"1LtvqCaApEdUGFkpKMM4MstjcaL4dKg8SP\\\"]\" 1")
+        );
+
+    if (params.size() > 4)
+        return RPCListPage(&ListUnspentPage, params, params[4], params.size() > 5 ? params[5] : Value::null);
+
+    return RPCListAll(&ListUnspentPage, params);
 }
 
 Value verifytxoutproof(const Array& params, bool fHelp)
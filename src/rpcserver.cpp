@@ -321,7 +321,7 @@ static const CRPCCommand vRPCCommands[] =
     { "network",            "getrtts",                     &getrtts,                     true,      false,      false },
     { "network",            "gettotalbandwidth",           &gettotalbandwidth,           true,      false,      false },
     { "network",            "getmemberlist",               &getmemberlist,               true,      false,      false },
-    { "network",            "getorderlist",                &getorderlist,                true,      false,      false },
+    { "network",            "getorderbook",                &getorderbook,                true,      false,      false },
 
     /* Block chain and UTXO */
     { "blockchain",         "getblockchaininfo",           &getblockchaininfo,           true,      false,      false },
@@ -392,6 +392,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "sendorder",                   &sendorder,                   false,     false,      true },
     { "wallet",             "cancelorder",                 &cancelorder,                 false,     false,      true },
     { "wallet",             "match",                       &match,                       false,     false,      true },
+    { "wallet",             "matchorders",                 &matchorders,                 false,     false,      true },
     { "wallet",             "getlicenselist",              &getlicenselist,              false,     false,      true },
     { "wallet",             "getlicenseinfo",              &getlicenseinfo,              false,     false,      true },
 
@@ -427,6 +428,7 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "listunspent",                 &listunspent,                 false,     false,      true },
     { "wallet",             "lockunspent",                 &lockunspent,                 true,      false,      true },
     { "wallet",             "move",                        &movecmd,                     false,     false,      true },
+    { "wallet",             "sendbatch",                   &sendbatch,                   false,     false,      true },
     { "wallet",             "sendfrom",                    &sendfrom,                    false,     false,      true },
     { "wallet",             "sendfromfeeaddress",          &sendfromfeeaddress,          false,     false,      true },
     { "wallet",             "sendmany",                    &sendmany,                    false,     false,      true },
@@ -440,6 +442,41 @@ static const CRPCCommand vRPCCommands[] =
     { "wallet",             "hdaddchain",                  &hdaddchain,                  true,      false,      true },
     { "wallet",             "hdsetchain",                  &hdsetchain,                  false,     false,      true },
     { "wallet",             "hdgetinfo",                   &hdgetinfo,                   false,     false,      true },
+    { "wallet",             "hdgennewaddress",             &hdgennewaddress,             false,     false,      true },
+#endif // ENABLE_WALLET
+};
+
+#ifdef ENABLE_WALLET
+static bool ListUnspentAll(const Array& params)
+{
+    return params.size() <= 4;
+}
+
+static bool ListWalletAddressAll(const Array& params)
+{
+    return params.size() <= 1;
+}
+
+static bool ListTransactionsAll(const Array& params)
+{
+    // A count of -1 lists all the transactions, with nothing skipped
+    return params.size() >= 2 && params.size() <= 4 &&
+           params[1].type() == int_type && params[1].get_int() == -1 &&
+           (params.size() < 3 || (params[2].type() == int_type && params[2].get_int() == 0));
+}
+#endif // ENABLE_WALLET
+
+/**
+ * List calls written out page by page
+ */
+static const CRPCListCommand vRPCListCommands[] =
+{
+  //  name                           actor (function)              full result asked
+  //  -----------------------------  ----------------------------  ------------------------
+#ifdef ENABLE_WALLET
+    { "listunspent",                 &ListUnspentPage,             &ListUnspentAll },
+    { "listwalletaddress",           &ListWalletAddressPage,       &ListWalletAddressAll },
+    { "listtransactions",            &ListTransactionsPage,        &ListTransactionsAll },
 #endif // ENABLE_WALLET
 };
 
@@ -453,6 +490,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCListCommands) / sizeof(vRPCListCommands[0])); vcidx++)
+        mapListCommands[vRPCListCommands[vcidx].name] = &vRPCListCommands[vcidx];
 }
 
 const CRPCCommand *CRPCTable::operator[](string name) const
@@ -463,6 +502,45 @@ const CRPCCommand *CRPCTable::operator[](string name) const
     return (*it).second;
 }
 
+const CRPCListCommand *CRPCTable::listCommand(const string& name) const
+{
+    map<string, const CRPCListCommand*>::const_iterator it = mapListCommands.find(name);
+    if (it == mapListCommands.end())
+        return NULL;
+    return (*it).second;
+}
+
+Array RPCListAll(rpclistfn_type actor, const Array& params, size_t nMax)
+{
+    Array entries;
+    if (nMax == 0)
+        return entries;
+    string strCursor;
+    do {
+        actor(params, strCursor, std::min((size_t)RPC_LIST_PAGE_SIZE, nMax - entries.size()), entries);
+    } while (!strCursor.empty() && entries.size() < nMax);
+    if (entries.size() > nMax)
+        entries.resize(nMax);
+    return entries;
+}
+
+Object RPCListPage(rpclistfn_type actor, const Array& params, const Value& cursor, const Value& limit)
+{
+    string strCursor = cursor.get_str();
+    int nLimit = RPC_LIST_PAGE_SIZE;
+    if (limit.type() != null_type)
+        nLimit = limit.get_int();
+    if (nLimit <= 0 || nLimit > (int)MAX_RPC_LIST_PAGE_SIZE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid limit, expected 1 to %u", MAX_RPC_LIST_PAGE_SIZE));
+
+    Array entries;
+    actor(params, strCursor, nLimit, entries);
+    Object ret;
+    ret.push_back(Pair("entries", entries));
+    ret.push_back(Pair("cursor", strCursor));
+    return ret;
+}
+
 
 bool HTTPAuthorized(map<string, string>& mapHeaders)
 {
@@ -960,9 +1038,120 @@ static string JSONRPCExecBatch(const Array& vReq)
     return write_string(Value(ret), false) + "\n";
 }
 
+/**
+ * Writes a JSON-RPC reply with an array result to a connection as its entries come,
+ * in HTTP chunks of about RPC_STREAM_CHUNK_SIZE bytes.
+ */
+class CRPCStreamWriter
+{
+private:
+    std::ostream& stream;
+    string strChunk;
+    bool fEmpty;
+
+    void Flush()
+    {
+        if (!strChunk.empty())
+            stream << HTTPChunk(strChunk) << std::flush;
+        strChunk.clear();
+    }
+
+public:
+    static const size_t RPC_STREAM_CHUNK_SIZE = 65536;
+
+    CRPCStreamWriter(std::ostream& streamIn, bool fKeepAlive) : stream(streamIn), fEmpty(true)
+    {
+        stream << HTTPReplyHeaderChunked(HTTP_OK, fKeepAlive);
+        strChunk = "{\"result\":[";
+    }
+
+    void Write(const Value& entry)
+    {
+        if (!fEmpty)
+            strChunk += ",";
+        fEmpty = false;
+        strChunk += write_string(entry, false);
+        if (strChunk.size() >= RPC_STREAM_CHUNK_SIZE)
+            Flush();
+    }
+
+    void Finish(const Value& id)
+    {
+        strChunk += "],\"error\":null,\"id\":" + write_string(id, false) + "}\n";
+        Flush();
+        stream << HTTPChunk("") << std::flush;
+    }
+};
+
+/** Signals the end of a command however it leaves the scope */
+class CRPCPostCommandGuard
+{
+private:
+    const CRPCCommand& cmd;
+
+public:
+    CRPCPostCommandGuard(const CRPCCommand& cmdIn) : cmd(cmdIn) {}
+
+    ~CRPCPostCommandGuard()
+    {
+        g_rpcSignals.PostCommand(cmd);
+    }
+};
+
+/**
+ * Reply to a list call page by page, releasing the locks in between, rather than
+ * building the whole result first. Returns false if the connection has to be closed.
+ */
+static bool JSONRPCExecList(AcceptedConnection *conn, const JSONRequest& jreq, const CRPCListCommand *plist, bool fRun)
+{
+    const CRPCCommand *pcmd = tableRPC[jreq.strMethod];
+    if (!pcmd)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+
+    g_rpcSignals.PreCommand(*pcmd);
+    CRPCPostCommandGuard postCommand(*pcmd);
+
+    // Errors of the first page are replied as usual
+    Array entries;
+    string strCursor;
+    try {
+        plist->actor(jreq.params, strCursor, RPC_LIST_PAGE_SIZE, entries);
+    } catch (const std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    // Past it the reply is under way and can only be cut off
+    CRPCStreamWriter writer(conn->stream(), fRun);
+    while (true) {
+        BOOST_FOREACH(const Value& entry, entries)
+            writer.Write(entry);
+        if (strCursor.empty())
+            break;
+        entries.clear();
+        try {
+            plist->actor(jreq.params, strCursor, RPC_LIST_PAGE_SIZE, entries);
+        } catch (const Object& objError) {
+            LogPrintf("%s: %s failed: %s\n", __func__, jreq.strMethod, find_value(objError, "message").get_str());
+            return false;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s failed: %s\n", __func__, jreq.strMethod, e.what());
+            return false;
+        }
+    }
+    writer.Finish(jreq.id);
+    return true;
+}
+
+/** Whether the client can take a chunked reply and asked for one */
+static bool HTTPStreamAccepted(int nProto, map<string, string>& mapHeaders)
+{
+    return nProto >= 1 && mapHeaders[boost::to_lower_copy(string(HTTP_HEADER_RPC_STREAM))] == "1";
+}
+
 static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
                             string& strRequest,
                             map<string, string>& mapHeaders,
+                            int nProto,
                             bool fRun)
 {
     // Check authorization
@@ -1005,6 +1194,11 @@ static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
         if (valRequest.type() == obj_type) {
             jreq.parse(valRequest);
 
+            // full result of a list call, streamed only to HTTP/1.1 clients that ask for it
+            const CRPCListCommand *plist = tableRPC.listCommand(jreq.strMethod);
+            if (plist && plist->fAll(jreq.params) && HTTPStreamAccepted(nProto, mapHeaders))
+                return JSONRPCExecList(conn, jreq, plist, fRun);
+
             Value result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -1053,7 +1247,7 @@ void ServiceConnection(AcceptedConnection *conn)
 
         // Process via JSON-RPC API
         if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
+            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, nProto, fRun))
                 break;
 
         // Process via HTTP REST API
@@ -9,9 +9,13 @@
 
 #include "amount.h"
 #include "rpcprotocol.h"
+#include "streams.h"
 #include "uint256.h"
+#include "utilstrencodings.h"
+#include "version.h"
 
 #include <inttypes.h>
+#include <limits>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -105,6 +109,60 @@ public:
     bool reqWallet;
 };
 
+/** Number of entries in a page of a list call, unless asked otherwise */
+static const unsigned int RPC_LIST_PAGE_SIZE = 1000;
+/** Largest page of a list call */
+static const unsigned int MAX_RPC_LIST_PAGE_SIZE = 100000;
+
+/**
+ * Page of a list call: appends up to nLimit entries following the position strCursor,
+ * and sets strCursor to the position after the last one, or to "" when the list is done.
+ * It takes the locks it needs for the page only.
+ */
+typedef void(*rpclistfn_type)(const json_spirit::Array& params, std::string& strCursor, unsigned int nLimit, json_spirit::Array& entries);
+
+/** Whether the parameters of a list call ask for its full result */
+typedef bool(*rpclistallfn_type)(const json_spirit::Array& params);
+
+/** List call whose full result the server writes out page by page instead of building it whole */
+class CRPCListCommand
+{
+public:
+    std::string name;
+    rpclistfn_type actor;
+    rpclistallfn_type fAll;
+};
+
+/** Collect the pages of a list call, at most nMax entries */
+json_spirit::Array RPCListAll(rpclistfn_type actor, const json_spirit::Array& params,
+                              size_t nMax = std::numeric_limits<size_t>::max());
+/** One page of a list call, given the cursor and the limit parameters: {"entries":[...],"cursor":"..."} */
+json_spirit::Object RPCListPage(rpclistfn_type actor, const json_spirit::Array& params,
+                                const json_spirit::Value& cursor, const json_spirit::Value& limit);
+
+/** Cursors are opaque to the client: the serialized position in hex */
+template<typename T>
+std::string EncodeRPCCursor(const T& pos)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << pos;
+    return HexStr(ss.begin(), ss.end());
+}
+
+template<typename T>
+void DecodeRPCCursor(const std::string& strCursor, T& pos)
+{
+    std::vector<unsigned char> vch(ParseHex(strCursor));
+    CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ss >> pos;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!ss.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+}
+
 /**
  * Gcoin RPC command dispatcher.
  */
@@ -112,9 +170,12 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, const CRPCListCommand*> mapListCommands;
 public:
     CRPCTable();
     const CRPCCommand* operator[](std::string name) const;
+    //! The pages of a list call, NULL if it is not one
+    const CRPCListCommand* listCommand(const std::string& name) const;
     std::string help(std::string name) const;
 
     /**
@@ -171,7 +232,7 @@ extern json_spirit::Value getmemberlist(const json_spirit::Array& params, bool f
 extern json_spirit::Value getrtts(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettotalbandwidth(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmemberlist(const json_spirit::Array& params, bool fHelp);
-extern json_spirit::Value getorderlist(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getorderbook(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHelp); // in rpcdump.cpp
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importaddress(const json_spirit::Array& params, bool fHelp);
@@ -204,6 +265,7 @@ extern json_spirit::Value getunconfirmedbalance(const json_spirit::Array& params
 extern json_spirit::Value movecmd(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendfrom(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendfromfeeaddress(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value sendbatch(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendmany(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value addmultisigaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value createmultisig(const json_spirit::Array& params, bool fHelp);
@@ -211,6 +273,8 @@ extern json_spirit::Value listreceivedbyaddress(const json_spirit::Array& params
 extern json_spirit::Value listreceivedbyaccount(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listtransactions(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listwalletaddress(const json_spirit::Array& params, bool fHelp);
+extern void ListTransactionsPage(const json_spirit::Array& params, std::string& strCursor, unsigned int nLimit, json_spirit::Array& entries);
+extern void ListWalletAddressPage(const json_spirit::Array& params, std::string& strCursor, unsigned int nLimit, json_spirit::Array& entries);
 extern json_spirit::Value listonewalletaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listaddressgroupings(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listaccounts(const json_spirit::Array& params, bool fHelp);
@@ -234,6 +298,7 @@ extern json_spirit::Value resendwallettransactions(const json_spirit::Array& par
 extern json_spirit::Value hdaddchain(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value hdsetchain(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value hdgetinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value hdgennewaddress(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getnewaddressamount(const json_spirit::Array& params, bool fHelp); // in rpcwallet.cpp
 extern json_spirit::Value gennewaddress(const json_spirit::Array& params, bool fHelp);
@@ -256,9 +321,11 @@ extern json_spirit::Value getlicenseinfo(const json_spirit::Array& params, bool
 extern json_spirit::Value sendorder(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value cancelorder(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value match(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value matchorders(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getrawtransaction(const json_spirit::Array& params, bool fHelp); // in rcprawtransaction.cpp
 extern json_spirit::Value listunspent(const json_spirit::Array& params, bool fHelp);
+extern void ListUnspentPage(const json_spirit::Array& params, std::string& strCursor, unsigned int nLimit, json_spirit::Array& entries);
 extern json_spirit::Value lockunspent(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value listlockunspent(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value createrawtransaction(const json_spirit::Array& params, bool fHelp);
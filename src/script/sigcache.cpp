@@ -5,13 +5,16 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
+#include "primitives/block.h"
 #include "pubkey.h"
 #include "random.h"
+#include "script/standard.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
 
 namespace {
 
@@ -19,65 +22,183 @@ namespace {
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * An entry is the salted hash of the signature hash, signature and public key.
+ * The entries live in a table of fixed size, in buckets of one cache line, and
+ * each entry may go to either of two buckets picked by its hash. They are read
+ * and written as atomic words without taking any lock. An entry torn by two
+ * threads writing it at once is only a mix of the hashes of valid signatures,
+ * which no other signature can be made to hash to without knowing the salt.
+ *
+ * Every insertion is tagged with the generation it happened in, a generation
+ * lasting for a quarter of the table worth of insertions. An entry of the
+ * oldest generation makes room for a new one when both its buckets are full.
  */
 class CSignatureCache
 {
+public:
+    static const unsigned int WORDS = 4;
+    /** Bytes taken by one entry */
+    static const size_t ENTRY_SIZE = WORDS * sizeof(uint64_t);
+
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    static const unsigned int BUCKET_ENTRIES = 2;
+    static const size_t CACHE_LINE = 64;
+
+    struct CBucket
+    {
+        boost::atomic<uint64_t> words[BUCKET_ENTRIES][WORDS];
+    };
+
+    uint256 nonce;
+    boost::scoped_array<char> storage;
+    CBucket *buckets;
+    size_t nBucketMask;
+    boost::scoped_array<boost::atomic<uint32_t> > generations;
+    uint64_t nGenerationSize;
+    boost::atomic<uint64_t> nInserted;
+
+    void ComputeEntry(uint64_t entry[WORDS], const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
+    {
+        unsigned char digest[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&vchSig[0], vchSig.size()).Write(pubKey.begin(), pubKey.size()).Finalize(digest);
+        memcpy(entry, digest, sizeof(digest));
+    }
+
+    size_t GetBucket(const uint64_t entry[WORDS], unsigned int nWay) const
+    {
+        return entry[nWay] & nBucketMask;
+    }
+
+    bool IsEntry(const CBucket &bucket, unsigned int nSlot, const uint64_t entry[WORDS]) const
+    {
+        for (unsigned int i = 0; i < WORDS; i++) {
+            if (bucket.words[nSlot][i].load(boost::memory_order_relaxed) != entry[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool Contains(const uint64_t entry[WORDS]) const
+    {
+        for (unsigned int nWay = 0; nWay < 2; nWay++) {
+            const CBucket &bucket = buckets[GetBucket(entry, nWay)];
+            for (unsigned int nSlot = 0; nSlot < BUCKET_ENTRIES; nSlot++) {
+                if (IsEntry(bucket, nSlot, entry))
+                    return true;
+            }
+        }
+        return false;
+    }
 
 public:
+    CSignatureCache() : buckets(NULL), nBucketMask(0), nGenerationSize(1), nInserted(0) {}
+
+    /** Allocate the table, the largest power of two of buckets fitting in nBytes. Return its size in bytes. */
+    size_t Setup(size_t nBytes)
+    {
+        size_t nBuckets = 0;
+        if (nBytes >= sizeof(CBucket)) {
+            nBuckets = 1;
+            while (nBuckets * 2 <= nBytes / sizeof(CBucket))
+                nBuckets *= 2;
+        }
+        buckets = NULL;
+        storage.reset();
+        generations.reset();
+        if (nBuckets == 0)
+            return 0;
+
+        GetRandBytes(nonce.begin(), 32);
+        storage.reset(new char[nBuckets * sizeof(CBucket) + CACHE_LINE]);
+        buckets = reinterpret_cast<CBucket*>((reinterpret_cast<uintptr_t>(storage.get()) + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+        generations.reset(new boost::atomic<uint32_t>[nBuckets * BUCKET_ENTRIES]);
+        for (size_t i = 0; i < nBuckets; i++) {
+            new (&buckets[i]) CBucket();
+            for (unsigned int nSlot = 0; nSlot < BUCKET_ENTRIES; nSlot++) {
+                for (unsigned int j = 0; j < WORDS; j++)
+                    buckets[i].words[nSlot][j].store(0, boost::memory_order_relaxed);
+                generations[i * BUCKET_ENTRIES + nSlot].store(0, boost::memory_order_relaxed);
+            }
+        }
+        nBucketMask = nBuckets - 1;
+        nGenerationSize = std::max((uint64_t)1, (uint64_t)nBuckets * BUCKET_ENTRIES / 4);
+        nInserted.store(0);
+        return nBuckets * sizeof(CBucket);
+    }
+
     bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        if (buckets == NULL || vchSig.empty())
+            return false;
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+        uint64_t entry[WORDS];
+        ComputeEntry(entry, hash, vchSig, pubKey);
+        return Contains(entry);
     }
 
     void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+        if (buckets == NULL || vchSig.empty())
+            return;
+
+        uint64_t entry[WORDS];
+        ComputeEntry(entry, hash, vchSig, pubKey);
+        if (Contains(entry))
+            return;
+
+        // Generations start at 1, a slot of generation 0 is empty
+        uint32_t nGeneration = 1 + nInserted.fetch_add(1, boost::memory_order_relaxed) / nGenerationSize;
+
+        // Take an empty slot of the two buckets, or else the oldest one
+        size_t nVictim = 0;
+        uint32_t nVictimAge = 0;
+        for (unsigned int nWay = 0; nWay < 2; nWay++) {
+            size_t nBucket = GetBucket(entry, nWay);
+            for (unsigned int nSlot = 0; nSlot < BUCKET_ENTRIES; nSlot++) {
+                size_t nPos = nBucket * BUCKET_ENTRIES + nSlot;
+                uint32_t nSlotGeneration = generations[nPos].load(boost::memory_order_relaxed);
+                uint32_t nAge = (nSlotGeneration == 0 ? std::numeric_limits<uint32_t>::max() : nGeneration - nSlotGeneration);
+                if (nWay + nSlot == 0 || nAge > nVictimAge) {
+                    nVictim = nPos;
+                    nVictimAge = nAge;
+                }
+            }
         }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+        CBucket &bucket = buckets[nVictim / BUCKET_ENTRIES];
+        for (unsigned int i = 0; i < WORDS; i++)
+            bucket.words[nVictim % BUCKET_ENTRIES][i].store(entry[i], boost::memory_order_relaxed);
+        generations[nVictim].store(nGeneration, boost::memory_order_relaxed);
     }
 };
 
+CSignatureCache signatureCache;
+
+/** Header signatures of blocks not validated yet, checked ahead of their processing */
+CSignatureCache preverifiedHeaderCache;
+
 }
 
-bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+size_t InitSignatureCache()
 {
-    static CSignatureCache signatureCache;
+    int64_t nMaxCacheSize = GetArg("-maxsigcachemb", DEFAULT_MAX_SIG_CACHE_SIZE);
+    if (!mapArgs.count("-maxsigcachemb") && mapArgs.count("-maxsigcachesize")) {
+        // The deprecated -maxsigcachesize counts entries, convert it rather than take it for MiB
+        int64_t nEntries = std::max((int64_t)0, std::min(GetArg("-maxsigcachesize", 0), MAX_MAX_SIG_CACHE_SIZE << 20));
+        nMaxCacheSize = (nEntries * CSignatureCache::ENTRY_SIZE + (1 << 20) - 1) >> 20;
+        LogPrintf("-maxsigcachesize is deprecated, %d entries taken as -maxsigcachemb=%d\n", nEntries, nMaxCacheSize);
+    }
+    nMaxCacheSize = std::max((int64_t)0, std::min(nMaxCacheSize, MAX_MAX_SIG_CACHE_SIZE));
+    size_t nBytes = signatureCache.Setup(nMaxCacheSize * ((size_t)1 << 20));
+    preverifiedHeaderCache.Setup(nBytes == 0 ? 0 : PREVERIFIED_HEADER_CACHE_SIZE << 10);
+    LogPrintf("Using %u KiB out of %u MiB requested for signature cache\n", (unsigned int)(nBytes >> 10), (unsigned int)nMaxCacheSize);
+    return nBytes;
+}
 
+bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
 
@@ -88,3 +209,22 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(sighash, vchSig, pubkey);
     return true;
 }
+
+bool CachingBlockHeaderSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    if (signatureCache.Get(sighash, vchSig, pubkey))
+        return true;
+
+    if (preverifiedHeaderCache.Get(sighash, vchSig, pubkey)) {
+        if (store && !fPreverify)
+            signatureCache.Set(sighash, vchSig, pubkey);
+        return true;
+    }
+
+    if (!VerifyUncachedSignature(vchSig, pubkey, sighash))
+        return false;
+
+    if (store)
+        (fPreverify ? preverifiedHeaderCache : signatureCache).Set(sighash, vchSig, pubkey);
+    return true;
+}
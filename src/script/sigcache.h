@@ -10,6 +10,13 @@
 
 #include <vector>
 
+/** Default size of the signature cache in MiB, room for a million entries */
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Maximum size of the signature cache in MiB */
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+/** Size of the cache of preverified block header signatures in KiB, room for eight thousand entries */
+static const size_t PREVERIFIED_HEADER_CACHE_SIZE = 256;
+
 class CPubKey;
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
@@ -23,4 +30,39 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * Block header signature checker sharing the signature cache, whose entries
+ * cover the header's sighash and so the block hash and the miner's key.
+ *
+ * The headers of blocks which are not validated yet are checked with fPreverify
+ * set. Their valid signatures go to a small cache of their own rather than to
+ * the signature cache, so that a peer sending made up blocks only pushes out
+ * other preverified headers. A signature found there is moved to the signature
+ * cache by the check of the block once it passed the header checks.
+ */
+class CachingBlockHeaderSignatureChecker : public BlockHeaderSignatureChecker
+{
+private:
+    bool store;
+    bool fPreverify;
+
+protected:
+    //! The ECDSA check a cached signature saves
+    virtual bool VerifyUncachedSignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const
+    {
+        return BlockHeaderSignatureChecker::VerifySignature(vchSig, vchPubKey, sighash);
+    }
+
+public:
+    CachingBlockHeaderSignatureChecker(const CBlock* blockIn, bool storeIn=true, bool fPreverifyIn=false) : BlockHeaderSignatureChecker(blockIn), store(storeIn), fPreverify(fPreverifyIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
+/**
+ * Size the signature cache from -maxsigcachemb, or from the deprecated entry count of
+ * -maxsigcachesize. The cache stays off until this is called. Return its size in bytes.
+ */
+size_t InitSignatureCache();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
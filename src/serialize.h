@@ -714,7 +714,7 @@ template<typename T, typename A>
 inline unsigned int GetSerializeSize(const std::list<T, A>& l, int nType, int nVersion)
 {
     unsigned int nSize = GetSizeOfCompactSize(l.size());
-    for (typename std::vector<T, A>::const_iterator li = l.begin(); li != l.end(); ++li)
+    for (typename std::list<T, A>::const_iterator li = l.begin(); li != l.end(); ++li)
         nSize += GetSerializeSize((*li), nType, nVersion);
     return nSize;
 }
@@ -0,0 +1,105 @@
+// Copyright (c) 2014-2016 The Gcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "clientversion.h"
+#include "key.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/standard.h"
+#include "undo.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+static CScript RandomScript()
+{
+    uint256 hash = GetRandHash();
+    return GetScriptForDestination(CKeyID(uint160(vector<unsigned char>(hash.begin(), hash.begin() + 20))));
+}
+
+static vector<unsigned char> ScriptBytes(const CScript& script)
+{
+    return vector<unsigned char>(script.begin(), script.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_match)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    CScript scriptSpent = RandomScript();
+    CScript scriptPaid = RandomScript();
+
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.push_back(CTxOut(COIN, scriptPaid, 1));
+    tx.vout.push_back(CTxOut(COIN, CScript() << ToByteVector(pubkey) << OP_CHECKSIG, 1));
+    block.vtx.push_back(tx);
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(COIN, scriptSpent, 1)));
+
+    CBloomFilter filter = BuildBlockFilter(block, blockundo);
+    vector<vector<unsigned char> > vScripts;
+    vScripts.push_back(ScriptBytes(RandomScript()));
+    BOOST_CHECK(!BlockFilterMatchAny(filter, vScripts));
+
+    // Outputs paid, outputs spent, and the key hash of a pay-to-pubkey output match.
+    vScripts[0] = ScriptBytes(scriptPaid);
+    BOOST_CHECK(BlockFilterMatchAny(filter, vScripts));
+    vScripts[0] = ScriptBytes(scriptSpent);
+    BOOST_CHECK(BlockFilterMatchAny(filter, vScripts));
+    vScripts[0] = ScriptBytes(GetScriptForDestination(pubkey.GetID()));
+    BOOST_CHECK(BlockFilterMatchAny(filter, vScripts));
+
+    // A filter read back from disk matches the same.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << filter;
+    CBloomFilter filterRead;
+    ss >> filterRead;
+    filterRead.UpdateEmptyFull();
+    BOOST_CHECK(BlockFilterMatchAny(filterRead, vScripts));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_false_positives)
+{
+    // A wallet of 100 scripts falsely matches a block with a chance of about
+    // 100 * BLOCK_FILTER_FP_RATE, so 0.5 of the 500 blocks are expected to.
+    // More than 5 of them is out of the bound by far.
+    const int nBlocks = 500, nTx = 20;
+    vector<vector<unsigned char> > vWallet;
+    for (int i = 0; i < 100; i++)
+        vWallet.push_back(ScriptBytes(RandomScript()));
+
+    int nMatch = 0;
+    for (int n = 0; n < nBlocks; n++) {
+        CBlock block;
+        CBlockUndo blockundo;
+        blockundo.vtxundo.resize(nTx);
+        for (int i = 0; i < nTx; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            tx.vout.push_back(CTxOut(COIN, RandomScript(), 1));
+            tx.vout.push_back(CTxOut(COIN, RandomScript(), 1));
+            block.vtx.push_back(tx);
+            blockundo.vtxundo[i].vprevout.push_back(CTxInUndo(CTxOut(COIN, RandomScript(), 1)));
+        }
+        if (BlockFilterMatchAny(BuildBlockFilter(block, blockundo), vWallet))
+            nMatch++;
+    }
+    BOOST_CHECK_LE(nMatch, 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+// Copyright (c) 2014-2016 The Gcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdint.h>
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "test_bitcoin.h"
+#include "random.h"
+#include "txdb.h"
+
+
+struct CacheOrderFixture : public CacheSetupFixture, public BasicTestingSetup
+{
+};
+
+BOOST_AUTO_TEST_SUITE(test_cache_order)
+
+BOOST_FIXTURE_TEST_CASE(CacheOrderBookPriceOrder, CacheOrderFixture)
+{
+    TxInfo order1 = CreateOrder(1, 10, 5, 30, 3);
+    TxInfo order2 = CreateOrder(2, 10, 5, 20, 3);
+    TxInfo order3 = CreateOrder(3, 20, 5, 40, 3);
+    TxInfo bid = CreateOrder(4, 20, 3, 10, 5);
+    porder->AddOrder(order1);
+    porder->AddOrder(order2);
+    porder->AddOrder(order3);
+    porder->AddOrder(bid);
+
+    order_list::order_info_ best;
+    BOOST_CHECK(porder->GetBest(5, 3, best));
+    BOOST_CHECK(best.hash == order2.GetTxHash());
+    BOOST_CHECK(porder->GetBest(3, 5, best));
+    BOOST_CHECK(best.hash == bid.GetTxHash());
+    BOOST_CHECK(!porder->GetBest(5, 4, best));
+
+    // Same price keeps the older order first.
+    std::vector<order_list::order_info_> book = porder->GetBook(5, 3, 10);
+    BOOST_CHECK(book.size() == 3);
+    BOOST_CHECK(book[0].hash == order2.GetTxHash());
+    BOOST_CHECK(book[1].hash == order3.GetTxHash());
+    BOOST_CHECK(book[2].hash == order1.GetTxHash());
+    BOOST_CHECK(porder->GetBook(5, 3, 2).size() == 2);
+
+    BOOST_CHECK(porder->IsExist(order1));
+    BOOST_CHECK(!porder->IsExist(CreateOrder(1, 10, 5, 31, 3)));
+    porder->Remove(order2);
+    BOOST_CHECK(!porder->IsExist(order2));
+    BOOST_CHECK(porder->IsExist(order3));
+    BOOST_CHECK(porder->GetBest(5, 3, best));
+    BOOST_CHECK(best.hash == order3.GetTxHash());
+
+    porder->Remove(bid);
+    BOOST_CHECK(!porder->GetBest(3, 5, best));
+    porder->RemoveAll();
+}
+
+BOOST_FIXTURE_TEST_CASE(CacheOrderBookDatabase, TestingSetup)
+{
+    TxInfo order1 = CreateOrder(1, 10, 5, 30, 3);
+    TxInfo order2 = CreateOrder(2, 10, 5, 20, 3);
+    porder->AddOrder(order1);
+    porder->AddOrder(order2);
+
+    CCacheDB db(1 << 20, true);
+    size_t nBytes;
+    BOOST_CHECK(WriteCacheState(db, 1, GetRandHash(), nBytes));
+    porder->RemoveAll();
+    int height;
+    uint256 hashBlock;
+    BOOST_CHECK(ReadCacheState(db, height, hashBlock));
+    BOOST_CHECK(porder->IsExist(order1));
+    BOOST_CHECK(porder->IsExist(order2));
+    BOOST_CHECK(porder->GetBook(5, 3, 10)[0].hash == order2.GetTxHash());
+    porder->RemoveAll();
+}
+
+static std::set<uint256> setExcluded;
+
+static bool IsExcluded(const uint256 &hash)
+{
+    return setExcluded.count(hash) > 0;
+}
+
+BOOST_FIXTURE_TEST_CASE(CacheOrderFindMatches, CacheOrderFixture)
+{
+    TxInfo ask1 = CreateOrder(1, 10, 5, 20, 3);
+    TxInfo ask2 = CreateOrder(2, 10, 5, 30, 3);
+    TxInfo bid1 = CreateOrder(3, 30, 3, 10, 5);
+    TxInfo bid2 = CreateOrder(4, 20, 3, 10, 5);
+    TxInfo bid3 = CreateOrder(5, 100, 3, 50, 5);
+    porder->AddOrder(ask1);
+    porder->AddOrder(ask2);
+    porder->AddOrder(bid1);
+    porder->AddOrder(bid2);
+    porder->AddOrder(bid3);
+
+    // The cheapest ask takes the best bid, the other ask crosses no bid left.
+    setExcluded.clear();
+    std::vector<std::pair<uint256, uint256> > matches = porder->FindMatches(5, 3, IsExcluded, 10);
+    BOOST_CHECK(matches.size() == 1);
+    BOOST_CHECK(matches[0].first == ask1.GetTxHash() && matches[0].second == bid1.GetTxHash());
+
+    // From the other side the best bid takes the best ask, the bid which is too large crosses none.
+    matches = porder->FindMatches(3, 5, NULL, 10);
+    BOOST_CHECK(matches.size() == 1);
+    BOOST_CHECK(matches[0].first == bid1.GetTxHash() && matches[0].second == ask1.GetTxHash());
+
+    setExcluded.insert(bid1.GetTxHash());
+    matches = porder->FindMatches(5, 3, IsExcluded, 10);
+    BOOST_CHECK(matches.size() == 1);
+    BOOST_CHECK(matches[0].first == ask1.GetTxHash() && matches[0].second == bid2.GetTxHash());
+    BOOST_CHECK(porder->FindMatches(5, 3, IsExcluded, 0).empty());
+    BOOST_CHECK(porder->FindMatches(5, 4, IsExcluded, 10).empty());
+    porder->RemoveAll();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,143 @@
+// Copyright (c) 2014-2016 The Gcoin Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "test_bitcoin.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "main.h"
+#include "random.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+
+BOOST_FIXTURE_TEST_SUITE(test_cache_snapshot, TestingSetup)
+
+// Append the checksum and write the content as the file, as the older versions wrote their cache files.
+static void WriteCacheFile(const std::string &strFile, CDataStream &ss)
+{
+    uint256 hash = Hash(ss.begin(), ss.end());
+    ss << hash;
+    boost::filesystem::path pathFile = GetDataDir() / strFile;
+    FILE *file = fopen(pathFile.string().c_str(), "wb");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_REQUIRE(fwrite(&ss[0], 1, ss.size(), file) == ss.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(CacheLegacyFileMigration)
+{
+    // Write activate.dat in the string keyed layout of the older versions.
+    std::string addr = CreateAddress();
+    std::map<type_Color, std::map<std::string, int64_t> > table;
+    table[5][addr] = 2;
+    table[6];
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << FLATDATA(Params().MessageStart());
+    ss << 9;
+    ss << table;
+    WriteCacheFile("activate.dat", ss);
+
+    BOOST_CHECK(pactivate->ReadDisk());
+    BOOST_CHECK(pactivate->BackupHeight() == 9);
+    BOOST_CHECK(pactivate->IsActivated(5, addr));
+    BOOST_CHECK(pactivate->IsColorExist(6));
+    BOOST_CHECK(!pactivate->Deactivate(5, addr));
+    BOOST_CHECK(pactivate->Deactivate(5, addr));
+
+    ClearAllCaches();
+}
+
+BOOST_AUTO_TEST_CASE(CacheStateDelta)
+{
+    CCacheDB db(1 << 20, true);
+    std::vector<std::string> members;
+    for (int i = 0; i < 50; i++) {
+        members.push_back(CreateAddress());
+        palliance->Add(members.back());
+    }
+    type_Color color = 5;
+    plicense->SetOwner(color, members[0]);
+    pactivate->Activate(color, members[1]);
+    for (int i = 0; i < 100; i++)
+        pminer->Add(members[i % 50]);
+    for (int i = 0; i < 20; i++) {
+        std::map<std::string, bool> voting;
+        voting[members[i + 20]] = false;
+        VoteList[members[i]].push_back(voting);
+        VoteListChanged.insert(members[i]);
+        BanVoteList[members[i + 20]].push_back(voting);
+        BanVoteListChanged.insert(members[i + 20]);
+    }
+
+    size_t nFull;
+    BOOST_CHECK(WriteCacheState(db, 7, GetRandHash(), nFull));
+
+    // Only the changed entries are written the next time.
+    palliance->Remove(members[2]);
+    pactivate->Activate(color, members[3]);
+    pminer->Remove();
+    pminer->Add(members[3]);
+    pminer->Add(members[4]);
+    VoteList[members[6]].back()[members[26]] = true;
+    VoteListChanged.insert(members[6]);
+    BanVoteList.erase(members[27]);
+    BanVoteListChanged.insert(members[27]);
+    uint256 hashBlock = GetRandHash();
+    size_t nDelta;
+    BOOST_CHECK(WriteCacheState(db, 8, hashBlock, nDelta));
+    BOOST_CHECK(nDelta < nFull);
+
+    // Changes queued in a batch which is never written are queued again.
+    palliance->Remove(members[4]);
+    CLevelDBBatch batchLost;
+    BOOST_CHECK(palliance->WriteChanges(db, batchLost));
+    BOOST_CHECK(WriteCacheState(db, 8, hashBlock, nDelta));
+
+    std::list<std::pair<std::string, unsigned int> > miners(pminer->IteratorBegin(), pminer->IteratorEnd());
+    std::map<std::string, std::vector<std::map<std::string, bool> > > votes = VoteList, banVotes = BanVoteList;
+    ClearAllCaches();
+    int height;
+    uint256 hashRead;
+    BOOST_CHECK(ReadCacheState(db, height, hashRead));
+    BOOST_CHECK(height == 8);
+    BOOST_CHECK(hashRead == hashBlock);
+    BOOST_CHECK(palliance->NumOfMembers() == 48);
+    BOOST_CHECK(!palliance->IsMember(members[2]));
+    BOOST_CHECK(!palliance->IsMember(members[4]));
+    BOOST_CHECK(palliance->IsMember(members[49]));
+    BOOST_CHECK(plicense->GetOwner(color) == members[0]);
+    BOOST_CHECK(pactivate->IsActivated(color, members[1]));
+    BOOST_CHECK(pactivate->IsActivated(color, members[3]));
+    BOOST_CHECK((std::list<std::pair<std::string, unsigned int> >(pminer->IteratorBegin(), pminer->IteratorEnd()) == miners));
+    BOOST_CHECK(pminer->IteratorBegin()->first == members[4]);
+    BOOST_CHECK(VoteList == votes);
+    BOOST_CHECK(VoteList[members[6]].back()[members[26]]);
+    BOOST_CHECK(BanVoteList == banVotes);
+    BOOST_CHECK(!BanVoteList.count(members[27]));
+    BOOST_CHECK(palliance->BackupHeight() == 8);
+
+    // Removing every entry is written as well.
+    ClearAllCaches();
+    BOOST_CHECK(WriteCacheState(db, 9, hashBlock, nDelta));
+    palliance->Add(members[0]);
+    BOOST_CHECK(ReadCacheState(db, height, hashRead));
+    BOOST_CHECK(palliance->NumOfMembers() == 0);
+    BOOST_CHECK(!pactivate->IsColorExist(color));
+    BOOST_CHECK(pminer->IteratorBegin() == pminer->IteratorEnd());
+    BOOST_CHECK(VoteList.empty() && BanVoteList.empty());
+    ClearAllCaches();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,10 +3,25 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "keystore.h"
 #include "main.h"
+#include "policy/licenseinfo.h"
+#include "pow.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "utiltime.h"
+#include "txdb.h"
+#include "undo.h"
 
 #include "test/test_bitcoin.h"
 
+#include <set>
+
+#include <boost/foreach.hpp>
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -73,4 +88,588 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     BOOST_CHECK(Test());
 }
 
+BOOST_AUTO_TEST_CASE(tx_outputs_index)
+{
+    CMutableTransaction tx;
+    tx.type = ORDER;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = GetRandHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 5 * COIN;
+    tx.vout[0].color = 3;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 7 * COIN;
+    tx.vout[1].color = 4;
+    tx.vout[1].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CTransaction txIn(tx);
+
+    CDiskTxPos pos(CDiskBlockPos(1, 100), 20);
+    std::vector<std::pair<uint256, CDiskTxOutputs> > vOutputs;
+    vOutputs.push_back(std::make_pair(txIn.GetHash(), CDiskTxOutputs(pos, txIn)));
+    BOOST_CHECK(pblocktree->WriteTxOutputs(vOutputs));
+
+    CDiskTxOutputs outputs;
+    BOOST_CHECK(!pblocktree->ReadTxOutputs(tx.vin[0].prevout.hash, outputs));
+    BOOST_CHECK(pblocktree->ReadTxOutputs(txIn.GetHash(), outputs));
+    BOOST_CHECK(outputs.pos.nFile == 1 && outputs.pos.nPos == 100 && outputs.pos.nTxOffset == 20);
+    BOOST_CHECK(outputs.type == ORDER);
+    BOOST_REQUIRE(outputs.vout.size() == 2);
+    BOOST_CHECK(outputs.vout[1].color == 4 && outputs.vout[1].nValue == 7 * COIN);
+    BOOST_CHECK(outputs.vout[1].address == CAddressKey(txIn.vout[1].scriptPubKey));
+
+    // Only the color, value and address are kept, the outputs are rebuilt with standard scripts
+    std::vector<CTxOut> vout;
+    outputs.GetTxOuts(vout);
+    BOOST_CHECK(vout == txIn.vout);
+
+    // Disconnecting the block erases the record
+    BOOST_CHECK(pblocktree->EraseTxOutputs(std::vector<uint256>(1, txIn.GetHash())));
+    BOOST_CHECK(!pblocktree->ReadTxOutputs(txIn.GetHash(), outputs));
+
+    // GetTransaction reads a transaction of a block outside the active chain, which the
+    // scan of the chain cannot find, from the position the record has
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.push_back(CTxOut(0, tx.vout[0].scriptPubKey, DEFAULT_ADMIN_COLOR));
+    block.vtx.push_back(CTransaction(coinbase));
+    block.vtx.push_back(txIn);
+    CDiskBlockPos posBlock(1000, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, posBlock, Params().MessageStart()));
+    CDiskTxPos posTx(posBlock, GetSizeOfCompactSize(block.vtx.size()) + ::GetSerializeSize(block.vtx[0], SER_DISK, CLIENT_VERSION));
+    vOutputs.clear();
+    vOutputs.push_back(std::make_pair(txIn.GetHash(), CDiskTxOutputs(posTx, txIn)));
+
+    bool (*GetTransactionOld)(const uint256&, CTransaction&, uint256&, const CBlock*, bool) = AlternateFunc_GetTransaction;
+    AlternateFunc_GetTransaction = NULL;
+    CTransaction txOut;
+    uint256 hashBlock;
+    BOOST_CHECK(!GetTransaction(txIn.GetHash(), txOut, hashBlock, NULL, true));
+    BOOST_CHECK(pblocktree->WriteTxOutputs(vOutputs));
+    BOOST_CHECK(GetTransaction(txIn.GetHash(), txOut, hashBlock, NULL, true));
+    BOOST_CHECK(txOut.GetHash() == txIn.GetHash());
+    BOOST_CHECK(hashBlock == block.GetHash());
+    BOOST_CHECK(pblocktree->EraseTxOutputs(std::vector<uint256>(1, txIn.GetHash())));
+    AlternateFunc_GetTransaction = GetTransactionOld;
+}
+
+/** Remove the blocks a test indexed, from pindex down to pindexStop */
+static void EraseBlockIndex(CBlockIndex *pindex, const CBlockIndex *pindexStop)
+{
+    while (pindex != pindexStop) {
+        CBlockIndex *pindexPrev = pindex->pprev;
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+        pindex = pindexPrev;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_index_miner)
+{
+    CKey keyA, keyB;
+    keyA.MakeNewKey(true);
+    keyB.MakeNewKey(true);
+    std::vector<CPubKey> vKeys;
+    vKeys.push_back(keyB.GetPubKey());
+    vKeys.push_back(keyA.GetPubKey());
+    CScript scriptA = GetScriptForDestination(keyA.GetPubKey().GetID());
+    CScript scripts[] = {
+        scriptA,
+        GetScriptForDestination(keyB.GetPubKey().GetID()),
+        CScript() << ToByteVector(keyA.GetPubKey()) << OP_CHECKSIG,
+        scriptA,
+        GetScriptForDestination(CScriptID(scriptA)),
+        GetScriptForMultisig(1, vKeys),
+        scriptA,
+        CScript() << OP_RETURN,
+    };
+    const int nBlocks = sizeof(scripts) / sizeof(scripts[0]);
+
+    // A chain of blocks on disk, indexed without their miner as before it was recorded
+    std::vector<CBlock> vBlocks(nBlocks);
+    CBlockIndex *pindexPrev = NULL;
+    CDiskBlockPos pos(1000, 0);
+    for (int i = 0; i < nBlocks; i++) {
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vout.push_back(CTxOut(0, scripts[i], DEFAULT_ADMIN_COLOR));
+        vBlocks[i].vtx.push_back(CTransaction(coinbase));
+        vBlocks[i].hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : uint256();
+        vBlocks[i].nNonce = i;
+        BOOST_CHECK(WriteBlockToDisk(vBlocks[i], pos, Params().MessageStart()));
+
+        CBlockIndex *pindex = new CBlockIndex(vBlocks[i]);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(vBlocks[i].GetHash(), pindex)).first;
+        pindex->phashBlock = &((*mi).first);
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = i;
+        pindex->nTx = 1;
+        pindex->nFile = pos.nFile;
+        pindex->nDataPos = pos.nPos;
+        pindex->nStatus = BLOCK_HAVE_DATA;
+        pindexPrev = pindex;
+        pos.nPos += ::GetSerializeSize(vBlocks[i], SER_DISK, CLIENT_VERSION);
+    }
+
+    // The count of the same miner by key id matches the one by address of the blocks,
+    // first read from disk and then from the miners kept in the index: for the second
+    // pass the blocks point to a file that does not exist, so no block is read again
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (int i = 0; i < nBlocks; i++) {
+            CBlock block = vBlocks[i];
+            block.hashPrevBlock = pindexPrev->GetBlockHash();
+            for (unsigned int nAlliance = 1; nAlliance <= (unsigned int)nBlocks + 1; nAlliance++) {
+                unsigned int nExpected = 0;
+                const CBlockIndex *pindex = pindexPrev;
+                for (unsigned int j = 0; pindex && j < Params().DynamicMiner() && j < nAlliance - 1; j++) {
+                    if (GetTxOutputAddr(block.vtx[0], 0) == GetTxOutputAddr(vBlocks[pindex->nHeight].vtx[0], 0))
+                        nExpected++;
+                    pindex = pindex->pprev;
+                }
+                BOOST_CHECK_EQUAL(NumOfMined(block, nAlliance), nExpected);
+            }
+        }
+        for (CBlockIndex *pindex = pindexPrev; pindex; pindex = pindex->pprev) {
+            BOOST_CHECK_EQUAL(pindex->nHeight < nBlocks - (int)Params().DynamicMiner(), !(pindex->nStatus & BLOCK_HAVE_MINER));
+            pindex->nFile = pos.nFile + 1;
+        }
+    }
+
+    // The key is stored at the end of the index record
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(pindexPrev);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.nStatus & BLOCK_HAVE_MINER);
+    BOOST_CHECK(diskindex.minerKeyId == pindexPrev->minerKeyId);
+    BOOST_CHECK(diskindex.GetBlockHash() == pindexPrev->GetBlockHash());
+
+    // A record written again by an older version keeps the status bit without the key
+    CBlockIndex indexOld(*pindexPrev);
+    indexOld.nStatus &= ~BLOCK_HAVE_MINER;
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+    ssOld << CDiskBlockIndex(&indexOld);
+    ss.clear();
+    ss << CDiskBlockIndex(pindexPrev);
+    BOOST_CHECK_EQUAL(ss.size(), ssOld.size() + 20);
+    ss.resize(ssOld.size());
+    ss >> diskindex;
+    BOOST_CHECK(!(diskindex.nStatus & BLOCK_HAVE_MINER));
+    BOOST_CHECK(diskindex.minerKeyId.IsNull());
+    BOOST_CHECK(diskindex.GetBlockHash() == pindexPrev->GetBlockHash());
+
+    EraseBlockIndex(pindexPrev, NULL);
+}
+
+/** Write the undo data of a block in the layout ConnectBlock writes it in */
+static void WriteBlockUndo(const CBlockUndo &blockundo, const CGcoinBlockUndo &gcoinundo, CDiskBlockPos &pos, const uint256 &hashPrev)
+{
+    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    unsigned int nSize = fileout.GetSerializeSize(blockundo);
+    fileout << FLATDATA(Params().MessageStart()) << nSize;
+    pos.nPos = (unsigned int)ftell(fileout.Get());
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashPrev << blockundo;
+    fileout << blockundo << hasher.GetHash();
+    CHashWriter hasherGcoin(SER_GETHASH, PROTOCOL_VERSION);
+    hasherGcoin << hashPrev << gcoinundo;
+    fileout << gcoinundo << hasherGcoin.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(block_undo_orders)
+{
+    LOCK(cs_main);
+    const type_Color colorSell = 5, colorBuy = 3, colorMember = 7;
+    CScript scriptA = GetScriptForDestination(CreateDestination());
+    CScript scriptB = GetScriptForDestination(CreateDestination());
+    CScript scriptC = GetScriptForDestination(CreateDestination());
+    CScript scriptUser = GetScriptForDestination(CreateDestination());
+    std::string strOwner = CreateAddress();
+    CScript scriptOwner = GetScriptForDestination(CBitcoinAddress(strOwner).Get());
+    CLicenseInfo info;
+    info.fMemberControl = true;
+    plicense->SetOwner(colorMember, strOwner, &info);
+
+    // Orders A and B matching each other, order C, and coins of the owner of a member-only color
+    CMutableTransaction orderA, orderB, orderC, funding;
+    orderA.type = orderB.type = orderC.type = ORDER;
+    orderA.vout.push_back(CTxOut(10, scriptA, colorSell));
+    orderA.vout.push_back(CTxOut(20, scriptA, colorBuy));
+    orderB.vout.push_back(CTxOut(20, scriptB, colorBuy));
+    orderB.vout.push_back(CTxOut(10, scriptB, colorSell));
+    orderC.vout.push_back(CTxOut(10, scriptC, colorSell));
+    orderC.vout.push_back(CTxOut(30, scriptC, colorBuy));
+    funding.type = NORMAL;
+    funding.vout.push_back(CTxOut(COIN, scriptOwner, colorMember));
+    funding.vout.push_back(CTxOut(COIN, scriptOwner, colorMember));
+    const CTransaction vtxPrev[] = {CTransaction(orderA), CTransaction(orderB), CTransaction(orderC), CTransaction(funding)};
+
+    CCoinsViewCache view(pcoinsTip);
+    for (unsigned int i = 0; i < sizeof(vtxPrev) / sizeof(vtxPrev[0]); i++) {
+        transactions[vtxPrev[i].GetHash()] = CMutableTransaction(vtxPrev[i]);
+        view.ModifyCoins(vtxPrev[i].GetHash())->FromTx(vtxPrev[i], 0);
+        if (vtxPrev[i].type == ORDER)
+            BOOST_CHECK(type_transaction_handler::GetHandler(ORDER)->Apply(vtxPrev[i], NULL));
+    }
+    std::vector<order_list::order_info_> vAsks = porder->GetBook(colorSell, colorBuy, 10);
+    std::vector<order_list::order_info_> vBids = porder->GetBook(colorBuy, colorSell, 10);
+    BOOST_CHECK_EQUAL(vAsks.size(), 2U);
+    BOOST_CHECK_EQUAL(vBids.size(), 1U);
+
+    // A block matching A and B, cancelling C and moving the member-only color to a new address
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.push_back(CTxOut(0, scriptOwner, DEFAULT_ADMIN_COLOR));
+    block.vtx.push_back(CTransaction(coinbase));
+    CMutableTransaction match;
+    match.type = MATCH;
+    match.vin.push_back(CTxIn(COutPoint(vtxPrev[0].GetHash(), 0)));
+    match.vin.push_back(CTxIn(COutPoint(vtxPrev[1].GetHash(), 0)));
+    match.vout.push_back(CTxOut(10, scriptB, colorSell));
+    match.vout.push_back(CTxOut(20, scriptA, colorBuy));
+    block.vtx.push_back(CTransaction(match));
+    CMutableTransaction cancel;
+    cancel.type = CANCEL;
+    cancel.vin.push_back(CTxIn(COutPoint(vtxPrev[2].GetHash(), 0)));
+    cancel.vout.push_back(CTxOut(10, scriptC, colorSell));
+    block.vtx.push_back(CTransaction(cancel));
+    CMutableTransaction transfer;
+    transfer.type = NORMAL;
+    transfer.vin.push_back(CTxIn(COutPoint(vtxPrev[3].GetHash(), 0)));
+    transfer.vout.push_back(CTxOut(COIN, scriptUser, colorMember));
+    block.vtx.push_back(CTransaction(transfer));
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+
+    CBlockIndex *pindex = new CBlockIndex(block);
+    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+    pindex->phashBlock = &((*mi).first);
+    pindex->pprev = chainActive.Tip();
+    pindex->nHeight = pindex->pprev->nHeight + 1;
+
+    // Connect it as ConnectBlock and ConnectTip do
+    CValidationState state;
+    CBlockUndo blockundo;
+    CGcoinBlockUndo gcoinundo;
+    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
+        if (tx.IsCoinBase()) {
+            UpdateCoins(tx, state, view, pindex->nHeight);
+        } else {
+            blockundo.vtxundo.push_back(CTxUndo());
+            UpdateCoins(tx, state, view, blockundo.vtxundo.back(), gcoinundo, pindex->nHeight);
+        }
+    }
+    BOOST_CHECK_EQUAL(gcoinundo.mapOrders.size(), 3U);
+    BOOST_CHECK(gcoinundo.mapOrders[vtxPrev[2].GetHash()] == vtxPrev[2].vout);
+    CDiskBlockPos pos(1000, 0);
+    WriteBlockUndo(blockundo, gcoinundo, pos, pindex->pprev->GetBlockHash());
+    pindex->nFile = pos.nFile;
+    pindex->nUndoPos = pos.nPos;
+    pindex->nStatus = BLOCK_HAVE_UNDO | BLOCK_HAVE_GCOIN_UNDO;
+    view.SetBestBlock(block.GetHash());
+
+    pminer->Add(GetTxOutputAddr(block.vtx[0], 0));
+    BOOST_FOREACH(const CTransaction &tx, block.vtx)
+        BOOST_CHECK(type_transaction_handler::GetHandler(tx.type)->Apply(tx, &block));
+    BOOST_CHECK(porder->GetBook(colorSell, colorBuy, 10).empty());
+    BOOST_CHECK(porder->GetBook(colorBuy, colorSell, 10).empty());
+    BOOST_CHECK(pactivate->IsActivated(colorMember, CAddressKey(scriptUser)));
+    BOOST_CHECK_EQUAL(pminer->NumOfMined(strOwner, 10), 1U);
+
+    // Disconnecting it from its undo data alone restores the caches and the coins
+    transactions.clear();
+    BOOST_CHECK(DisconnectBlock(block, state, pindex, view));
+    BOOST_CHECK(porder->GetBook(colorSell, colorBuy, 10) == vAsks);
+    BOOST_CHECK(porder->GetBook(colorBuy, colorSell, 10) == vBids);
+    for (unsigned int i = 0; i < 3; i++)
+        BOOST_CHECK(porder->IsExist(TxInfo(vtxPrev[i])));
+    BOOST_CHECK(!pactivate->IsActivated(colorMember, CAddressKey(scriptUser)));
+    BOOST_CHECK_EQUAL(pminer->NumOfMined(strOwner, 10), 0U);
+    for (unsigned int i = 0; i < sizeof(vtxPrev) / sizeof(vtxPrev[0]); i++)
+        BOOST_CHECK(view.AccessCoins(vtxPrev[i].GetHash())->vout == vtxPrev[i].vout);
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(!view.HaveCoins(block.vtx[i].GetHash()));
+    BOOST_CHECK(view.GetBestBlock() == pindex->pprev->GetBlockHash());
+
+    EraseBlockIndex(pindex, pindex->pprev);
+    ClearAllCaches();
+}
+
+static CBlock CreateBlock(int nTx, int nIn, int nOut)
+{
+    CBlock block;
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.type = NORMAL;
+        tx.vin.resize(nIn);
+        for (int j = 0; j < nIn; j++) {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            tx.vin[j].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+        }
+        tx.vout.resize(nOut);
+        for (int j = 0; j < nOut; j++) {
+            tx.vout[j].nValue = i * nOut + j;
+            tx.vout[j].color = 1;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(CTransaction(tx));
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_block_view)
+{
+    CBlock block = CreateBlock(3, 1, 2);
+
+    // The outputs of a transaction in the block are looked at in place
+    TxInfo txinfo;
+    BOOST_CHECK(txinfo.init(COutPoint(block.vtx[1].GetHash(), 1), &block));
+    BOOST_CHECK(&txinfo.GetTxOuts() == &block.vtx[1].vout);
+    BOOST_CHECK_EQUAL(txinfo.GetTxOutValueOfIndex(1), 3);
+    TxInfo view(txinfo);
+    BOOST_CHECK(&view.GetTxOuts() == &block.vtx[1].vout);
+    BOOST_CHECK(!txinfo.init(COutPoint(GetRandHash(), 0), &block));
+    BOOST_CHECK_EQUAL(txinfo.GetTxOutSize(), 0U);
+
+    // Outputs given by value are held, and copied along
+    TxInfo owner(block.vtx[2].GetHash(), block.vtx[2].vout, ORDER);
+    BOOST_CHECK(&owner.GetTxOuts() != &block.vtx[2].vout);
+    TxInfo copy;
+    copy = owner;
+    BOOST_CHECK(&copy.GetTxOuts() != &owner.GetTxOuts());
+    BOOST_CHECK(copy.GetTxOuts() == block.vtx[2].vout);
+    BOOST_CHECK(copy.GetTxType() == ORDER);
+
+    // A transaction is copied unless a view is asked for
+    TxInfo held(block.vtx[2]);
+    BOOST_CHECK(&held.GetTxOuts() != &block.vtx[2].vout);
+    BOOST_CHECK(held.GetTxOuts() == block.vtx[2].vout);
+    TxInfo viewed = TxInfo::View(block.vtx[2]);
+    BOOST_CHECK(&viewed.GetTxOuts() == &block.vtx[2].vout);
+    BOOST_CHECK(viewed.GetTxHash() == block.vtx[2].GetHash());
+}
+
+/** A block of NORMAL transfers of the color, each spending one of the transactions given to the handlers */
+static CBlock CreateTransferBlock(int nTx, type_Color color)
+{
+    CLicenseInfo info;
+    plicense->SetOwner(color, CreateAddress(), &info);
+
+    CScript scripts[4];
+    for (int i = 0; i < 4; i++)
+        scripts[i] = GetScriptForDestination(CreateDestination());
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.push_back(CTxOut(0, scripts[0], DEFAULT_ADMIN_COLOR));
+    block.vtx.push_back(CTransaction(coinbase));
+    for (int i = 0; i < nTx; i++) {
+        uint256 hash = ArithToUint256(arith_uint256(i + 1));
+        CreateTransaction(hash, NORMAL);
+        transactions[hash].vout.push_back(CTxOut(COIN, scripts[i % 4], color));
+        CMutableTransaction tx;
+        tx.type = NORMAL;
+        tx.vin.push_back(CTxIn(COutPoint(hash, 0)));
+        tx.vout.push_back(CTxOut(COIN, scripts[(i + 1) % 4], color));
+        block.vtx.push_back(CTransaction(tx));
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(block_type_check_parallel)
+{
+    const int nTx = 1000;
+    type_Color color = 5;
+    CBlock block = CreateTransferBlock(nTx, color);
+
+    CValidationState state;
+    BOOST_CHECK(CheckBlockTransactionTypes(block, state, false));
+    BOOST_CHECK(CheckBlockTransactionTypes(block, state, true));
+    BOOST_CHECK(state.IsValid());
+
+    // A transaction sending a color without license fails the block either way
+    CMutableTransaction tx(block.vtx[nTx / 2]);
+    tx.vout[0].color = color + 1;
+    block.vtx[nTx / 2] = CTransaction(tx);
+    int nDoS = 0;
+    CValidationState stateSerial;
+    BOOST_CHECK(!CheckBlockTransactionTypes(block, stateSerial, false));
+    BOOST_CHECK(stateSerial.IsInvalid(nDoS) && nDoS == 100);
+    CValidationState stateParallel;
+    BOOST_CHECK(!CheckBlockTransactionTypes(block, stateParallel, true));
+    BOOST_CHECK(stateParallel.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK_EQUAL(stateParallel.GetRejectReason(), stateSerial.GetRejectReason());
+}
+
+static int nCoinsLookups = 0;
+
+static bool GetCoinsFromCache_Counted(const COutPoint &outpoint, CCoins &coins, bool fUseMempool)
+{
+    nCoinsLookups++;
+    return GetCoinsFromCache_UnitTest(outpoint, coins, fUseMempool);
+}
+
+BOOST_AUTO_TEST_CASE(block_spent_outputs_lookups)
+{
+    const int nTx = 500;
+    CBlock block = CreateTransferBlock(nTx, 5);
+
+    // GeneralCheckValid and Handler_Normal_ share the outputs resolved for the block,
+    // CheckTxFeeAndColor would too, if it was not replaced by the unit test one.
+    AlternateFunc_GetCoinsFromCache = GetCoinsFromCache_Counted;
+    nCoinsLookups = 0;
+    CValidationState state;
+    BOOST_CHECK(CheckBlockTransactionTypes(block, state, false));
+    BOOST_CHECK_EQUAL(nCoinsLookups, nTx);
+    AlternateFunc_GetCoinsFromCache = GetCoinsFromCache_UnitTest;
+}
+
+BOOST_AUTO_TEST_CASE(type_check_cache)
+{
+    const int nTx = 1000;
+    type_Color color = 5;
+    CBlock block = CreateTransferBlock(nTx, color);
+    std::set<type_Color> colors;
+    colors.insert(color);
+
+    CValidationState state;
+    BOOST_CHECK(CheckBlockTransactionTypes(block, state, false));
+
+    // Accepted to the mempool before, the transactions are not checked again
+    for (unsigned int i = 1; i < block.vtx.size(); i++)
+        typecheckcache.Add(block.vtx[i].GetHash(), colors);
+    BOOST_CHECK(typecheckcache.Contains(block.vtx[1].GetHash()));
+    BOOST_CHECK(CheckBlockTransactionTypes(block, state, false));
+
+    // The license going away is only seen once a transaction of its color is applied or undone
+    plicense->RemoveColor(color);
+    BOOST_CHECK(CheckBlockTransactionTypes(block, state, false));
+    CMutableTransaction license;
+    license.type = LICENSE;
+    license.vout.push_back(CTxOut(0, CScript(), color));
+    typecheckcache.Touch(CTransaction(license));
+    BOOST_CHECK(!typecheckcache.Contains(block.vtx[1].GetHash()));
+    CValidationState stateStale;
+    BOOST_CHECK(!CheckBlockTransactionTypes(block, stateStale, false));
+
+    // Other colors leave the entries alone
+    typecheckcache.Add(block.vtx[1].GetHash(), colors);
+    license.vout[0].color = color + 1;
+    typecheckcache.Touch(CTransaction(license));
+    BOOST_CHECK(typecheckcache.Contains(block.vtx[1].GetHash()));
+
+    typecheckcache.Clear();
+    BOOST_CHECK_EQUAL(typecheckcache.Size(), 0U);
+
+    // A full cache evicts an entry for a new one
+    CTypeCheckCache cache(2);
+    for (unsigned int i = 1; i <= 3; i++)
+        cache.Add(block.vtx[i].GetHash(), colors);
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    BOOST_CHECK(cache.Contains(block.vtx[3].GetHash()));
+}
+
+static bool VerifyBlockHeaderSignature(const CBlock &block, const BaseSignatureChecker &checker)
+{
+    return VerifyScript(block.scriptSig, block.vtx[0].vout[0].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker);
+}
+
+// Block header signature checker counting the ECDSA checks the caches did not save
+class CountingBlockHeaderSignatureChecker : public CachingBlockHeaderSignatureChecker
+{
+protected:
+    bool VerifyUncachedSignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const
+    {
+        nVerified++;
+        return CachingBlockHeaderSignatureChecker::VerifyUncachedSignature(vchSig, vchPubKey, sighash);
+    }
+
+public:
+    mutable unsigned int nVerified;
+
+    CountingBlockHeaderSignatureChecker(const CBlock* blockIn, bool storeIn=true, bool fPreverifyIn=false) :
+        CachingBlockHeaderSignatureChecker(blockIn, storeIn, fPreverifyIn), nVerified(0) {}
+};
+
+// Whether the check of a header signature finds it in one of the caches, without storing it
+static bool IsBlockHeaderSignatureCached(const CBlock &block)
+{
+    CountingBlockHeaderSignatureChecker checker(&block, false);
+    VerifyBlockHeaderSignature(block, checker);
+    return checker.nVerified == 0;
+}
+
+BOOST_AUTO_TEST_CASE(block_header_signature_preverify)
+{
+    // Blocks of the regression test chain, whose proof of work takes a few tries
+    SelectParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nBlocks = 20;
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    std::vector<CBlock> vblock(nBlocks + 1);
+    std::vector<CDataStream> vStreams(nBlocks + 1, CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    for (int i = 0; i <= nBlocks; i++) {
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vout.push_back(CTxOut(0, GetScriptForDestination(key.GetPubKey().GetID()), DEFAULT_ADMIN_COLOR));
+        vblock[i].vtx.push_back(CTransaction(coinbase));
+        vblock[i].nTime = i;
+        vblock[i].nBits = UintToArith256(consensus.powLimit).GetCompact();
+        while (!CheckProofOfWork(vblock[i].GetHash(), vblock[i].nBits, consensus, 0))
+            vblock[i].nNonce++;
+        BOOST_CHECK(SignBlockHeader(keystore, vblock[i]));
+    }
+    // The last block does not have the work its target asks for
+    CBlock &blockNoWork = vblock[nBlocks];
+    while (CheckProofOfWork(blockNoWork.GetHash(), blockNoWork.nBits, consensus, 0))
+        blockNoWork.nNonce++;
+    BOOST_CHECK(SignBlockHeader(keystore, blockNoWork));
+    for (int i = 0; i <= nBlocks; i++)
+        vStreams[i] << vblock[i];
+
+    // A signature over another header does not verify
+    CBlock blockChanged = vblock[0];
+    blockChanged.nTime = nBlocks + 1;
+    BOOST_CHECK(!VerifyBlockHeaderSignature(blockChanged, CachingBlockHeaderSignatureChecker(&blockChanged, true, true)));
+    BOOST_CHECK(!IsBlockHeaderSignatureCached(blockChanged));
+
+    // Malformed messages in the batch are left to their own processing
+    CDataStream ssGarbage(SER_NETWORK, PROTOCOL_VERSION);
+    ssGarbage << nBlocks;
+    std::vector<const CDataStream*> vpvRecv;
+    vpvRecv.push_back(&ssGarbage);
+    for (int i = 0; i <= nBlocks; i++)
+        vpvRecv.push_back(&vStreams[i]);
+    PreverifyBlockHeaderSignatures(vpvRecv);
+    BOOST_CHECK_EQUAL(vStreams[0].size(), ::GetSerializeSize(vblock[0], SER_NETWORK, PROTOCOL_VERSION));
+
+    // The check of a block then finds its header signature, unless it lacks the work
+    for (int i = 0; i < nBlocks; i++)
+        BOOST_CHECK(IsBlockHeaderSignatureCached(vblock[i]));
+    BOOST_CHECK(!IsBlockHeaderSignatureCached(blockNoWork));
+
+    // Checked once they passed the header checks, without an ECDSA check, they stay cached
+    for (int i = 0; i < nBlocks; i++) {
+        CountingBlockHeaderSignatureChecker checker(&vblock[i], true);
+        BOOST_CHECK(VerifyBlockHeaderSignature(vblock[i], checker));
+        BOOST_CHECK_EQUAL(checker.nVerified, 0U);
+        BOOST_CHECK(IsBlockHeaderSignatureCached(vblock[i]));
+    }
+    BOOST_CHECK(!VerifyBlockHeaderSignature(blockChanged, CachingBlockHeaderSignatureChecker(&blockChanged, true)));
+    BOOST_CHECK(!IsBlockHeaderSignatureCached(blockChanged));
+
+    // A check which does not store leaves the signature cache alone
+    BOOST_CHECK(VerifyBlockHeaderSignature(blockNoWork, CachingBlockHeaderSignatureChecker(&blockNoWork, false)));
+    BOOST_CHECK(!IsBlockHeaderSignatureCached(blockNoWork));
+
+    SelectParams(CBaseChainParams::MAIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
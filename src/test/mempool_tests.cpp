@@ -2,7 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "arith_uint256.h"
+#include "consensus/validation.h"
 #include "main.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util.h"
 
@@ -101,4 +104,126 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static CMutableTransaction CreateTypedTx(tx_type type, type_Color color, const CScript &scriptPubKey, int n)
+{
+    CMutableTransaction tx;
+    tx.type = type;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout.hash = ArithToUint256(arith_uint256(n + 1));
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].color = color;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRepeatedTypeTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+    CValidationState state;
+    std::list<CTransaction> removed;
+    CScript scriptCandidate = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))));
+    CScript scriptOther = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 2))));
+
+    CMutableTransaction txLicense = CreateTypedTx(LICENSE, 5, scriptCandidate, 0);
+    CMutableTransaction txVote = CreateTypedTx(VOTE, 0, scriptCandidate, 1);
+    testPool.addUnchecked(txLicense.GetHash(), CTxMemPoolEntry(txLicense, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txVote.GetHash(), CTxMemPoolEntry(txVote, 0, 0, 0.0, 1));
+
+    // A license of the same color is repeated, other colors and types are not.
+    BOOST_CHECK(!CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(LICENSE, 5, scriptOther, 2)));
+    BOOST_CHECK(CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(LICENSE, 6, scriptCandidate, 3)));
+    BOOST_CHECK(CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(NORMAL, 5, scriptCandidate, 4)));
+
+    // The senders of these votes can not be resolved, so they count as the same voter.
+    BOOST_CHECK(!CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(VOTE, 0, scriptCandidate, 5)));
+    BOOST_CHECK(CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(VOTE, 0, scriptOther, 6)));
+    BOOST_CHECK(CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(BANVOTE, 0, scriptCandidate, 7)));
+
+    // The index follows the removal of the transactions.
+    testPool.remove(txLicense, removed, true);
+    testPool.remove(txVote, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    BOOST_CHECK(CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(LICENSE, 5, scriptOther, 2)));
+    BOOST_CHECK(CheckRepeatedTypeTransactionInPool(testPool, state, CreateTypedTx(VOTE, 0, scriptCandidate, 5)));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolColorConflictTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> conflicts;
+    CScript scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))));
+
+    CMutableTransaction txLicense5 = CreateTypedTx(LICENSE, 5, scriptPubKey, 0);
+    CMutableTransaction txLicense6 = CreateTypedTx(LICENSE, 6, scriptPubKey, 1);
+    CMutableTransaction txOrder5 = CreateTypedTx(ORDER, 5, scriptPubKey, 2);
+    testPool.addUnchecked(txLicense5.GetHash(), CTxMemPoolEntry(txLicense5, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txLicense6.GetHash(), CTxMemPoolEntry(txLicense6, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txOrder5.GetHash(), CTxMemPoolEntry(txOrder5, 0, 0, 0.0, 1));
+
+    // A confirmed license of color 5 only conflicts with the pending license of that color.
+    std::vector<CTransaction> block;
+    block.push_back(CreateTypedTx(LICENSE, 5, scriptPubKey, 3));
+    testPool.removeForBlock(block, 1, conflicts);
+    BOOST_CHECK_EQUAL(conflicts.size(), 1);
+    BOOST_CHECK(conflicts.front().GetHash() == txLicense5.GetHash());
+    BOOST_CHECK(!testPool.exists(txLicense5.GetHash()));
+    BOOST_CHECK(testPool.exists(txLicense6.GetHash()));
+    BOOST_CHECK(testPool.exists(txOrder5.GetHash()));
+
+    // Once removed, the license does not conflict any more.
+    conflicts.clear();
+    testPool.removeForBlock(block, 2, conflicts);
+    BOOST_CHECK_EQUAL(conflicts.size(), 0);
+    BOOST_CHECK_EQUAL(testPool.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAddressIndexTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> removed;
+    std::vector<uint256> vtxid;
+    CScript scriptA = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))));
+    CScript scriptB = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 2))));
+    CScript scriptC = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 3))));
+    CAddressKey addressA(scriptA), addressB(scriptB), addressC(scriptC);
+
+    // The parent spends a confirmed output of C and pays A, the child spends it and pays B.
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    CMutableTransaction txParent = CreateTypedTx(NORMAL, 1, scriptA, 0);
+    {
+        CCoinsModifier coins = view.ModifyCoins(txParent.vin[0].prevout.hash);
+        coins->vout.resize(1);
+        coins->vout[0] = CTxOut(COIN, scriptC, 1);
+    }
+    CMutableTransaction txChild = CreateTypedTx(NORMAL, 1, scriptB, 1);
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1), true, &view);
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 0, 0, 0.0, 1));
+
+    testPool.queryHashesByAddress(addressA, vtxid);
+    BOOST_CHECK_EQUAL(vtxid.size(), 2);
+    testPool.queryHashesByAddress(addressB, vtxid);
+    BOOST_CHECK_EQUAL(vtxid.size(), 1);
+    BOOST_CHECK(vtxid[0] == txChild.GetHash());
+    testPool.queryHashesByAddress(addressC, vtxid);
+    BOOST_CHECK_EQUAL(vtxid.size(), 1);
+    BOOST_CHECK(vtxid[0] == txParent.GetHash());
+
+    // Removing the child keeps the parent indexed, and the index is empty at the end.
+    testPool.remove(txChild, removed, false);
+    testPool.queryHashesByAddress(addressA, vtxid);
+    BOOST_CHECK_EQUAL(vtxid.size(), 1);
+    testPool.queryHashesByAddress(addressB, vtxid);
+    BOOST_CHECK(vtxid.empty());
+    testPool.remove(txParent, removed, false);
+    testPool.queryHashesByAddress(addressA, vtxid);
+    BOOST_CHECK(vtxid.empty());
+    testPool.queryHashesByAddress(addressC, vtxid);
+    BOOST_CHECK(vtxid.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
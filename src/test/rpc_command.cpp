@@ -10,6 +10,7 @@
 #include "key.h"
 #include "test_bitcoin.h"
 #include "policy/licenseinfo.h"
+#include "script/standard.h"
 
 #include <set>
 #include <stdint.h>
@@ -18,6 +19,7 @@
 
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/assign/list_of.hpp>
 #include <boost/test/unit_test.hpp>
 
 using namespace std;
@@ -33,6 +35,21 @@ struct RPCTestWalletFixture : public WalletSetupFixture, public TestingSetup
     }
 };
 
+struct RPCTestOrderFixture : public CacheSetupFixture, public RPCTestWalletFixture
+{
+    // Put the order in the book, and its transaction where the match reads the payouts from unless fKnown is false
+    void AddOrder(const TxInfo &order, bool fKnown = true)
+    {
+        porder->AddOrder(order);
+        if (!fKnown)
+            return;
+        CMutableTransaction tx;
+        tx.type = ORDER;
+        tx.vout = order.GetTxOuts();
+        transactions[order.GetTxHash()] = tx;
+    }
+};
+
 struct RPCTestFixture : public TestingSetup
 {
     RPCTestFixture()
@@ -146,6 +163,51 @@ BOOST_FIXTURE_TEST_CASE(rpc_listwalletaddress_test, RPCTestWalletFixture)
     BOOST_CHECK(result.find(CBitcoinAddress(pubkey.GetID()).ToString()) == string::npos);
 }
 
+BOOST_FIXTURE_TEST_CASE(rpc_listwalletaddress_page_test, RPCTestWalletFixture)
+{
+    rpcfn_type listwalletaddress = tableRPC["listwalletaddress"]->actor;
+    for (int i = 0; i < 25; i++)
+        CallRPC("getnewaddress");
+
+    BOOST_FOREACH(const string& group, boost::assign::list_of("-a")("-p")) {
+        Array all = CallRPC("listwalletaddress " + group).get_array();
+        BOOST_CHECK(all.size() >= 25U);
+
+        // The pages put together give back the whole list
+        Array paged;
+        string strCursor;
+        int nPages = 0;
+        do {
+            Array params;
+            params.push_back(group);
+            params.push_back(0);
+            params.push_back(strCursor);
+            params.push_back(7);
+            Object page = listwalletaddress(params, false).get_obj();
+            Array entries = find_value(page, "entries").get_array();
+            BOOST_CHECK(entries.size() <= 7U);
+            paged.insert(paged.end(), entries.begin(), entries.end());
+            strCursor = find_value(page, "cursor").get_str();
+            nPages++;
+        } while (!strCursor.empty() && nPages < 100);
+        BOOST_CHECK(nPages >= (int)(all.size() + 6) / 7 && nPages <= (int)all.size() / 7 + 1);
+        BOOST_CHECK(paged == all);
+
+        // No addresses are asked for
+        BOOST_CHECK(CallRPC("listwalletaddress " + group + " 0").get_array().empty());
+        BOOST_CHECK(CallRPC("listwalletaddress " + group + " -1").get_array().empty());
+    }
+
+    Array params;
+    params.push_back("-a");
+    params.push_back(0);
+    params.push_back("00");
+    BOOST_CHECK_THROW(listwalletaddress(params, false), Object);
+    params[2] = "";
+    params.push_back(0);
+    BOOST_CHECK_THROW(listwalletaddress(params, false), Object);
+}
+
 BOOST_AUTO_TEST_CASE(rpc_createrawtransaction_test)
 {
     Value v;
@@ -324,4 +386,104 @@ BOOST_FIXTURE_TEST_CASE(rpc_hdkeypoolrefill_test, RPCTestWalletFixture)
     BOOST_CHECK_EQUAL(CallRPC("getnewaddress").get_str(), "1PuJ5yq3kh6Ln3K71jfYwiuf8KZk7foHE8");
 }
 
+BOOST_FIXTURE_TEST_CASE(rpc_hdgennewaddress_test, RPCTestWalletFixture)
+{
+    string strRPC = "hdgennewaddress 2";
+    BOOST_CHECK_THROW(CallRPC(strRPC), runtime_error);
+    CallRPC("hdaddchain default bb5dd1ccfe176a516b311f8d26fc2dbfb9344bbc83c34b35f532847a66b930ae");
+    Object o;
+    BOOST_CHECK_NO_THROW(o = CallRPC(strRPC + " deposit").get_obj());
+    Array a = find_value(o, "addresses").get_array();
+    BOOST_CHECK_EQUAL(a.size(), 2U);
+    BOOST_CHECK_EQUAL(a[0].get_str(), "1PuJ5yq3kh6Ln3K71jfYwiuf8KZk7foHE8");
+    CBitcoinAddress address(a[1].get_str());
+    BOOST_CHECK(pwalletMain->mapAddressBook[address.Get()].name == "deposit");
+
+    // The derived children are skipped by the keypool.
+    CallRPC("hdkeypoolrefill");
+    string strNew = CallRPC("getnewaddress").get_str();
+    BOOST_CHECK(strNew != a[0].get_str() && strNew != a[1].get_str());
+
+    // The number is positive and bounded by MAX_HD_BULK_KEYS, not by the keypool size.
+    BOOST_CHECK_THROW(CallRPC("hdgennewaddress 0"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("hdgennewaddress -1"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("hdgennewaddress " + itostr(MAX_HD_BULK_KEYS + 1)), runtime_error);
+    BOOST_CHECK_NO_THROW(o = CallRPC("hdgennewaddress 1000").get_obj());
+    BOOST_CHECK_EQUAL(find_value(o, "addresses").get_array().size(), 1000U);
+}
+
+BOOST_FIXTURE_TEST_CASE(rpc_matchorders_test, RPCTestOrderFixture)
+{
+    BOOST_CHECK_THROW(CallRPC("matchorders 5"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("matchorders 5 3 -1"), runtime_error);
+
+    Object o;
+    BOOST_CHECK_NO_THROW(o = CallRPC("matchorders 5 3").get_obj());
+    BOOST_CHECK(find_value(o, "matches").get_array().empty());
+    BOOST_CHECK_EQUAL(find_value(o, "notfound").get_int(), 0);
+    BOOST_CHECK_EQUAL(find_value(o, "rejected").get_int(), 0);
+
+    // Orders which do not cross are left alone
+    porder->AddOrder(CreateOrder(1, 10, 5, 30, 3));
+    porder->AddOrder(CreateOrder(2, 20, 3, 10, 5));
+    BOOST_CHECK_NO_THROW(o = CallRPC("matchorders 5 3").get_obj());
+    BOOST_CHECK(find_value(o, "matches").get_array().empty());
+
+    // Crossing orders are matched from the transactions they come in, here unknown
+    porder->AddOrder(CreateOrder(3, 30, 3, 10, 5));
+    BOOST_CHECK_NO_THROW(o = CallRPC("matchorders 5 3").get_obj());
+    BOOST_CHECK(find_value(o, "matches").get_array().empty());
+    BOOST_CHECK_EQUAL(find_value(o, "notfound").get_int(), 1);
+    BOOST_CHECK_EQUAL(find_value(o, "rejected").get_int(), 0);
+    BOOST_CHECK_NO_THROW(o = CallRPC("matchorders 5 3 0").get_obj());
+    BOOST_CHECK_EQUAL(find_value(o, "notfound").get_int(), 0);
+    porder->RemoveAll();
+}
+
+BOOST_FIXTURE_TEST_CASE(rpc_matchorders_commit, RPCTestOrderFixture)
+{
+    // A crossing pair is sent as a MATCH paying each order what it asked for
+    TxInfo ask = CreateOrder(1, 30, 5, 10, 3);
+    TxInfo bid = CreateOrder(2, 10, 3, 30, 5);
+    AddOrder(ask);
+    AddOrder(bid);
+    Object o;
+    BOOST_CHECK_NO_THROW(o = CallRPC("matchorders 5 3").get_obj());
+    BOOST_CHECK_EQUAL(find_value(o, "notfound").get_int(), 0);
+    BOOST_CHECK_EQUAL(find_value(o, "rejected").get_int(), 0);
+    Array matches = find_value(o, "matches").get_array();
+    BOOST_REQUIRE_EQUAL(matches.size(), 1U);
+    Array orders = find_value(matches[0].get_obj(), "orders").get_array();
+    BOOST_CHECK_EQUAL(orders[0].get_str(), ask.GetTxHash().GetHex());
+    BOOST_CHECK_EQUAL(orders[1].get_str(), bid.GetTxHash().GetHex());
+
+    uint256 txid = uint256S(find_value(matches[0].get_obj(), "txid").get_str());
+    BOOST_REQUIRE(pwalletMain->mapWallet.count(txid));
+    const CWalletTx &wtx = pwalletMain->mapWallet[txid];
+    BOOST_CHECK(wtx.type == MATCH);
+    BOOST_REQUIRE(wtx.vin.size() == 2 && wtx.vout.size() == 2);
+    BOOST_CHECK(wtx.vin[0].prevout == COutPoint(ask.GetTxHash(), 0));
+    BOOST_CHECK(wtx.vin[1].prevout == COutPoint(bid.GetTxHash(), 0));
+    BOOST_CHECK(wtx.vout[0] == ask.GetTxOuts()[1]);
+    BOOST_CHECK(wtx.vout[1] == bid.GetTxOuts()[1]);
+    porder->RemoveAll();
+
+    // A pair whose order cannot be read is dropped, the other one is still sent
+    TxInfo unknown = CreateOrder(3, 30, 5, 10, 3);
+    AddOrder(CreateOrder(4, 30, 5, 10, 3));
+    AddOrder(unknown, false);
+    AddOrder(CreateOrder(5, 10, 3, 30, 5));
+    AddOrder(CreateOrder(6, 10, 3, 30, 5));
+    BOOST_CHECK_NO_THROW(o = CallRPC("matchorders 5 3").get_obj());
+    BOOST_CHECK_EQUAL(find_value(o, "notfound").get_int(), 1);
+    BOOST_CHECK_EQUAL(find_value(o, "rejected").get_int(), 0);
+    matches = find_value(o, "matches").get_array();
+    BOOST_REQUIRE_EQUAL(matches.size(), 1U);
+    orders = find_value(matches[0].get_obj(), "orders").get_array();
+    BOOST_CHECK(orders[0].get_str() != unknown.GetTxHash().GetHex());
+    BOOST_CHECK(pwalletMain->mapWallet.count(uint256S(find_value(matches[0].get_obj(), "txid").get_str())));
+    porder->RemoveAll();
+    transactions.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
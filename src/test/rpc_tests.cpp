@@ -10,6 +10,8 @@
 
 #include "test/test_bitcoin.h"
 
+#include <sstream>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -142,4 +144,23 @@ BOOST_AUTO_TEST_CASE(rpc_boostasiotocnetaddr)
     BOOST_CHECK_EQUAL(BoostAsioToCNetAddr(boost::asio::ip::address::from_string("::ffff:127.0.0.1")).ToString(), "127.0.0.1");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_chunked_reply)
+{
+    std::stringstream ss;
+    ss << HTTPReplyHeaderChunked(HTTP_OK, false) << HTTPChunk("{\"result\":[") << HTTPChunk("1,2") << HTTPChunk("],\"id\":1}") << HTTPChunk("");
+
+    int nProto = 0;
+    BOOST_CHECK_EQUAL(ReadHTTPStatus(ss, nProto), HTTP_OK);
+    map<string, string> mapHeaders;
+    string strReply;
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(ss, mapHeaders, strReply, nProto, 1000), HTTP_OK);
+    BOOST_CHECK_EQUAL(strReply, "{\"result\":[1,2],\"id\":1}");
+
+    // The body is still bounded by the size limit
+    ss.clear();
+    ss << HTTPReplyHeaderChunked(HTTP_OK, false) << HTTPChunk(string(100, ' ')) << HTTPChunk("");
+    ReadHTTPStatus(ss, nProto);
+    BOOST_CHECK_EQUAL(ReadHTTPMessage(ss, mapHeaders, strReply, nProto, 50), HTTP_INTERNAL_SERVER_ERROR);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "keystore.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "util.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, BasicTestingSetup)
+
+// Fund nTx outputs paying to key and spend each of them in its own signed transaction
+static void CreateSpends(const CKey &key, unsigned int nTx, CMutableTransaction &txFrom, vector<CMutableTransaction> &vtxTo)
+{
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+
+    txFrom.vout.resize(nTx);
+    for (unsigned int i = 0; i < nTx; i++) {
+        txFrom.vout[i].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        txFrom.vout[i].nValue = 1;
+    }
+
+    vtxTo.resize(nTx);
+    for (unsigned int i = 0; i < nTx; i++) {
+        vtxTo[i].vin.resize(1);
+        vtxTo[i].vin[0].prevout.hash = txFrom.GetHash();
+        vtxTo[i].vin[0].prevout.n = i;
+        vtxTo[i].vout.resize(1);
+        vtxTo[i].vout[0].scriptPubKey = txFrom.vout[i].scriptPubKey;
+        vtxTo[i].vout[0].nValue = 1;
+        BOOST_CHECK(SignSignature(keystore, txFrom, vtxTo[i], 0));
+    }
+}
+
+static bool VerifyCached(const CScript &scriptPubKey, const CMutableTransaction &txTo, bool fStore)
+{
+    CTransaction tx(txTo);
+    return VerifyScript(tx.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, CachingTransactionSignatureChecker(&tx, 0, fStore));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_verify)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CMutableTransaction txFrom;
+    vector<CMutableTransaction> vtxTo;
+    CreateSpends(key, 2, txFrom, vtxTo);
+    const CScript &scriptPubKey = txFrom.vout[0].scriptPubKey;
+
+    // A valid signature keeps verifying once it is cached
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[0], true));
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[0], true));
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[0], false));
+
+    // The cached signature does not cover another transaction reusing it
+    CMutableTransaction txChanged = vtxTo[0];
+    txChanged.vout[0].nValue = 2;
+    BOOST_CHECK(!VerifyCached(scriptPubKey, txChanged, true));
+    BOOST_CHECK(!VerifyCached(scriptPubKey, txChanged, true));
+
+    // Nor the signature of another transaction for the same key
+    CMutableTransaction txSwapped = vtxTo[1];
+    txSwapped.vin[0].scriptSig = vtxTo[0].vin[0].scriptSig;
+    BOOST_CHECK(!VerifyCached(scriptPubKey, txSwapped, true));
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[1], true));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_disabled)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CMutableTransaction txFrom;
+    vector<CMutableTransaction> vtxTo;
+    CreateSpends(key, 1, txFrom, vtxTo);
+    const CScript &scriptPubKey = txFrom.vout[0].scriptPubKey;
+
+    mapArgs["-maxsigcachemb"] = "0";
+    BOOST_CHECK_EQUAL(InitSignatureCache(), 0U);
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[0], true));
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[0], true));
+    CMutableTransaction txChanged = vtxTo[0];
+    txChanged.vout[0].nValue = 2;
+    BOOST_CHECK(!VerifyCached(scriptPubKey, txChanged, true));
+
+    mapArgs.erase("-maxsigcachemb");
+    BOOST_CHECK(InitSignatureCache() > 0);
+    BOOST_CHECK(VerifyCached(scriptPubKey, vtxTo[0], true));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_deprecated_size)
+{
+    // The entry count of -maxsigcachesize is converted, not taken for MiB
+    mapArgs["-maxsigcachesize"] = "50000";
+    size_t nBytes = InitSignatureCache();
+    BOOST_CHECK(nBytes > 0 && nBytes <= (2U << 20));
+
+    // -maxsigcachemb wins over it
+    mapArgs["-maxsigcachemb"] = "0";
+    BOOST_CHECK_EQUAL(InitSignatureCache(), 0U);
+
+    mapArgs.erase("-maxsigcachesize");
+    mapArgs.erase("-maxsigcachemb");
+    BOOST_CHECK(InitSignatureCache() > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
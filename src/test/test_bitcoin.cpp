@@ -6,9 +6,11 @@
 
 #include "test_bitcoin.h"
 
+#include "arith_uint256.h"
 #include "key.h"
 #include "main.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "txdb.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -37,6 +39,12 @@ BasicTestingSetup::BasicTestingSetup()
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::MAIN);
+        // The signature cache is sized once for the whole test binary
+        static bool fSignatureCacheReady = false;
+        if (!fSignatureCacheReady) {
+            InitSignatureCache();
+            fSignatureCacheReady = true;
+        }
 }
 BasicTestingSetup::~BasicTestingSetup()
 {
@@ -63,8 +71,8 @@ TestingSetup::TestingSetup()
         RegisterValidationInterface(pwalletMain);
 #endif
         nScriptCheckThreads = 3;
-        for (int i=0; i < nScriptCheckThreads-1; i++)
-            threadGroup.create_thread(&ThreadScriptCheck);
+        nCheckThreads = 2;
+        StartCheckThreads(threadGroup);
         RegisterNodeSignals(GetNodeSignals());
 }
 
@@ -212,6 +220,25 @@ string CreateAddress()
 }
 
 
+/*!
+ * @brief Creates an ORDER transaction paying to a new address.
+ * @param [in] n The transaction hash, as a number.
+ * @param [in] sell_amount The amount sold, in vout[0].
+ * @param [in] sell_color The color sold.
+ * @param [in] buy_amount The amount asked for, in vout[1].
+ * @param [in] buy_color The color asked for.
+ */
+TxInfo CreateOrder(int n, int64_t sell_amount, type_Color sell_color,
+                   int64_t buy_amount, type_Color buy_color)
+{
+    CScript script = GetScriptForDestination(CBitcoinAddress(CreateAddress()).Get());
+    vector<CTxOut> vout;
+    vout.push_back(CTxOut(sell_amount, script, sell_color));
+    vout.push_back(CTxOut(buy_amount, script, buy_color));
+    return TxInfo(ArithToUint256(arith_uint256(n)), vout, ORDER);
+}
+
+
 /*!
  * @brief Creates a valid bitcoin transaction destination.
  */
@@ -57,6 +57,9 @@ void ConnectTransactions(const uint256 &src_hash,
 
 std::string CreateAddress();
 
+TxInfo CreateOrder(int n, int64_t sell_amount, type_Color sell_color,
+                   int64_t buy_amount, type_Color buy_color);
+
 CTxDestination CreateDestination();
 
 json_spirit::Array createArgs(int nRequired, const char* address1=NULL, const char* address2=NULL);
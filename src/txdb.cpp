@@ -5,6 +5,7 @@
 
 #include "txdb.h"
 
+#include "bloom.h"
 #include "chainparams.h"
 #include "hash.h"
 #include "main.h"
@@ -23,6 +24,8 @@ using namespace std;
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_TXOUTPUTS = 'o';
+static const char DB_BLOCK_FILTER = 'L';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -107,6 +110,25 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+CCacheDB::CCacheDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "cachestate", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CCacheDB::ReadBestBlock(int &nHeight, uint256 &hashBlock)
+{
+    std::pair<int, uint256> best;
+    if (!Read(DB_BEST_BLOCK, best))
+        return false;
+    nHeight = best.first;
+    hashBlock = best.second;
+    return true;
+}
+
+void CCacheDB::WriteBestBlock(CLevelDBBatch &batch, int nHeight, const uint256 &hashBlock)
+{
+    batch.Write(DB_BEST_BLOCK, std::make_pair(nHeight, hashBlock));
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
@@ -188,6 +210,49 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxOutputs(const uint256 &txid, CDiskTxOutputs &outputs) {
+    return Read(make_pair(DB_TXOUTPUTS, txid), outputs);
+}
+
+bool CBlockTreeDB::WriteTxOutputs(const std::vector<std::pair<uint256, CDiskTxOutputs> >&vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256,CDiskTxOutputs> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_TXOUTPUTS, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseTxOutputs(const std::vector<uint256> &vTxid)
+{
+    CLevelDBBatch batch;
+    for (std::vector<uint256>::const_iterator it=vTxid.begin(); it!=vTxid.end(); it++)
+        batch.Erase(make_pair(DB_TXOUTPUTS, *it));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockFilter(const uint256 &hash, CBloomFilter &filter) {
+    if (!Read(make_pair(DB_BLOCK_FILTER, hash), filter))
+        return false;
+    filter.UpdateEmptyFull();
+    return true;
+}
+
+bool CBlockTreeDB::WriteBlockFilter(const uint256 &hash, const CBloomFilter &filter) {
+    return Write(make_pair(DB_BLOCK_FILTER, hash), filter);
+}
+
+bool CBlockTreeDB::EraseBlockFilter(const uint256 &hash) {
+    return Erase(make_pair(DB_BLOCK_FILTER, hash));
+}
+
+bool CBlockTreeDB::WriteBlockOutputs(const std::vector<std::pair<uint256, CDiskTxOutputs> >&vect, const uint256 &hash, const CBloomFilter &filter) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<uint256,CDiskTxOutputs> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_TXOUTPUTS, it->first), it->second);
+    batch.Write(make_pair(DB_BLOCK_FILTER, hash), filter);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -237,6 +302,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nNonce         = diskindex.nNonce;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
+                pindexNew->minerKeyId     = diskindex.minerKeyId;
 
                 /*
                 if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
@@ -14,9 +14,13 @@
 #include <utility>
 #include <vector>
 
+#include <boost/scoped_ptr.hpp>
+
 class CBlockFileInfo;
+class CBloomFilter;
 class CBlockIndex;
 struct CDiskTxPos;
+struct CDiskTxOutputs;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -25,6 +29,8 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! cache of the gcoin cache database (bytes)
+static const int64_t nCacheStateDbCache = 8 << 20;
 
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -57,9 +63,88 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadTxOutputs(const uint256 &txid, CDiskTxOutputs &outputs);
+    bool WriteTxOutputs(const std::vector<std::pair<uint256, CDiskTxOutputs> > &list);
+    bool EraseTxOutputs(const std::vector<uint256> &vTxid);
+    bool ReadBlockFilter(const uint256 &hash, CBloomFilter &filter);
+    bool WriteBlockFilter(const uint256 &hash, const CBloomFilter &filter);
+    bool EraseBlockFilter(const uint256 &hash);
+    //! Write the output index entries of a block together with its filter, in one batch
+    bool WriteBlockOutputs(const std::vector<std::pair<uint256, CDiskTxOutputs> > &list, const uint256 &hash, const CBloomFilter &filter);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
 };
 
+/** Access to the gcoin cache database (cachestate/) */
+class CCacheDB : public CLevelDBWrapper
+{
+public:
+    CCacheDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CCacheDB(const CCacheDB&);
+    void operator=(const CCacheDB&);
+public:
+    bool ReadBestBlock(int &nHeight, uint256 &hashBlock);
+    void WriteBestBlock(CLevelDBBatch &batch, int nHeight, const uint256 &hashBlock);
+    //! Queue the erase of every entry keyed by (chType, key) into the batch
+    template <typename K>
+    bool EraseEntries(char chType, CLevelDBBatch &batch)
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << chType;
+        pcursor->Seek(ssKeySet.str());
+
+        for (; pcursor->Valid(); pcursor->Next()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chKeyType;
+                ssKey >> chKeyType;
+                if (chKeyType != chType)
+                    break;
+                K key;
+                ssKey >> key;
+                batch.Erase(std::make_pair(chType, key));
+            } catch (const std::exception& e) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //! Read every entry keyed by (chType, key)
+    template <typename K, typename V>
+    bool ReadEntries(char chType, std::vector<std::pair<K, V> > &entries)
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << chType;
+        pcursor->Seek(ssKeySet.str());
+
+        for (; pcursor->Valid(); pcursor->Next()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chKeyType;
+                ssKey >> chKeyType;
+                if (chKeyType != chType)
+                    break;
+                std::pair<K, V> entry;
+                ssKey >> entry.first;
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                ssValue >> entry.second;
+                entries.push_back(entry);
+            } catch (const std::exception& e) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 #endif // BITCOIN_TXDB_H
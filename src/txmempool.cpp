@@ -91,7 +91,7 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
-bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate, const CCoinsViewCache *pcoins)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
@@ -103,6 +103,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     if (tx.type != MINT)
         for (unsigned int i = 0; i < tx.vin.size(); i++)
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+    addTypeIndex(hash, tx);
+    addAddressIndex(hash, tx, pcoins);
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, fCurrentEstimate);
@@ -147,6 +149,8 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             }
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
+            removeTypeIndex(hash, tx);
+            removeAddressIndex(hash);
 
             removed.push_back(tx);
             totalTxSize -= mapTx[hash].GetTxSize();
@@ -200,18 +204,24 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
 void CTxMemPool::removeColorConflicts(const CTransaction &tx, std::list<CTransaction>& removed)
 {
-    // Remove transactions which has color conflict
-    std::list<CTransaction> result;
+    // Remove license transactions which has color conflict
+    std::set<type_Color> colors;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout)
+        colors.insert(txout.color);
 
     LOCK(cs);
-    BOOST_FOREACH(const CTxOut &txout, tx.vout) {
-        BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool.mapTx) {
-            const CTransaction& m_tx = entry.second.GetTx();
-            if (m_tx.type != LICENSE) continue;
-            if (m_tx.vout[0].color == txout.color) {
-                const CTransaction &txConflict = m_tx;
-                remove(txConflict, removed, true);
-            }
+    BOOST_FOREACH(const type_Color &color, colors) {
+        std::map<std::pair<tx_type, type_Color>, std::set<uint256> >::const_iterator it = mapTypeColor.find(make_pair((tx_type)LICENSE, color));
+        if (it == mapTypeColor.end())
+            continue;
+        // remove() updates the index, so walk a copy of it.
+        std::vector<uint256> vhash(it->second.begin(), it->second.end());
+        BOOST_FOREACH(const uint256 &hash, vhash) {
+            std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+            if (itTx == mapTx.end())
+                continue;
+            const CTransaction txConflict = itTx->second.GetTx();
+            remove(txConflict, removed, true);
         }
     }
 }
@@ -241,11 +251,125 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
 }
 
+void CTxMemPool::addTypeIndex(const uint256& hash, const CTransaction& tx)
+{
+    if (tx.vout.empty())
+        return;
+    if (tx.type == LICENSE)
+        mapTypeColor[make_pair(tx.type, tx.vout[0].color)].insert(hash);
+    else if (tx.type == ORDER)
+        BOOST_FOREACH(const CTxOut &txout, tx.vout)
+            mapTypeColor[make_pair(tx.type, txout.color)].insert(hash);
+    else if (tx.type == VOTE || tx.type == BANVOTE)
+        mapTypeAddress.insert(make_pair(make_pair(tx.type, CAddressKey(tx.vout[0].scriptPubKey)), hash));
+}
+
+void CTxMemPool::removeTypeIndex(const uint256& hash, const CTransaction& tx)
+{
+    if (tx.vout.empty())
+        return;
+    if (tx.type == LICENSE || tx.type == ORDER) {
+        BOOST_FOREACH(const CTxOut &txout, tx.vout) {
+            std::map<std::pair<tx_type, type_Color>, std::set<uint256> >::iterator it = mapTypeColor.find(make_pair(tx.type, txout.color));
+            if (it == mapTypeColor.end())
+                continue;
+            it->second.erase(hash);
+            if (it->second.empty())
+                mapTypeColor.erase(it);
+        }
+    } else if (tx.type == VOTE || tx.type == BANVOTE) {
+        typedef std::multimap<std::pair<tx_type, CAddressKey>, uint256>::iterator Iter;
+        std::pair<Iter, Iter> range = mapTypeAddress.equal_range(make_pair(tx.type, CAddressKey(tx.vout[0].scriptPubKey)));
+        for (Iter it = range.first; it != range.second; it++) {
+            if (it->second == hash) {
+                mapTypeAddress.erase(it);
+                break;
+            }
+        }
+    }
+}
+
+void CTxMemPool::queryRepeatedTypeTx(const CTransaction& tx, std::vector<CTransaction>& vtx) const
+{
+    vtx.clear();
+    if (tx.vout.empty())
+        return;
+
+    LOCK(cs);
+    std::vector<uint256> vhash;
+    if (tx.type == LICENSE) {
+        std::map<std::pair<tx_type, type_Color>, std::set<uint256> >::const_iterator it = mapTypeColor.find(make_pair(tx.type, tx.vout[0].color));
+        if (it != mapTypeColor.end())
+            vhash.assign(it->second.begin(), it->second.end());
+    } else if (tx.type == VOTE || tx.type == BANVOTE) {
+        typedef std::multimap<std::pair<tx_type, CAddressKey>, uint256>::const_iterator Iter;
+        std::pair<Iter, Iter> range = mapTypeAddress.equal_range(make_pair(tx.type, CAddressKey(tx.vout[0].scriptPubKey)));
+        for (Iter it = range.first; it != range.second; it++)
+            vhash.push_back(it->second);
+    }
+    BOOST_FOREACH(const uint256& hash, vhash) {
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(hash);
+        if (it != mapTx.end())
+            vtx.push_back(it->second.GetTx());
+    }
+}
+
+void CTxMemPool::addAddressIndex(const uint256& hash, const CTransaction& tx, const CCoinsViewCache *pcoins)
+{
+    std::vector<CAddressKey> vAddress;
+    BOOST_FOREACH(const CTxOut &txout, tx.vout)
+        vAddress.push_back(CAddressKey(txout.scriptPubKey));
+    if (tx.type != MINT) {
+        BOOST_FOREACH(const CTxIn &txin, tx.vin) {
+            std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.find(txin.prevout.hash);
+            if (it != mapTx.end()) {
+                const CTransaction& txPrev = it->second.GetTx();
+                if (txin.prevout.n < txPrev.vout.size())
+                    vAddress.push_back(CAddressKey(txPrev.vout[txin.prevout.n].scriptPubKey));
+            } else if (pcoins) {
+                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
+                if (coins && coins->IsAvailable(txin.prevout.n))
+                    vAddress.push_back(CAddressKey(coins->vout[txin.prevout.n].scriptPubKey));
+            }
+        }
+    }
+    std::sort(vAddress.begin(), vAddress.end());
+    vAddress.erase(std::unique(vAddress.begin(), vAddress.end()), vAddress.end());
+
+    std::vector<CAddressKey>& vIndexed = mapTxAddress[hash];
+    BOOST_FOREACH(const CAddressKey &address, vAddress) {
+        if (address.IsNull())
+            continue;
+        mapAddressTx[address].insert(hash);
+        vIndexed.push_back(address);
+    }
+}
+
+void CTxMemPool::removeAddressIndex(const uint256& hash)
+{
+    std::map<uint256, std::vector<CAddressKey> >::iterator it = mapTxAddress.find(hash);
+    if (it == mapTxAddress.end())
+        return;
+    BOOST_FOREACH(const CAddressKey &address, it->second) {
+        std::map<CAddressKey, std::set<uint256> >::iterator itAddress = mapAddressTx.find(address);
+        if (itAddress == mapAddressTx.end())
+            continue;
+        itAddress->second.erase(hash);
+        if (itAddress->second.empty())
+            mapAddressTx.erase(itAddress);
+    }
+    mapTxAddress.erase(it);
+}
+
 void CTxMemPool::clear()
 {
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    mapTypeColor.clear();
+    mapTypeAddress.clear();
+    mapAddressTx.clear();
+    mapTxAddress.clear();
     totalTxSize = 0;
     ++nTransactionsUpdated;
 }
@@ -322,10 +446,39 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(tx.vin.size() > it->second.n);
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
     }
+    for (std::map<std::pair<tx_type, type_Color>, std::set<uint256> >::const_iterator it = mapTypeColor.begin(); it != mapTypeColor.end(); it++) {
+        assert(!it->second.empty());
+        BOOST_FOREACH(const uint256 &hash, it->second) {
+            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(hash);
+            assert(it2 != mapTx.end());
+            assert(it2->second.GetTx().type == it->first.first);
+        }
+    }
+    assert(mapTxAddress.size() == mapTx.size());
+    for (std::map<CAddressKey, std::set<uint256> >::const_iterator it = mapAddressTx.begin(); it != mapAddressTx.end(); it++) {
+        assert(!it->second.empty());
+        BOOST_FOREACH(const uint256 &hash, it->second)
+            assert(mapTxAddress.count(hash));
+    }
+    for (std::multimap<std::pair<tx_type, CAddressKey>, uint256>::const_iterator it = mapTypeAddress.begin(); it != mapTypeAddress.end(); it++) {
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(it->second);
+        assert(it2 != mapTx.end());
+        assert(it2->second.GetTx().type == it->first.first);
+    }
 
     assert(totalTxSize == checkTotal);
 }
 
+void CTxMemPool::queryHashesByAddress(const CAddressKey& address, std::vector<uint256>& vtxid) const
+{
+    vtxid.clear();
+
+    LOCK(cs);
+    std::map<CAddressKey, std::set<uint256> >::const_iterator it = mapAddressTx.find(address);
+    if (it != mapAddressTx.end())
+        vtxid.assign(it->second.begin(), it->second.end());
+}
+
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 {
     vtxid.clear();
@@ -8,8 +8,13 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include "amount.h"
+#include "cache.h"
 #include "coins.h"
 #include "primitives/transaction.h"
 #include "sync.h"
@@ -95,6 +100,22 @@ private:
 
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    //! License and order transactions by (type, color of their outputs)
+    std::map<std::pair<tx_type, type_Color>, std::set<uint256> > mapTypeColor;
+    //! Vote transactions by (type, candidate address)
+    std::multimap<std::pair<tx_type, CAddressKey>, uint256> mapTypeAddress;
+
+    void addTypeIndex(const uint256& hash, const CTransaction& tx);
+    void removeTypeIndex(const uint256& hash, const CTransaction& tx);
+
+    //! Transactions by the addresses they pay to or spend from
+    std::map<CAddressKey, std::set<uint256> > mapAddressTx;
+    //! Addresses each transaction is indexed by, so that removal needs no input lookups
+    std::map<uint256, std::vector<CAddressKey> > mapTxAddress;
+
+    void addAddressIndex(const uint256& hash, const CTransaction& tx, const CCoinsViewCache *pcoins);
+    void removeAddressIndex(const uint256& hash);
+
 public:
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
@@ -113,7 +134,11 @@ public:
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
-    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
+    /**
+     * The inputs spent from pcoins, if given, or from the pool are indexed by
+     * their address together with the outputs.
+     */
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true, const CCoinsViewCache *pcoins = NULL);
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeCoinbaseSpends(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
@@ -122,6 +147,7 @@ public:
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
+    void queryHashesByAddress(const CAddressKey& address, std::vector<uint256>& vtxid) const;
     void pruneSpent(const uint256& hash, CCoins &coins);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
@@ -155,6 +181,12 @@ public:
 
     bool lookup(uint256 hash, CTransaction& result) const;
 
+    /**
+     * Get the transactions in the pool of the same type as tx that may repeat
+     * it: licenses of the same color, and votes for the same candidate.
+     */
+    void queryRepeatedTypeTx(const CTransaction& tx, std::vector<CTransaction>& vtx) const;
+
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 
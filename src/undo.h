@@ -10,6 +10,9 @@
 #include "primitives/transaction.h"
 #include "serialize.h"
 
+#include <map>
+#include <vector>
+
 /** Undo information for a CTxIn
  *
  *  Contains the prevout's CTxOut being spent, and if this was the
@@ -98,4 +101,24 @@ public:
     }
 };
 
+/** Undo information of a CBlock for the gcoin caches
+ *
+ *  Contains the outputs of the order transactions spent by the MATCH and
+ *  CANCEL transactions of the block. The CTxInUndo entries only keep the
+ *  spent output of an order, while restoring it to the order list also
+ *  needs the output with the color and amount it buys.
+ */
+class CGcoinBlockUndo
+{
+public:
+    std::map<uint256, std::vector<CTxOut> > mapOrders;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(mapOrders);
+    }
+};
+
 #endif // BITCOIN_UNDO_H
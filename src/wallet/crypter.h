@@ -185,6 +185,18 @@ public:
             mi++;
         }
     }
+    void GetKeysAfter(const CKeyID &keyAfter, unsigned int nMax, std::vector<CKeyID> &vKeyOut) const
+    {
+        if (!IsCrypted())
+        {
+            CBasicKeyStore::GetKeysAfter(keyAfter, nMax, vKeyOut);
+            return;
+        }
+        vKeyOut.clear();
+        LOCK(cs_KeyStore);
+        for (CryptedKeyMap::const_iterator mi = mapCryptedKeys.upper_bound(keyAfter); mi != mapCryptedKeys.end() && vKeyOut.size() < nMax; mi++)
+            vKeyOut.push_back((*mi).first);
+    }
 
     /**
      * Wallet status (encrypted, locked) changed.
@@ -1854,6 +1854,105 @@ Value sendmany(const Array& params, bool fHelp)
     return wtx.GetHash().GetHex();
 }
 
+Value sendbatch(const Array& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return Value::null;
+
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "sendbatch [{\"from\":\"address\",\"to\":\"address\",\"amount\":x,\"color\":n},...]\n"
+            "\nSend a list of payments in one call. The payments from the same address and of the same color\n"
+            "are sent in one transaction, or in several ones if they do not fit in the size and fee limits of one,\n"
+            "and the later transactions may spend the change of the earlier ones."
+            + HelpRequiringPassphrase() + "\n"
+            "\nArguments:\n"
+            "1. \"payments\"          (string, required) A json array of payments\n"
+            "    [\n"
+            "      {\n"
+            "        \"from\":\"address\"   (string, optional) The bitcoin address to send funds from, any address if omitted\n"
+            "        \"to\":\"address\"     (string, required) The bitcoin address to send funds to\n"
+            "        \"amount\":x         (numeric, required) The amount in btc\n"
+            "        \"color\":n          (numeric, required) The currency type (color) of the coin\n"
+            "      }\n"
+            "      ,...\n"
+            "    ]\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"results\": [           (array) One entry for each payment, in the same order\n"
+            "    {\n"
+            "      \"txid\":\"id\"        (string) The id of the transaction of the payment, if it was sent\n"
+            "      \"error\":\"message\"  (string) The reason it was not sent otherwise\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"transactions\": n      (numeric) The number of transactions sent\n"
+            "  \"time\": n              (numeric) The time spent sending them, in milliseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendbatch", "\"[{\\\"to\\\":\\\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\\\",\\\"amount\\\":0.01,\\\"color\\\":1}]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendbatch", "[{\"to\":\"1D1ZrZNe3JUo7ZycKEYQQiQAWd9y54F4XZ\",\"amount\":0.01,\"color\":1}]")
+        );
+
+    RPCTypeCheck(params, boost::assign::list_of(array_type));
+    const Array& payments = params[0].get_array();
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    vector<CBatchPayment> vPayment;
+    BOOST_FOREACH(const Value& payment, payments) {
+        if (payment.type() != obj_type)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected object");
+        const Object& o = payment.get_obj();
+
+        string strFromAddress;
+        const Value& from = find_value(o, "from");
+        if (from.type() != null_type) {
+            strFromAddress = from.get_str();
+            if (!CBitcoinAddress(strFromAddress).IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid From-Bitcoin address: ") + strFromAddress);
+        }
+        string strToAddress = find_value(o, "to").get_str();
+        CBitcoinAddress address(strToAddress);
+        if (!address.IsValid())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, string("Invalid To-Bitcoin address: ") + strToAddress);
+        CAmount nAmount = AmountFromValue(find_value(o, "amount"));
+        if (nAmount <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid amount");
+        const type_Color color = ColorFromValue(find_value(o, "color"));
+        if (!IsValidColor(color))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid color");
+
+        CRecipient recipient = {GetScriptForDestination(address.Get()), nAmount, false};
+        CBatchPayment batchPayment = {strFromAddress, color, recipient};
+        vPayment.push_back(batchPayment);
+    }
+
+    EnsureWalletIsUnlocked();
+
+    int64_t nStart = GetTimeMicros();
+    vector<pair<uint256, string> > vResult;
+    int nTransactions = pwalletMain->SendBatch(vPayment, vResult);
+    int64_t nTime = GetTimeMicros() - nStart;
+    LogPrint("bench", "sendbatch: %u payments in %d transactions, %.2fms\n", vPayment.size(), nTransactions, 0.001 * nTime);
+
+    Array results;
+    for (unsigned int i = 0; i < vResult.size(); i++) {
+        Object result;
+        if (vResult[i].first.IsNull())
+            result.push_back(Pair("error", vResult[i].second));
+        else
+            result.push_back(Pair("txid", vResult[i].first.GetHex()));
+        results.push_back(result);
+    }
+    Object ret;
+    ret.push_back(Pair("results", results));
+    ret.push_back(Pair("transactions", nTransactions));
+    ret.push_back(Pair("time", nTime / 1000));
+    return ret;
+}
+
 // Defined in rpcmisc.cpp
 extern CScript _createmultisig_redeemScript(const Array& params);
 
@@ -2186,20 +2285,68 @@ void AcentryToJSON(const CAccountingEntry& acentry, const string& strAccount, Ar
     }
 }
 
+void ListTransactionsPage(const Array& params, string& strCursor, unsigned int nLimit, Array& entries)
+{
+    EnsureWalletIsAvailable(false);
+
+    string strAccount = "*";
+    if (params.size() > 0)
+        strAccount = params[0].get_str();
+    isminefilter filter = ISMINE_SPENDABLE;
+    if (params.size() > 3)
+        if (params[3].get_bool())
+            filter = filter | ISMINE_WATCH_ONLY;
+
+    // The pages follow the order positions, the same order count and from return the
+    // transactions in, which keeps them in place as transactions come in
+    int64_t nOrderPos = 0;
+    bool fAfter = !strCursor.empty();
+    if (fAfter)
+        DecodeRPCCursor(strCursor, nOrderPos);
+    strCursor.clear();
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    list<CAccountingEntry> acentries;
+    CWallet::TxItems txOrdered = pwalletMain->OrderedTxItems(acentries, strAccount);
+
+    size_t nStart = entries.size();
+    CWallet::TxItems::iterator it = fAfter ? txOrdered.upper_bound(nOrderPos) : txOrdered.begin();
+    for (; it != txOrdered.end(); ++it) {
+        // A page ends between two positions, so that the next one starts where it stopped
+        if (entries.size() - nStart >= nLimit && it->first != nOrderPos)
+            break;
+        CWalletTx *const pwtx = (*it).second.first;
+        if (pwtx != 0)
+            ListTransactions(*pwtx, strAccount, 0, true, entries, filter);
+
+        CAccountingEntry *const pacentry = (*it).second.second;
+        if (pacentry != 0)
+            AcentryToJSON(*pacentry, strAccount, entries);
+        nOrderPos = it->first;
+    }
+    if (it != txOrdered.end())
+        strCursor = EncodeRPCCursor(nOrderPos);
+}
+
 Value listtransactions(const Array& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
         return Value::null;
 
-    if (fHelp || params.size() > 4)
+    if (fHelp || params.size() > 6)
         throw runtime_error(
-            _(__func__) + " ( \"account\" count from includeWatchonly)\n"
+            _(__func__) + " ( \"account\" count from includeWatchonly \"cursor\" limit )\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
+            "With a count of -1, returns all the transactions, oldest first.\n"
+            "With a cursor, returns one page of all the transactions instead, oldest first.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) DEPRECATED. The account name. Should be \"*\".\n"
-            "2. count          (numeric, optional, default=10) The number of transactions to return\n"
+            "2. count          (numeric, optional, default=10) The number of transactions to return, -1 for all of them\n"
             "3. from           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. includeWatchonly (bool, optional, default=false) Include transactions to watchonly addresses (see 'importaddress')\n"
+            "5. \"cursor\"     (string, optional) Where the page starts, \"\" for the first one, count and from are ignored\n"
+            "6. limit          (numeric, optional, default=1000) The number of transactions in the page, the entries of the last one may pass it\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -2239,10 +2386,23 @@ Value listtransactions(const Array& params, bool fHelp)
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList all the transactions\n"
+            + HelpExampleCli("listtransactions", "\"*\" -1") +
+            "\nList the first page of all the transactions, giving {\"entries\":[...],\"cursor\":\"...\"}\n"
+            + HelpExampleCli("listtransactions", "\"*\" 0 0 false \"\" 1000") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
         );
 
+    if (params.size() > 4)
+        return RPCListPage(&ListTransactionsPage, params, params[4], params.size() > 5 ? params[5] : Value::null);
+
+    if (params.size() > 1 && params[1].get_int() == -1) {
+        if (params.size() > 2 && params[2].get_int() != 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot skip transactions when listing all of them");
+        return RPCListAll(&ListTransactionsPage, params);
+    }
+
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
     string strAccount = "*";
@@ -2300,19 +2460,70 @@ Value listtransactions(const Array& params, bool fHelp)
     return ret;
 }
 
+void ListWalletAddressPage(const Array& params, string& strCursor, unsigned int nLimit, Array& entries)
+{
+    EnsureWalletIsAvailable(false);
+
+    string group = "-a";
+    if (params.size() >= 1)
+        group = params[0].get_str();
+
+    if (group == "-p") { // list addresses from keypool
+        int64_t nIndex = 0;
+        if (!strCursor.empty())
+            DecodeRPCCursor(strCursor, nIndex);
+        strCursor.clear();
+
+        std::vector<std::pair<int64_t, CPubKey> > keys;
+        pwalletMain->ViewKeyPool(nIndex, nLimit, keys);
+        for (std::vector<std::pair<int64_t, CPubKey> >::iterator it = keys.begin(); it != keys.end(); ++it)
+            entries.push_back(CBitcoinAddress(it->second.GetID()).ToString());
+        if (!keys.empty() && keys.size() == nLimit)
+            strCursor = EncodeRPCCursor(keys.back().first);
+        return;
+    }
+
+    CKeyID keyAfter;
+    if (!strCursor.empty())
+        DecodeRPCCursor(strCursor, keyAfter);
+    strCursor.clear();
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    // Look at no more than a page of keys, the page may come out short when they are filtered
+    std::vector<CKeyID> keyids;
+    pwalletMain->GetKeysAfter(keyAfter, nLimit, keyids);
+    for (std::vector<CKeyID>::iterator it = keyids.begin(); it != keyids.end(); ++it) {
+        if (group == "-i") { // list addresses imported
+            if (!pwalletMain->mapKeyMetadata[*it].fromImport)
+                continue;
+        } else if (group != "-a") { // list address match the label
+            std::map<CTxDestination, CAddressBookData>::const_iterator mi = pwalletMain->mapAddressBook.find(*it);
+            if (mi == pwalletMain->mapAddressBook.end() || mi->second.name != group)
+                continue;
+        }
+        entries.push_back(CBitcoinAddress(*it).ToString());
+    }
+    if (!keyids.empty() && keyids.size() == nLimit)
+        strCursor = EncodeRPCCursor(keyids.back());
+}
+
 Value listwalletaddress(const Array& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
         return Value::null;
 
-    if (fHelp || params.size() > 2)
+    if (fHelp || params.size() > 4)
         throw runtime_error(
-            _(__func__) + " \"group-of-addresses\" \"number-of-addresses\"\n"
+            _(__func__) + " \"group-of-addresses\" \"number-of-addresses\" ( \"cursor\" limit )\n"
             "\n List addresses in the wallet.\n"
+            "With a cursor, returns one page of the addresses instead.\n"
             + HelpRequiringPassphrase() +
             "\nArguments:\n"
             "1. group-of-addresses (string, optional) The group you select to get. (-a:all, -i:imported, -p: keypool, others: label of keys).\n"
             "2. number-of-addresses (unsigned_int, optional) The number of addresses you want to get from your wallet.\n"
+            "3. \"cursor\"      (string, optional) Where the page starts, \"\" for the first one, number-of-addresses is ignored\n"
+            "4. limit           (numeric, optional, default=1000) The number of keys looked at for the page\n"
             "\nResult:\n"
             "{\n"
             "   \"address\", (string) An address in your wallet.\n"
@@ -2320,66 +2531,17 @@ Value listwalletaddress(const Array& params, bool fHelp)
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("listwalletaddress", "-a 3")
+            + HelpExampleCli("listwalletaddress", "-a 0 \"\" 1000")
             + HelpExampleRpc("listwalletaddress", "-a 3")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    std::set<CKeyID> keyids;
-    pwalletMain->GetKeys(keyids);
-
-    std::vector<CPubKey> keys;
-    pwalletMain->ViewKeyPool(keys);
-
-    string group = "-a";
-    if (params.size() >= 1)
-            group = params[0].get_str();
+    if (params.size() > 2)
+        return RPCListPage(&ListWalletAddressPage, params, params[2], params.size() > 3 ? params[3] : Value::null);
 
-    // number of address
-    int number = keyids.size() + keys.size();
+    size_t number = std::numeric_limits<size_t>::max();
     if (params.size() == 2)
-        number = params[1].get_int();
-
-    Array a;
-    int count = 0;
-    if (group == "-a") { // list all addresses in wallet
-        for (std::set<CKeyID>::iterator it = keyids.begin(); it != keyids.end(); ++it) {
-            if (count >= number)
-                break;
-            string addr = CBitcoinAddress(*it).ToString();
-            a.push_back(addr);
-            count++;
-        }
-    } else if (group == "-i") { // list addresses imported
-        for (std::set<CKeyID>::iterator it = keyids.begin(); it != keyids.end(); ++it) {
-            if (count >= number)
-                break;
-            string addr = CBitcoinAddress(*it).ToString();
-            if (pwalletMain->mapKeyMetadata[*it].fromImport) {
-                 a.push_back(addr);
-                 count++;
-            }
-        }
-    } else if (group == "-p") { // list addresses from keypool
-        for (std::vector<CPubKey>::iterator it = keys.begin(); it != keys.end(); ++it) {
-            if (count >= number)
-                break;
-            string addr = CBitcoinAddress((*it).GetID()).ToString();
-            a.push_back(addr);
-            count++;
-        }
-    } else { // list address match the label
-       for (std::set<CKeyID>::iterator it = keyids.begin(); it != keyids.end(); ++it) {
-            if (count >= number)
-                break;
-            string addr = CBitcoinAddress(*it).ToString();
-            if (pwalletMain->mapAddressBook[*it].name == group) {
-                 a.push_back(addr);
-                 count++;
-            }
-        }
-    }
-    return a;
+        number = std::max(0, params[1].get_int());
+    return RPCListAll(&ListWalletAddressPage, params, number);
 }
 
 Value listonewalletaddress(const Array& params, bool fHelp)
@@ -2455,6 +2617,71 @@ Value gennewaddress(const Array& params, bool fHelp)
     return a;
 }
 
+// Derive many new addresses from the active HD chain at once.
+Value hdgennewaddress(const Array& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return Value::null;
+
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            _(__func__) + " number ( \"account\" )\n"
+            "\nDerive new addresses for receiving payments from the active HD chain.\n"
+            "The keys are derived in parallel and stored, with their address book entries, in one database transaction.\n"
+            "\nArguments:\n"
+            "1. \"number\"        (int, required) Number of addresses to derive, at most " + itostr(MAX_HD_BULK_KEYS) + "\n"
+            "2. \"account\"       (string, optional) The account name for the addresses to be linked to, default \"\"\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"addresses\": [     (array) The new addresses\n"
+            "    \"address\"        (string) A new address\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"keys_per_sec\": n  (numeric) The number of keys derived and stored per second\n"
+            "  \"time\": n          (numeric) The time spent, in milliseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("hdgennewaddress", "100")
+            + HelpExampleCli("hdgennewaddress", "100 \"deposit\"")
+            + HelpExampleRpc("hdgennewaddress", "100, \"deposit\"")
+        );
+
+    int number = params[0].get_int();
+    if (number <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected a positive number.");
+    if ((unsigned int)number > MAX_HD_BULK_KEYS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid parameter, at most %u addresses at once.", MAX_HD_BULK_KEYS));
+    string strAccount;
+    if (params.size() > 1)
+        strAccount = AccountFromValue(params[1]);
+
+    // The keys are derived without the wallet lock, which is only taken to store them
+    HDChainID chainID;
+    pwalletMain->HDGetActiveChainID(chainID);
+    if (chainID.IsNull())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error: No active HD chain, use hdaddchain first");
+
+    int64_t nStart = GetTimeMicros();
+    vector<CPubKey> vPubKey;
+    try {
+        pwalletMain->HDGetNextChildPubKeys(chainID, number, vPubKey, strAccount);
+    } catch (const std::runtime_error& e) {
+        throw JSONRPCError(RPC_WALLET_ERROR, string("Error: ") + e.what());
+    }
+    int64_t nTime = GetTimeMicros() - nStart;
+    double dKeysPerSec = nTime > 0 ? vPubKey.size() * 1000000.0 / nTime : 0;
+    LogPrint("bench", "hdgennewaddress: %u keys, %.2fms (%.0f keys/s)\n", vPubKey.size(), 0.001 * nTime, dKeysPerSec);
+
+    Array a;
+    BOOST_FOREACH(const CPubKey& pubkey, vPubKey)
+        a.push_back(CBitcoinAddress(pubkey.GetID()).ToString());
+    Object ret;
+    ret.push_back(Pair("addresses", a));
+    ret.push_back(Pair("keys_per_sec", dKeysPerSec));
+    ret.push_back(Pair("time", nTime / 1000));
+    return ret;
+}
+
 Value listaccounts(const Array& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -3377,6 +3604,83 @@ Value match(const Array& params, bool fHelp)
     return a;
 }
 
+Value matchorders(const Array& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return Value::null;
+
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw runtime_error(
+            _(__func__) + " sellcolor buycolor ( max )\n"
+            "\nFind the resting orders which cross between two colors and send the match transactions of all of them.\n"
+            "Orders selling sellcolor are taken in price order, each with the best order selling buycolor it crosses.\n"
+            "Orders already spent by a transaction in the mempool are left out.\n"
+            + HelpRequiringPassphrase() +
+            "\nArguments:\n"
+            "1. sellcolor    (numeric, required) The color sold by the first order of each match\n"
+            "2. buycolor     (numeric, required) The color sold by the second order of each match\n"
+            "3. max          (numeric, optional, default=1000) The maximum amount of matches\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"matches\": [            (array) the matches sent\n"
+            "    {\n"
+            "      \"txid\": \"hash\",    (string) the match transaction id\n"
+            "      \"orders\": [\"hash\", \"hash\"]  (array) the transaction ids of the matched orders\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"notfound\": n,         (numeric) the amount of matches found with an order whose transaction could not be read\n"
+            "  \"rejected\": n,         (numeric) the amount of matches found but not committed to the wallet and the mempool\n"
+            "  \"time\": n              (numeric) milliseconds spent\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("matchorders", "5 3")
+            + HelpExampleRpc("matchorders", "5, 3, 100")
+        );
+
+    const type_Color colorA = ColorFromValue(params[0]), colorB = ColorFromValue(params[1]);
+    int nMax = 1000;
+    if (params.size() > 2)
+        nMax = params[2].get_int();
+    if (nMax < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative max");
+
+    EnsureWalletIsUnlocked();
+
+    int64_t nStart = GetTimeMicros();
+    std::vector<std::pair<uint256, uint256> > matchlist;
+    std::vector<uint256> txid;
+    std::vector<MatchOrderResult> vResult;
+    pwalletMain->MatchOrderBook(colorA, colorB, nMax, matchlist, txid, vResult);
+    int64_t nTime = GetTimeMicros() - nStart;
+    LogPrint("bench", "matchorders: %u matches, %.2fms\n", matchlist.size(), 0.001 * nTime);
+
+    Array matches;
+    int nNotFound = 0, nRejected = 0;
+    for (size_t i = 0; i < txid.size(); i++) {
+        if (vResult[i] == MATCH_ORDER_NOT_FOUND) {
+            nNotFound++;
+            continue;
+        }
+        if (vResult[i] == MATCH_REJECTED) {
+            nRejected++;
+            continue;
+        }
+        Array orders;
+        orders.push_back(matchlist[i].first.GetHex());
+        orders.push_back(matchlist[i].second.GetHex());
+        Object entry;
+        entry.push_back(Pair("txid", txid[i].GetHex()));
+        entry.push_back(Pair("orders", orders));
+        matches.push_back(entry);
+    }
+    Object ret;
+    ret.push_back(Pair("matches", matches));
+    ret.push_back(Pair("notfound", nNotFound));
+    ret.push_back(Pair("rejected", nRejected));
+    ret.push_back(Pair("time", nTime / 1000));
+    return ret;
+}
+
 Value cancelorder(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -4,6 +4,17 @@
 
 #include "wallet/wallet.h"
 
+#include "base58.h"
+#include "blockfilter.h"
+#include "chainparams.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "undo.h"
+
+#include <map>
 #include <set>
 #include <stdint.h>
 #include <utility>
@@ -11,6 +22,7 @@
 
 #include "test/test_bitcoin.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -307,4 +319,454 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+// Write a block on top of pindexPrev to disk with its filter, and make it the tip.
+// The filter is built from pblockFilter if given, and the outputs vSpent spent by the block.
+static CBlockIndex* add_rescan_block(CBlock& block, CBlockIndex* pindexPrev, CDiskBlockPos& pos,
+                                     const vector<CTxOut>& vSpent, const CBlock* pblockFilter = NULL)
+{
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = GetTime();
+    BOOST_CHECK(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    CBlockIndex* pindex = new CBlockIndex(block);
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(block.GetHash(), pindex)).first;
+    pindex->phashBlock = &mi->first;
+    pindex->pprev = pindexPrev;
+    pindex->nHeight = pindexPrev->nHeight + 1;
+    pindex->nTx = block.vtx.size();
+    pindex->nFile = pos.nFile;
+    pindex->nDataPos = pos.nPos;
+    pindex->nStatus = BLOCK_HAVE_DATA;
+    pos.nPos += ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    BOOST_FOREACH(const CTxOut& txout, vSpent)
+        blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(txout));
+    BOOST_CHECK(pblocktree->WriteBlockFilter(block.GetHash(), BuildBlockFilter(pblockFilter ? *pblockFilter : block, blockundo)));
+    chainActive.SetTip(pindex);
+    return pindex;
+}
+
+// Take the blocks add_rescan_block added above pindexStop off the chain, the index,
+// the block tree and the disk.
+static void erase_rescan_blocks(CBlockIndex* pindex, CBlockIndex* pindexStop)
+{
+    chainActive.SetTip(pindexStop);
+    while (pindex != pindexStop) {
+        CBlockIndex* pindexPrev = pindex->pprev;
+        BOOST_CHECK(pblocktree->EraseBlockFilter(pindex->GetBlockHash()));
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+        pindex = pindexPrev;
+    }
+    boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(1000, 0), "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(balance_ledger_tests)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = GetScriptForDestination(CKeyID(uint160(vector<unsigned char>(20, 1))));
+    string strMine = CBitcoinAddress(key.GetPubKey().GetID()).ToString();
+    type_Color color = 3;
+    map<type_Color, CAmount> color_amount;
+
+    // An incoming payment in the pool is unconfirmed.
+    CMutableTransaction txIn;
+    txIn.vin.resize(1);
+    txIn.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txIn.vout.push_back(CTxOut(5 * COIN, scriptMine, color));
+    mempool.addUnchecked(txIn.GetHash(), CTxMemPoolEntry(txIn, 0, 0, 0.0, 1));
+    pwalletMain->SyncTransaction(txIn, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedColorBalance(color), 5 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetColorBalance(color), 0);
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+
+    // Spending it with change to ourselves makes the change trusted.
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txIn.GetHash(), 0);
+    txSpend.vout.push_back(CTxOut(2 * COIN, scriptOther, color));
+    txSpend.vout.push_back(CTxOut(3 * COIN, scriptMine, color));
+    mempool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, 0, 0.0, 1));
+    pwalletMain->SyncTransaction(txSpend, NULL);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedColorBalance(color), 0);
+    BOOST_CHECK_EQUAL(pwalletMain->GetColorBalance(color), 3 * COIN);
+    pwalletMain->GetBalance(color_amount);
+    BOOST_CHECK_EQUAL(color_amount[color], 3 * COIN);
+    pwalletMain->GetAddressBalance(strMine, color_amount, 0);
+    BOOST_CHECK_EQUAL(color_amount[color], 3 * COIN);
+    pwalletMain->GetAddressBalance(strMine, color_amount, 1);
+    BOOST_CHECK(color_amount.empty());
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+
+    // Dropping the transactions from the pool is not notified to the wallet,
+    // the ledger follows the pool when the balances are read again.
+    mempool.clear();
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+    BOOST_CHECK_EQUAL(pwalletMain->GetColorBalance(color), 0);
+    BOOST_CHECK_EQUAL(pwalletMain->GetUnconfirmedColorBalance(color), 0);
+
+    // A rescan finds a payment in a block, then its spend in the next one.
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    CDiskBlockPos pos(1000, 0);
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 1;
+    coinbase.vout.push_back(CTxOut(COIN, scriptOther, color));
+    CMutableTransaction txPay;
+    txPay.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txPay.vout.push_back(CTxOut(4 * COIN, scriptMine, color));
+    CBlock blockPay;
+    blockPay.vtx.push_back(coinbase);
+    blockPay.vtx.push_back(txPay);
+    CBlockIndex* pindex = add_rescan_block(blockPay, pindexGenesis, pos, vector<CTxOut>(1, CTxOut(4 * COIN, scriptOther, color)));
+    BOOST_CHECK_EQUAL(pwalletMain->ScanForWalletTransactions(pindex, true), 1);
+    BOOST_CHECK_EQUAL(pwalletMain->GetColorBalance(color), 4 * COIN);
+    pwalletMain->GetAddressBalance(strMine, color_amount, 1);
+    BOOST_CHECK_EQUAL(color_amount[color], 4 * COIN);
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+
+    coinbase.vin[0].scriptSig = CScript() << 2;
+    CMutableTransaction txSpendPay;
+    txSpendPay.vin.push_back(CTxIn(COutPoint(txPay.GetHash(), 0)));
+    txSpendPay.vout.push_back(CTxOut(4 * COIN, scriptOther, color));
+    CBlock blockSpend;
+    blockSpend.vtx.push_back(coinbase);
+    blockSpend.vtx.push_back(txSpendPay);
+    pindex = add_rescan_block(blockSpend, pindex, pos, vector<CTxOut>(1, txPay.vout[0]));
+    BOOST_CHECK_EQUAL(pwalletMain->ScanForWalletTransactions(pindex, true), 1);
+    BOOST_CHECK_EQUAL(pwalletMain->GetColorBalance(color), 0);
+    pwalletMain->GetBalance(color_amount);
+    BOOST_CHECK_EQUAL(color_amount[color], 0);
+    pwalletMain->GetAddressBalance(strMine, color_amount, 1);
+    BOOST_CHECK_EQUAL(color_amount[color], 0);
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+
+    erase_rescan_blocks(pindex, pindexGenesis);
+}
+
+// Pay nOutputs outputs of a color to scriptMine in trusted transactions of the pool.
+static void add_pool_coins(const CScript& scriptMine, type_Color color, int nOutputs, CAmount nValue)
+{
+    while (nOutputs > 0) {
+        CMutableTransaction txIn;
+        txIn.vin.resize(1);
+        txIn.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        txIn.vout.push_back(CTxOut(nValue, scriptMine, color));
+        mempool.addUnchecked(txIn.GetHash(), CTxMemPoolEntry(txIn, 0, 0, 0.0, 1));
+        pwalletMain->SyncTransaction(txIn, NULL);
+
+        CMutableTransaction txFund;
+        txFund.vin.resize(1);
+        txFund.vin[0].prevout = COutPoint(txIn.GetHash(), 0);
+        for (; nOutputs > 0 && txFund.vout.size() < 1000; nOutputs--)
+            txFund.vout.push_back(CTxOut(nValue, scriptMine, color));
+        mempool.addUnchecked(txFund.GetHash(), CTxMemPoolEntry(txFund, 0, 0, 0.0, 1));
+        pwalletMain->SyncTransaction(txFund, NULL);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(coin_index_tests)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = GetScriptForDestination(CKeyID(uint160(vector<unsigned char>(20, 1))));
+    type_Color color = 3, colorOther = 4;
+    vector<COutput> vAvailable;
+
+    add_pool_coins(scriptMine, color, 3, COIN);
+    add_pool_coins(scriptMine, colorOther, 5, COIN);
+    pwalletMain->AvailableCoins(vAvailable, color);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 3U);
+    BOOST_FOREACH(const COutput& out, vAvailable)
+        BOOST_CHECK(out.tx->vout[out.i].color == color);
+    pwalletMain->AvailableCoins(vAvailable, colorOther);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 5U);
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+
+    // A spent output leaves the index, its change is added.
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(vAvailable[0].tx->GetHash(), vAvailable[0].i);
+    txSpend.vout.push_back(CTxOut(COIN / 2, scriptOther, colorOther));
+    txSpend.vout.push_back(CTxOut(COIN / 2, scriptMine, colorOther));
+    mempool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, 0, 0.0, 1));
+    pwalletMain->SyncTransaction(txSpend, NULL);
+    pwalletMain->AvailableCoins(vAvailable, colorOther);
+    BOOST_CHECK_EQUAL(vAvailable.size(), 5U);
+    BOOST_CHECK_EQUAL(vAvailable[0].tx->vout[vAvailable[0].i].nValue, COIN / 2);
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+
+    // The pool transactions are dropped, nothing is left to spend.
+    mempool.clear();
+    pwalletMain->MarkDirty();
+    pwalletMain->AvailableCoins(vAvailable, color);
+    BOOST_CHECK(vAvailable.empty());
+    BOOST_CHECK(pwalletMain->CheckBalanceLedger());
+}
+
+BOOST_AUTO_TEST_CASE(confirm_cache_tests)
+{
+    // Three blocks on top of the genesis block, and a fork of two from it.
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    vector<uint256> vHash(5);
+    vector<CBlockIndex> vBlock(5);
+    for (int i = 0; i < 5; i++) {
+        vHash[i] = GetRandHash();
+        vBlock[i].phashBlock = &vHash[i];
+        vBlock[i].pprev = (i == 0 || i == 3) ? pindexGenesis : &vBlock[i - 1];
+        vBlock[i].nHeight = vBlock[i].pprev->nHeight + 1;
+        mapBlockIndex[vHash[i]] = &vBlock[i];
+    }
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    chainActive.SetTip(&vBlock[0]);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.push_back(CTxOut(COIN, CScript(), 1));
+    CWalletTx wtx(pwalletMain, tx);
+    wtx.hashBlock = vHash[0];
+    wtx.nIndex = 0;
+    wtx.fMerkleVerified = true;
+    BOOST_CHECK_EQUAL(wtx.GetDepthInMainChain(), 1);
+
+    // Extending the chain keeps the cached block.
+    chainActive.SetTip(&vBlock[2]);
+    BOOST_CHECK_EQUAL(wtx.GetDepthInMainChain(), 3);
+
+    // A reorganization drops it, the transaction is in neither the chain nor the mempool.
+    chainActive.SetTip(&vBlock[4]);
+    BOOST_CHECK_EQUAL(wtx.GetDepthInMainChain(), -1);
+
+    // Marking the transaction dirty drops it as well.
+    wtx.hashBlock = vHash[3];
+    BOOST_CHECK_EQUAL(wtx.GetDepthInMainChain(), -1);
+    wtx.MarkDirty();
+    BOOST_CHECK_EQUAL(wtx.GetDepthInMainChain(), 2);
+
+    chainActive.SetTip(pindexGenesis);
+    for (int i = 0; i < 5; i++)
+        mapBlockIndex.erase(vHash[i]);
+}
+
+// A wallet whose transactions are built from the payments alone. More than three payments
+// are too large for one transaction, and a payment of nRejected cannot be funded.
+class CBatchWallet : public CWallet
+{
+public:
+    static const CAmount nRejected = 99;
+
+    //! the source of each transaction created, and the transactions committed before it
+    vector<pair<pair<string, type_Color>, size_t> > vCreated;
+    map<uint256, CTransaction> mapCommitted;
+    uint256 hashLastCommitted;
+
+    bool CreateTransaction(const vector<CRecipient>& vecSend, const type_Color& send_color, CWalletTx& wtxNew,
+                           CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosRet, string& strFailReason,
+                           const CCoinControl *coinControl, const string& strFromAddress, const string& feeFromAddress,
+                           CreateTxFailure* pFailureRet)
+    {
+        *pFailureRet = CREATE_TX_FAILED;
+        if (vecSend.size() > 3) {
+            // The reason is not looked at, only the failure is
+            strFailReason = "too many payments";
+            *pFailureRet = CREATE_TX_TOO_LARGE;
+            return false;
+        }
+        CMutableTransaction tx;
+        // Spend the change of the transaction committed last
+        tx.vin.push_back(CTxIn(COutPoint(hashLastCommitted, 0)));
+        BOOST_FOREACH(const CRecipient& recipient, vecSend) {
+            if (recipient.nAmount == nRejected) {
+                strFailReason = _("Insufficient funds");
+                return false;
+            }
+            tx.vout.push_back(CTxOut(recipient.nAmount, recipient.scriptPubKey, send_color));
+        }
+        wtxNew = CWalletTx(this, tx);
+        vCreated.push_back(make_pair(make_pair(strFromAddress, send_color), mapCommitted.size()));
+        return true;
+    }
+
+    bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
+    {
+        mapCommitted[wtxNew.GetHash()] = wtxNew;
+        hashLastCommitted = wtxNew.GetHash();
+        return true;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(send_batch_tests)
+{
+    CScript scriptPay = GetScriptForDestination(CKeyID(uint160(vector<unsigned char>(20, 1))));
+    const char* from[] = {"A", "B", "A", "A", "A", "A", "A", "A", "A", "B"};
+    type_Color color[] = {1, 1, 2, 1, 1, 1, 1, 1, 1, 1};
+    CAmount amount[] = {1, CBatchWallet::nRejected, 2, 3, 4, 5, 6, 7, 8, 9};
+    vector<CBatchPayment> vPayment;
+    for (unsigned int i = 0; i < sizeof(amount) / sizeof(amount[0]); i++) {
+        CRecipient recipient = {scriptPay, amount[i], false};
+        CBatchPayment payment = {from[i], color[i], recipient};
+        vPayment.push_back(payment);
+    }
+
+    CBatchWallet walletBatch;
+    vector<pair<uint256, string> > vResult;
+    BOOST_CHECK_EQUAL(walletBatch.SendBatch(vPayment, vResult), 4);
+    BOOST_CHECK_EQUAL(vResult.size(), vPayment.size());
+    BOOST_CHECK_EQUAL(walletBatch.mapCommitted.size(), 4U);
+
+    // The seven payments of A in color 1 are halved until they fit, in three transactions
+    // in the order they come, before the group of A in color 2.
+    BOOST_CHECK_EQUAL(walletBatch.vCreated.size(), 4U);
+    for (unsigned int i = 0; i < walletBatch.vCreated.size(); i++) {
+        BOOST_CHECK(walletBatch.vCreated[i].first == make_pair(string("A"), (type_Color)(i < 3 ? 1 : 2)));
+        // Each transaction is created once the previous one is committed, so it may spend its change
+        BOOST_CHECK_EQUAL(walletBatch.vCreated[i].second, i);
+    }
+    BOOST_CHECK(vResult[0].first == vResult[3].first);
+    BOOST_CHECK(vResult[4].first == vResult[5].first && vResult[5].first == vResult[6].first);
+    BOOST_CHECK(vResult[7].first == vResult[8].first);
+    BOOST_CHECK(vResult[0].first != vResult[4].first && vResult[4].first != vResult[7].first);
+    BOOST_CHECK(vResult[2].first != vResult[0].first);
+
+    // Each payment sent has the txid of the transaction paying it
+    for (unsigned int i = 0; i < vPayment.size(); i++) {
+        if (vResult[i].first.IsNull())
+            continue;
+        BOOST_CHECK(vResult[i].second.empty());
+        BOOST_REQUIRE(walletBatch.mapCommitted.count(vResult[i].first));
+        const CTransaction& tx = walletBatch.mapCommitted[vResult[i].first];
+        bool fPaid = false;
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+            fPaid |= (txout.nValue == amount[i] && txout.color == color[i] && txout.scriptPubKey == scriptPay);
+        BOOST_CHECK(fPaid);
+    }
+
+    // The group of B cannot be funded, which is no matter of size, both of its payments have the error.
+    BOOST_CHECK(vResult[1].first.IsNull() && vResult[9].first.IsNull());
+    BOOST_CHECK_EQUAL(vResult[1].second, _("Insufficient funds"));
+    BOOST_CHECK_EQUAL(vResult[9].second, _("Insufficient funds"));
+}
+
+BOOST_AUTO_TEST_CASE(rescan_tests)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptMine = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptOther = GetScriptForDestination(CKeyID(uint160(vector<unsigned char>(20, 1))));
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+
+    // More blocks than one batch, each a coinbase and in turn: paying us, spending the
+    // coinbase before, paying us and spending it in the same block, or unrelated to us.
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    CBlockIndex* pindex = pindexGenesis;
+    CDiskBlockPos pos(1000, 0);
+    const int nBlocks = RESCAN_BATCH_SIZE + 20;
+    const int nSkipped = 51;
+    uint256 hashSkipped;
+    vector<CTransaction> vMine;
+    CTransaction txPrev;
+    for (int i = 0; i < nBlocks; i++) {
+        CBlock block;
+        vector<CTxOut> vSpent;
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << i;
+        coinbase.vout.push_back(CTxOut(COIN, i % 4 == 0 ? scriptMine : scriptOther, 1));
+        block.vtx.push_back(coinbase);
+        if (i % 4 == 0)
+            vMine.push_back(block.vtx.back());
+
+        if (i % 4 == 1) {
+            CMutableTransaction txSpend;
+            txSpend.vin.push_back(CTxIn(COutPoint(txPrev.GetHash(), 0)));
+            txSpend.vout.push_back(CTxOut(COIN, scriptOther, 1));
+            block.vtx.push_back(txSpend);
+            vMine.push_back(block.vtx.back());
+            vSpent.push_back(txPrev.vout[0]);
+        } else if (i % 4 == 2) {
+            CMutableTransaction txPay;
+            txPay.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+            txPay.vout.push_back(CTxOut(COIN, scriptMine, 1));
+            block.vtx.push_back(txPay);
+            CMutableTransaction txChained;
+            txChained.vin.push_back(CTxIn(COutPoint(txPay.GetHash(), 0)));
+            txChained.vout.push_back(CTxOut(COIN, scriptOther, 1));
+            block.vtx.push_back(txChained);
+            vMine.push_back(block.vtx[1]);
+            vMine.push_back(block.vtx[2]);
+            vSpent.push_back(CTxOut(COIN, scriptOther, 1));
+        }
+        txPrev = block.vtx[0];
+
+        if (i == nSkipped) {
+            // A block whose filter has none of our scripts is not read, paying us or not
+            BOOST_CHECK(i % 4 == 3);
+            CBlock blockFilter = block;
+            coinbase.vout[0].scriptPubKey = scriptMine;
+            block.vtx[0] = coinbase;
+            hashSkipped = block.vtx[0].GetHash();
+            pindex = add_rescan_block(block, pindex, pos, vSpent, &blockFilter);
+        } else
+            pindex = add_rescan_block(block, pindex, pos, vSpent);
+    }
+
+    // The blocks are scanned one by one by a single thread into another wallet,
+    // passing over the block the filter skips.
+    CWallet walletSerial("wallet_serial.dat");
+    bool fFirstRun;
+    walletSerial.LoadWallet(fFirstRun);
+    {
+        LOCK2(cs_main, walletSerial.cs_wallet);
+        BOOST_CHECK(walletSerial.AddKeyPubKey(key, key.GetPubKey()));
+        for (CBlockIndex* pindexScan = chainActive.Next(pindexGenesis); pindexScan; pindexScan = chainActive.Next(pindexScan)) {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, pindexScan));
+            if (block.vtx[0].GetHash() == hashSkipped)
+                continue;
+            BOOST_FOREACH(const CTransaction& tx, block.vtx)
+                walletSerial.AddToWalletIfInvolvingMe(tx, &block, true);
+        }
+    }
+
+    int nScriptCheckThreadsOld = nScriptCheckThreads;
+    nScriptCheckThreads = 4;
+    BOOST_CHECK_EQUAL(pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true), (int)vMine.size());
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        BOOST_CHECK_EQUAL(pwalletMain->mapWallet.size(), vMine.size());
+        BOOST_CHECK_EQUAL(pwalletMain->mapWallet.size(), walletSerial.mapWallet.size());
+        BOOST_FOREACH(const CTransaction& tx, vMine) {
+            map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.find(tx.GetHash());
+            map<uint256, CWalletTx>::const_iterator itSerial = walletSerial.mapWallet.find(tx.GetHash());
+            BOOST_REQUIRE(it != pwalletMain->mapWallet.end() && itSerial != walletSerial.mapWallet.end());
+            BOOST_CHECK(it->second.hashBlock == itSerial->second.hashBlock);
+            BOOST_CHECK_EQUAL(it->second.nIndex, itSerial->second.nIndex);
+        }
+        BOOST_CHECK(!pwalletMain->mapWallet.count(hashSkipped));
+        BOOST_CHECK_EQUAL(pwalletMain->GetColorBalance(1), walletSerial.GetColorBalance(1));
+    }
+
+    erase_rescan_blocks(pindex, pindexGenesis);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
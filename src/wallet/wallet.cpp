@@ -7,6 +7,7 @@
 #include "wallet/wallet.h"
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "checkpoints.h"
 #include "coincontrol.h"
 #include "consensus/consensus.h"
@@ -18,7 +19,9 @@
 #include "net.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "script/standard.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
@@ -26,7 +29,9 @@
 #include <cassert>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -451,6 +456,9 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
+    // The spent output leaves the balances, also when a rescan finds the spend
+    if (mapWallet.count(outpoint.hash))
+        MarkBalanceDirty(outpoint.hash);
 
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -759,6 +767,7 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
+        MarkBalanceDirty(hash);
         map<uint256, CWalletTx>::iterator ittx = mapWallet.find(hash);
         for (unsigned int i = 0; ittx != mapWallet.end() && i < ittx->second.vout.size(); i++) {
             map<string, set<pair<uint256, unsigned int> > >::iterator itaddr = mapWalletAddr.find(GetDestination(ittx->second.vout[i].scriptPubKey));
@@ -1036,50 +1045,208 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb)
     return pwalletdb->WriteTx(GetHash(), *this);
 }
 
+/**
+ * A batch of blocks to rescan. Worker threads read the blocks from the
+ * positions picked under cs_main and find the transactions paying to the
+ * wallet keys under cs_wallet, the matches are then added to the wallet in
+ * order by ScanForWalletTransactions. The blocks whose filter has none of the
+ * wallet scripts are not read.
+ */
+class CRescanBatch
+{
+public:
+    struct Block
+    {
+        CBlockIndex* pindex;
+        //! taken from pindex under cs_main, the workers do not look at the block index
+        uint256 hash;
+        CDiskBlockPos pos;
+        CBlock block;
+        //! whether each transaction has an output of ours
+        std::vector<bool> vMine;
+        bool fFiltered;
+    };
+
+    std::vector<Block> vBlock;
+
+private:
+    const CWallet* pwallet;
+    const std::vector<std::vector<unsigned char> >* pvScripts;
+    boost::mutex mutex;
+    size_t nNext;
+    boost::scoped_ptr<boost::thread_group> threads;
+
+    void ThreadRead()
+    {
+        while (true) {
+            size_t n;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (nNext >= vBlock.size())
+                    return;
+                n = nNext++;
+            }
+            Block& b = vBlock[n];
+            CBloomFilter filter;
+            if (pblocktree->ReadBlockFilter(b.hash, filter) && !BlockFilterMatchAny(filter, *pvScripts)) {
+                b.fFiltered = true;
+                continue;
+            }
+            if (!ReadBlockFromDisk(b.block, b.pos) || b.block.GetHash() != b.hash) {
+                b.block.SetNull();
+                continue;
+            }
+            // The keys may change meanwhile, only the reading above runs without the wallet lock
+            LOCK(pwallet->cs_wallet);
+            b.vMine.resize(b.block.vtx.size());
+            for (unsigned int i = 0; i < b.block.vtx.size(); i++)
+                b.vMine[i] = pwallet->IsMine(b.block.vtx[i]);
+        }
+    }
+
+public:
+    CRescanBatch(const CWallet* pwalletIn, const std::vector<std::vector<unsigned char> >* pvScriptsIn) :
+        pwallet(pwalletIn), pvScripts(pvScriptsIn), nNext(0) {}
+    ~CRescanBatch() { Wait(); }
+
+    //! Start reading the blocks of the active chain from pindex, return the block after them
+    CBlockIndex* Start(CBlockIndex* pindex, int nThreads)
+    {
+        AssertLockHeld(cs_main);
+        vBlock.clear();
+        nNext = 0;
+        for (; pindex && vBlock.size() < RESCAN_BATCH_SIZE; pindex = chainActive.Next(pindex)) {
+            vBlock.push_back(Block());
+            vBlock.back().pindex = pindex;
+            vBlock.back().hash = pindex->GetBlockHash();
+            vBlock.back().pos = pindex->GetBlockPos();
+            vBlock.back().fFiltered = false;
+        }
+        threads.reset(new boost::thread_group());
+        for (int i = 0; i < nThreads && i < (int)vBlock.size(); i++)
+            threads->create_thread(boost::bind(&CRescanBatch::ThreadRead, this));
+        return pindex;
+    }
+
+    void Wait()
+    {
+        if (threads) {
+            threads->join_all();
+            threads.reset();
+        }
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
- * exist in the wallet will be updated.
+ * exist in the wallet will be updated. The caller must not hold cs_wallet,
+ * which the threads reading the blocks take while it waits for them.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
+    AssertLockNotHeld(cs_wallet);
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMillis();
+    int nBlocks = 0, nFiltered = 0;
     const CChainParams& chainParams = Params();
-
+    int nThreads = std::max(1, nScriptCheckThreads);
+    std::vector<std::vector<unsigned char> > vScripts;
+    GetFilterScripts(vScripts);
+
+    // cs_main is only held to pick the next blocks and to add the transactions
+    // found in them, so the node is not blocked while the blocks are read.
+    CRescanBatch batch1(this, &vScripts), batch2(this, &vScripts);
+    CRescanBatch *pbatch = &batch1, *pbatchNext = &batch2;
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
+        // The start was picked before the locks were taken, a reorg since then
+        // leaves it off the active chain, the scan goes on from the fork
+        if (pindex && !chainActive.Contains(pindex)) {
+            const CBlockIndex* pindexFork = chainActive.FindFork(pindex);
+            pindex = pindexFork ? chainActive[pindexFork->nHeight] : chainActive.Genesis();
+        }
+
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH(CTransaction& tx, block.vtx) {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+        pindex = pbatch->Start(pindex, nThreads);
+    }
+    while (!pbatch->vBlock.empty()) {
+        pbatch->Wait();
+        {
+            LOCK2(cs_main, cs_wallet);
+            // Read the next blocks while the ones read are added.
+            if (pindex && !chainActive.Contains(pindex))
+                pindex = chainActive.Next(chainActive.FindFork(pindex));
+            pindex = pbatchNext->Start(pindex, nThreads);
+
+            BOOST_FOREACH(CRescanBatch::Block& b, pbatch->vBlock) {
+                // The blocks disconnected since they were picked are left to SyncTransaction.
+                if (!chainActive.Contains(b.pindex))
+                    continue;
+                if (b.fFiltered)
+                    nFiltered++;
+                for (unsigned int i = 0; i < b.vMine.size(); i++) {
+                    const CTransaction& tx = b.block.vtx[i];
+                    // Only transactions paying us, already in the wallet or spending
+                    // from the wallet may be added, the others need not be looked at.
+                    bool fRelevant = b.vMine[i] || mapWallet.count(tx.GetHash());
+                    for (unsigned int j = 0; !fRelevant && j < tx.vin.size(); j++)
+                        fRelevant = mapWallet.count(tx.vin[j].prevout.hash);
+                    if (fRelevant && AddToWalletIfInvolvingMe(tx, &b.block, fUpdate))
+                        ret++;
+                }
             }
-            pindex = chainActive.Next(pindex);
+            nBlocks += pbatch->vBlock.size();
+
+            CBlockIndex* pindexLast = pbatch->vBlock.back().pindex;
+            if (dProgressTip - dProgressStart > 0.0)
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexLast, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s\n", pindexLast->nHeight,
+                    Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexLast), 1000.0 * nBlocks / std::max((int64_t)1, GetTimeMillis() - nStart));
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        std::swap(pbatch, pbatchNext);
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    LogPrint("bench", "Rescanned %d blocks in %dms (%.1f blocks/s), %d skipped by their filter\n", nBlocks, GetTimeMillis() - nStart,
+        1000.0 * nBlocks / std::max((int64_t)1, GetTimeMillis() - nStart), nFiltered);
     return ret;
 }
 
+void CWallet::GetFilterScripts(vector<vector<unsigned char> >& vScripts) const
+{
+    vScripts.clear();
+    LOCK(cs_KeyStore);
+    // The block filters hold the pay-to-pubkey and multisig keys as key hashes.
+    set<CKeyID> setKeyId;
+    GetKeys(setKeyId);
+    for (map<CKeyID, CHDPubKey>::const_iterator it = mapHDPubKeys.begin(); it != mapHDPubKeys.end(); ++it)
+        setKeyId.insert(it->first);
+    BOOST_FOREACH(const CKeyID& keyid, setKeyId) {
+        CScript script = GetScriptForDestination(keyid);
+        vScripts.push_back(vector<unsigned char>(script.begin(), script.end()));
+    }
+    for (ScriptMap::const_iterator it = mapScripts.begin(); it != mapScripts.end(); ++it) {
+        CScript script = GetScriptForDestination(it->first);
+        vScripts.push_back(vector<unsigned char>(script.begin(), script.end()));
+    }
+    BOOST_FOREACH(const CScript& script, setWatchOnly)
+        vScripts.push_back(vector<unsigned char>(script.begin(), script.end()));
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -1200,6 +1367,22 @@ CAmount CWalletTx::GetCredit(const isminefilter& filter) const
     return credit;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    nAvailableCreditCached.clear();
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    MarkConfirmDirty();
+    if (pwallet)
+        pwallet->MarkBalanceDirty(GetHash());
+}
+
 CAmount CWalletTx::GetImmatureCredit(bool fUseCache) const
 {
     if (IsCoinBase() && GetBlocksToMaturity() > 0 && IsInMainChain())
@@ -1468,18 +1651,243 @@ CAmount CWallet::GetSendLicenseBalance(const type_Color& color) const
     return nTotal;
 }
 
+void CBalanceLedger::Add(const Entry& entry, int nSign)
+{
+    Key key(entry.strAddress, make_pair((int)entry.state, entry.color));
+    pair<CAmount, int>& total = mapTotal[key];
+    total.first += nSign * entry.nValue;
+    total.second += nSign;
+    if (total.second == 0)
+        mapTotal.erase(key);
+}
+
+void CBalanceLedger::Set(const uint256& hash, const vector<Entry>& entries)
+{
+    Erase(hash);
+    if (entries.empty())
+        return;
+    BOOST_FOREACH(const Entry& entry, entries)
+        Add(entry, 1);
+    mapEntries[hash] = entries;
+}
+
+void CBalanceLedger::Erase(const uint256& hash)
+{
+    map<uint256, vector<Entry> >::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return;
+    BOOST_FOREACH(const Entry& entry, it->second)
+        Add(entry, -1);
+    mapEntries.erase(it);
+}
+
+void CBalanceLedger::Clear()
+{
+    mapTotal.clear();
+    mapEntries.clear();
+}
+
+CAmount CBalanceLedger::Get(const string& strAddress, State state, type_Color color) const
+{
+    map<Key, pair<CAmount, int> >::const_iterator it = mapTotal.find(Key(strAddress, make_pair((int)state, color)));
+    return it == mapTotal.end() ? 0 : it->second.first;
+}
+
+void CBalanceLedger::Get(const string& strAddress, State state, map<type_Color, CAmount>& color_amount) const
+{
+    map<Key, pair<CAmount, int> >::const_iterator it = mapTotal.lower_bound(Key(strAddress, make_pair((int)state, (type_Color)0)));
+    for (; it != mapTotal.end() && it->first.first == strAddress && it->first.second.first == state; ++it)
+        color_amount[it->first.second.second] += it->second.first;
+}
+
+void CWalletCoinIndex::Set(const uint256& hash, const vector<pair<type_Color, Coin> >& coins)
+{
+    Erase(hash);
+    if (coins.empty())
+        return;
+    for (vector<pair<type_Color, Coin> >::const_iterator it = coins.begin(); it != coins.end(); ++it)
+        mapColorCoins[it->first].insert(it->second);
+    mapEntries[hash] = coins;
+}
+
+void CWalletCoinIndex::Erase(const uint256& hash)
+{
+    map<uint256, vector<pair<type_Color, Coin> > >::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return;
+    for (vector<pair<type_Color, Coin> >::const_iterator itcoin = it->second.begin(); itcoin != it->second.end(); ++itcoin) {
+        map<type_Color, set<Coin> >::iterator itcolor = mapColorCoins.find(itcoin->first);
+        itcolor->second.erase(itcoin->second);
+        if (itcolor->second.empty())
+            mapColorCoins.erase(itcolor);
+    }
+    mapEntries.erase(it);
+}
+
+void CWalletCoinIndex::Clear()
+{
+    mapColorCoins.clear();
+    mapEntries.clear();
+}
+
+const set<CWalletCoinIndex::Coin>* CWalletCoinIndex::Get(type_Color color) const
+{
+    map<type_Color, set<Coin> >::const_iterator it = mapColorCoins.find(color);
+    return it == mapColorCoins.end() ? NULL : &it->second;
+}
+
+bool CWalletCoinIndex::GetAfter(pair<type_Color, Coin>& pos, unsigned int nMax, vector<pair<type_Color, Coin> >& coins) const
+{
+    map<type_Color, set<Coin> >::const_iterator itcolor = mapColorCoins.lower_bound(pos.first);
+    if (itcolor == mapColorCoins.end())
+        return false;
+    set<Coin>::const_iterator it = itcolor->first == pos.first ? itcolor->second.upper_bound(pos.second) : itcolor->second.begin();
+    while (coins.size() < nMax) {
+        if (it == itcolor->second.end()) {
+            if (++itcolor == mapColorCoins.end())
+                return false;
+            it = itcolor->second.begin();
+        }
+        pos = make_pair(itcolor->first, *it);
+        coins.push_back(pos);
+        ++it;
+    }
+    return it != itcolor->second.end() || ++itcolor != mapColorCoins.end();
+}
+
+void CWalletCoinIndex::GetTransactions(type_Color color, set<uint256>& setTx) const
+{
+    const set<Coin>* pcoins = Get(color);
+    if (!pcoins)
+        return;
+    for (set<Coin>::const_iterator it = pcoins->begin(); it != pcoins->end(); ++it)
+        setTx.insert(it->second.hash);
+}
+
+bool CWallet::GetBalanceEntries(const CWalletTx& wtx, vector<CBalanceLedger::Entry>& entries) const
+{
+    entries.clear();
+    const uint256& hash = wtx.GetHash();
+    int nDepth = wtx.GetDepthInMainChain();
+
+    // Must wait until coinbase is safely deep enough in the chain before valuing it
+    if (wtx.IsCoinBase() && wtx.GetBlocksToMaturity() > 0) {
+        if (nDepth > 0 && !wtx.vout.empty())
+            entries.push_back(CBalanceLedger::Entry("", CBalanceLedger::IMMATURE, wtx.vout[0].color, GetCredit(wtx, ISMINE_SPENDABLE)));
+        return true;
+    }
+
+    bool fTrusted = wtx.IsTrusted();
+    bool fFinal = IsFinalTx(wtx, chainActive.Height(), GetAdjustedTime());
+    bool fConfirmed = fTrusted && (wtx.type == NORMAL || wtx.type == MINT || wtx.type == MATCH || wtx.type == CANCEL || wtx.type == ORDER);
+    bool fUnconfirmed = !fFinal || (!fTrusted && nDepth == 0);
+    if (!fConfirmed && !fUnconfirmed)
+        return nDepth < 1;
+
+    for (unsigned int i = wtx.type == ORDER ? 2 : 0; i < wtx.vout.size(); i++) {
+        if (IsSpent(hash, i))
+            continue;
+        const CTxOut& txout = wtx.vout[i];
+        CAmount nCredit = GetCredit(txout, ISMINE_SPENDABLE);
+        if (fConfirmed)
+            entries.push_back(CBalanceLedger::Entry("", CBalanceLedger::CONFIRMED, txout.color, nCredit));
+        if (fUnconfirmed)
+            entries.push_back(CBalanceLedger::Entry("", CBalanceLedger::UNCONFIRMED, txout.color, nCredit));
+        if (fConfirmed && IsMine(txout) != ISMINE_NO && txout.nValue > 0)
+            entries.push_back(CBalanceLedger::Entry(GetDestination(txout.scriptPubKey),
+                nDepth >= 1 ? CBalanceLedger::ADDRESS_CONFIRMED : CBalanceLedger::ADDRESS_PENDING, txout.color, txout.nValue));
+    }
+    return nDepth < 1;
+}
+
+void CWallet::GetUnspentCoins(const CWalletTx& wtx, vector<pair<type_Color, CWalletCoinIndex::Coin> >& coins) const
+{
+    coins.clear();
+    const uint256& hash = wtx.GetHash();
+    // Conflicted transactions come back when their depth does, see UpdateBalanceLedger.
+    if (wtx.GetDepthInMainChain() < 0)
+        return;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        const CTxOut& txout = wtx.vout[i];
+        if (IsMine(txout) != ISMINE_NO && !IsSpent(hash, i))
+            coins.push_back(make_pair(txout.color, CWalletCoinIndex::Coin(txout.nValue, COutPoint(hash, i))));
+    }
+}
+
+void CWallet::UpdateBalanceLedger() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // The transactions not in a block yet, or not mature, may change state
+    // with the tip or the mempool without being marked dirty, and so may the
+    // outputs they spend.
+    unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (pindexBalance != chainActive.Tip() || nBalanceMempoolUpdated != nMempoolUpdated) {
+        BOOST_FOREACH(const uint256& hash, setBalanceDepth) {
+            setBalanceDirty.insert(hash);
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            BOOST_FOREACH(const CTxIn& txin, it->second.vin)
+                if (mapWallet.count(txin.prevout.hash))
+                    setBalanceDirty.insert(txin.prevout.hash);
+        }
+        pindexBalance = chainActive.Tip();
+        nBalanceMempoolUpdated = nMempoolUpdated;
+    }
+
+    set<uint256> setDirty;
+    setDirty.swap(setBalanceDirty);
+    vector<CBalanceLedger::Entry> entries;
+    vector<pair<type_Color, CWalletCoinIndex::Coin> > coins;
+    BOOST_FOREACH(const uint256& hash, setDirty) {
+        map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end()) {
+            balanceLedger.Erase(hash);
+            coinIndex.Erase(hash);
+            setBalanceDepth.erase(hash);
+            continue;
+        }
+        if (GetBalanceEntries(it->second, entries))
+            setBalanceDepth.insert(hash);
+        else
+            setBalanceDepth.erase(hash);
+        balanceLedger.Set(hash, entries);
+        GetUnspentCoins(it->second, coins);
+        coinIndex.Set(hash, coins);
+    }
+}
+
+bool CWallet::CheckBalanceLedger() const
+{
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceLedger();
+
+    CBalanceLedger ledger;
+    CWalletCoinIndex index;
+    vector<CBalanceLedger::Entry> entries;
+    vector<pair<type_Color, CWalletCoinIndex::Coin> > coins;
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        GetBalanceEntries(it->second, entries);
+        ledger.Set(it->first, entries);
+        GetUnspentCoins(it->second, coins);
+        index.Set(it->first, coins);
+    }
+    if (ledger == balanceLedger && index == coinIndex)
+        return true;
+    LogPrintf("%s: balance ledger or coin index does not match the wallet transactions\n", __func__);
+    return false;
+}
+
 void CWallet::GetBalance(map<type_Color, CAmount>& color_amount) const
 {
     color_amount.clear();
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted() && (pcoin->type == NORMAL || pcoin->type == MINT || pcoin->type == MATCH || pcoin->type == CANCEL || pcoin->type == ORDER)) {
-                pcoin->GetAvailableCredit(color_amount);
-            }
-        }
+        UpdateBalanceLedger();
+        balanceLedger.Get("", CBalanceLedger::CONFIRMED, color_amount);
     }
     return;
 }
@@ -1491,6 +1899,15 @@ void CWallet::GetAddressBalance(const string& strAddress, map<type_Color, CAmoun
 
     {
         LOCK2(cs_main, cs_wallet);
+        // The ledger separates the outputs in a block from the trusted ones that are not.
+        if (nMinDepth <= 1) {
+            UpdateBalanceLedger();
+            balanceLedger.Get(strAddress, CBalanceLedger::ADDRESS_CONFIRMED, color_amount);
+            if (nMinDepth <= 0)
+                balanceLedger.Get(strAddress, CBalanceLedger::ADDRESS_PENDING, color_amount);
+            return;
+        }
+
         map<string, set<pair<uint256, unsigned int> > >::const_iterator itaddr = mapWalletAddr.find(strAddress);
         if (itaddr == mapWalletAddr.end()) return;
 
@@ -1564,17 +1981,9 @@ CAmount CWallet::GetColorBalanceFromFixedAddress(const string& strFromAddress, c
 
 CAmount CWallet::GetColorBalance(const type_Color& color) const
 {
-    CAmount nTotal = 0;
-
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted() && (pcoin->type == NORMAL || pcoin->type == MINT || pcoin->type == MATCH || pcoin->type == CANCEL || pcoin->type == ORDER))
-                nTotal += pcoin->GetAvailableColorCredit(color);
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceLedger();
+    return balanceLedger.Get("", CBalanceLedger::CONFIRMED, color);
 }
 
 void CWallet::GetUnconfirmedBalance(map<type_Color, CAmount>& color_amount) const
@@ -1583,13 +1992,8 @@ void CWallet::GetUnconfirmedBalance(map<type_Color, CAmount>& color_amount) cons
 
     {
         LOCK2(cs_main, cs_wallet);
-
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin, chainActive.Height(), GetAdjustedTime()) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0)) {
-                pcoin->GetAvailableCredit(color_amount);
-            }
-        }
+        UpdateBalanceLedger();
+        balanceLedger.Get("", CBalanceLedger::UNCONFIRMED, color_amount);
     }
     return;
 }
@@ -1597,32 +2001,16 @@ void CWallet::GetUnconfirmedBalance(map<type_Color, CAmount>& color_amount) cons
 
 CAmount CWallet::GetUnconfirmedColorBalance(const type_Color& color) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!IsFinalTx(*pcoin, chainActive.Height(), GetAdjustedTime()) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
-                nTotal += pcoin->GetAvailableColorCredit(color);
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceLedger();
+    return balanceLedger.Get("", CBalanceLedger::UNCONFIRMED, color);
 }
 
 CAmount CWallet::GetImmatureBalance(const type_Color& color) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx* pcoin = &(*it).second;
-            if (color == pcoin->vout[0].color)
-                nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceLedger();
+    return balanceLedger.Get("", CBalanceLedger::IMMATURE, color);
 }
 
 CAmount CWallet::GetWatchOnlyBalance(const type_Color& color) const
@@ -1677,8 +2065,16 @@ void CWallet::AvailableCoinsForType(vector<COutput>& vCoins, const type_Color& s
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
+        UpdateBalanceLedger();
+        // Only the admin mints and the licenses of send_color can be used
+        set<uint256> setTx;
+        coinIndex.GetTransactions(DEFAULT_ADMIN_COLOR, setTx);
+        if (type == LICENSE)
+            coinIndex.GetTransactions(send_color, setTx);
+        BOOST_FOREACH(const uint256& wtxid, setTx) {
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx* pcoin = &(*it).second;
             bool fMintLicense = false;
 
@@ -1776,38 +2172,61 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, const type_Color& color, b
                     vCoins.push_back(COutput(pcoin, index, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO));
             }
         } else {
-            for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-                const uint256& wtxid = it->first;
-                const CWalletTx* pcoin = &(*it).second;
+            UpdateBalanceLedger();
+            const set<CWalletCoinIndex::Coin>* pcoins = coinIndex.Get(color);
+            if (!pcoins)
+                return;
+            for (set<CWalletCoinIndex::Coin>::const_iterator itcoin = pcoins->begin(); itcoin != pcoins->end(); ++itcoin)
+                AddAvailableCoin(vCoins, itcoin->second, fOnlyConfirmed, coinControl, fIncludeZeroValue);
+        }
+    }
+}
 
-                if (!CheckFinalTx(*pcoin))
-                    continue;
+void CWallet::AddAvailableCoin(vector<COutput>& vCoins, const COutPoint& outpoint, bool fOnlyConfirmed, const CCoinControl *coinControl,
+                                bool fIncludeZeroValue) const
+{
+    const uint256& wtxid = outpoint.hash;
+    const unsigned int& i = outpoint.n;
+    map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+    if (it == mapWallet.end())
+        return;
+    const CWalletTx* pcoin = &(*it).second;
 
-                if (fOnlyConfirmed && !pcoin->IsTrusted())
-                    continue;
+    if (!CheckFinalTx(*pcoin))
+        return;
 
-                if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
-                    continue;
+    if (fOnlyConfirmed && !pcoin->IsTrusted())
+        return;
 
+    if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0)
+        return;
 
-                if (!(pcoin->type == NORMAL || pcoin->type == MINT || pcoin->type == MATCH || pcoin->type == CANCEL || pcoin->type == ORDER))
-                    continue;
+    if (!(pcoin->type == NORMAL || pcoin->type == MINT || pcoin->type == MATCH || pcoin->type == CANCEL || pcoin->type == ORDER))
+        return;
 
-                int nDepth = pcoin->GetDepthInMainChain();
-                if (nDepth < 0)
-                    continue;
-                unsigned int i = pcoin->type == ORDER? 2: 0;
-                for (; i < pcoin->vout.size(); i++) {
-                    if (pcoin->vout[i].color != color)
-                        continue;
-                    isminetype mine = IsMine(pcoin->vout[i]);
-                    if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO && !IsLockedCoin((*it).first, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                            (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected((*it).first, i)))
-                        vCoins.push_back(COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO));
-                }
-            }
-        }
-    }
+    // the first two outputs of an order are not spendable by the wallet
+    if (pcoin->type == ORDER && i < 2)
+        return;
+
+    int nDepth = pcoin->GetDepthInMainChain();
+    if (nDepth < 0)
+        return;
+    isminetype mine = IsMine(pcoin->vout[i]);
+    if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO && !IsLockedCoin(wtxid, i) && (pcoin->vout[i].nValue > 0 || fIncludeZeroValue) &&
+            (!coinControl || !coinControl->HasSelected() || coinControl->IsSelected(wtxid, i)))
+        vCoins.push_back(COutput(pcoin, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO));
+}
+
+bool CWallet::AvailableCoinsAfter(vector<COutput>& vCoins, pair<type_Color, CWalletCoinIndex::Coin>& pos, unsigned int nMax, bool fOnlyConfirmed) const
+{
+    vCoins.clear();
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalanceLedger();
+    vector<pair<type_Color, CWalletCoinIndex::Coin> > coins;
+    bool fMore = coinIndex.GetAfter(pos, nMax, coins);
+    for (vector<pair<type_Color, CWalletCoinIndex::Coin> >::const_iterator it = coins.begin(); it != coins.end(); ++it)
+        AddAvailableCoin(vCoins, it->second.second, fOnlyConfirmed, NULL, false);
+    return fMore;
 }
 
 static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*, unsigned int> > > vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
@@ -2081,8 +2500,11 @@ bool CWallet::CreateTypeTransaction(const std::vector<CRecipient>& vecSend, cons
 }
 
 bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, const type_Color& send_color, CWalletTx& wtxNew,
-                            CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosRet, string& strFailReason, const CCoinControl *coinControl, const string& strFromAddress, const string& feeFromAddress)
+                            CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosRet, string& strFailReason, const CCoinControl *coinControl, const string& strFromAddress, const string& feeFromAddress,
+                            CreateTxFailure* pFailureRet)
 {
+    if (pFailureRet)
+        *pFailureRet = CREATE_TX_FAILED;
     CAmount nValue = 0;
     unsigned int nSubtractFeeFromAmount = 0;
 
@@ -2290,6 +2712,8 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, const type_Co
                 unsigned int nBytes = ::GetSerializeSize(*(CTransaction*)&wtxNew, SER_NETWORK, PROTOCOL_VERSION);
                 if (nBytes >= MAX_STANDARD_TX_SIZE) {
                     strFailReason = _("Transaction too large");
+                    if (pFailureRet)
+                        *pFailureRet = CREATE_TX_TOO_LARGE;
                     return false;
                 }
                 dPriority = wtxNew.ComputePriority(dPriority, nBytes);
@@ -2314,6 +2738,8 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, const type_Co
                 // because we must be at the maximum allowed fee.
                 if (nFeeNeeded < ::minRelayTxFee.GetFee(nBytes)) {
                     strFailReason = _("Transaction too large for fee policy");
+                    if (pFailureRet)
+                        *pFailureRet = CREATE_TX_TOO_LARGE;
                     return false;
                 }
 
@@ -2685,49 +3111,117 @@ bool CWallet::CreateCancel(uint256& txhash, CWalletTx& wtxNew, string& strFailRe
 // Call after CreateTransaction unless you want to abort
 bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
 {
-    {
-        LOCK2(cs_main, cs_wallet);
-        LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
-        {
-            // This is only to keep the database open to defeat the auto-flush for the
-            // duration of this scope.  This is the only place where this optimization
-            // maybe makes sense; please don't do it anywhere else.
-            CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile,"r+") : NULL;
-
-            // Take key pair from key pool so it won't be used again
-            // We dont want to change address now
-            // reservekey.KeepKey();
-
-            // Add tx to wallet, because if it has change it's also ours,
-            // otherwise just for transaction history.
-            AddToWallet(wtxNew, false, pwalletdb);
-
-            // Notify that old coins are spent
-            set<CWalletTx*> setCoins;
-            BOOST_FOREACH(const CTxIn& txin, wtxNew.vin) {
-                CWalletTx &coin = mapWallet[txin.prevout.hash];
-                coin.BindWallet(this);
-                NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
-            }
+    LOCK2(cs_main, cs_wallet);
+    LogPrintf("CommitTransaction:\n%s", wtxNew.ToString());
+
+    // This is only to keep the database open to defeat the auto-flush for the
+    // duration of this scope.  This is the only place where this optimization
+    // maybe makes sense; please don't do it anywhere else.
+    CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile,"r+") : NULL;
+
+    // Take key pair from key pool so it won't be used again
+    // We dont want to change address now
+    // reservekey.KeepKey();
+
+    bool fCommitted = CommitWalletTx(wtxNew, pwalletdb, false);
+
+    if (fFileBacked)
+        delete pwalletdb;
+    return fCommitted;
+}
+
+bool CWallet::CommitWalletTx(CWalletTx& wtxNew, CWalletDB* pwalletdb, bool fDropRejected)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (fDropRejected && fBroadcastTransactions && !wtxNew.AcceptToMemoryPool(false))
+        return false;
+
+    // Add tx to wallet, because if it has change it's also ours,
+    // otherwise just for transaction history.
+    AddToWallet(wtxNew, false, pwalletdb);
+
+    // Notify that old coins are spent
+    BOOST_FOREACH(const CTxIn& txin, wtxNew.vin) {
+        map<uint256, CWalletTx>::iterator it = mapWallet.find(txin.prevout.hash);
+        if (it == mapWallet.end())
+            continue;
+        it->second.BindWallet(this);
+        NotifyTransactionChanged(this, it->first, CT_UPDATED);
+    }
 
-            if (fFileBacked)
-                delete pwalletdb;
+    // Track how many getdata requests our transaction gets
+    mapRequestCount[wtxNew.GetHash()] = 0;
+
+    if (fBroadcastTransactions) {
+        // Broadcast
+        if (!fDropRejected && !wtxNew.AcceptToMemoryPool(false)) {
+            // This must not fail. The transaction has already been signed and recorded.
+            LogPrintf("CommitTransaction(): Error: Transaction not valid\n");
+            return false;
         }
+        wtxNew.RelayWalletTransaction();
+    }
+    return true;
+}
 
-        // Track how many getdata requests our transaction gets
-        mapRequestCount[wtxNew.GetHash()] = 0;
+int CWallet::SendBatch(const vector<CBatchPayment>& vPayment, vector<pair<uint256, string> >& vResult)
+{
+    LOCK2(cs_main, cs_wallet);
 
-        if (fBroadcastTransactions) {
-            // Broadcast
-            if (!wtxNew.AcceptToMemoryPool(false)) {
-                // This must not fail. The transaction has already been signed and recorded.
-                LogPrintf("CommitTransaction(): Error: Transaction not valid\n");
-                return false;
+    // Group the payments by the address and color they are sent from, in the order they come.
+    typedef pair<string, type_Color> Source;
+    vector<Source> vSource;
+    map<Source, vector<unsigned int> > mapSourcePayments;
+    for (unsigned int i = 0; i < vPayment.size(); i++) {
+        Source source(vPayment[i].strFromAddress, vPayment[i].color);
+        if (!mapSourcePayments.count(source))
+            vSource.push_back(source);
+        mapSourcePayments[source].push_back(i);
+    }
+
+    // The later transactions may spend the change of the earlier ones, which are committed first.
+    vResult.assign(vPayment.size(), make_pair(uint256(), string()));
+    int nTransactions = 0;
+    BOOST_FOREACH(const Source& source, vSource) {
+        const vector<unsigned int>& vIndex = mapSourcePayments[source];
+        size_t nFirst = 0;
+        while (nFirst < vIndex.size()) {
+            // Take all the payments left, and halve them until they fit in one transaction
+            size_t nCount = vIndex.size() - nFirst;
+            CWalletTx wtx;
+            CReserveKey keyChange(this);
+            string strError;
+            bool fCreated;
+            while (true) {
+                vector<CRecipient> vecSend;
+                for (size_t i = nFirst; i < nFirst + nCount; i++)
+                    vecSend.push_back(vPayment[vIndex[i]].recipient);
+                CAmount nFeeRequired = 0;
+                int nChangePosRet = -1;
+                CreateTxFailure failure;
+                strError.clear();
+                fCreated = CreateTransaction(vecSend, source.second, wtx, keyChange, nFeeRequired, nChangePosRet, strError, NULL, source.first, "", &failure);
+                if (fCreated || nCount == 1 || failure != CREATE_TX_TOO_LARGE)
+                    break;
+                nCount = (nCount + 1) / 2;
+            }
+
+            pair<uint256, string> result(uint256(), strError);
+            if (fCreated) {
+                if (CommitTransaction(wtx, keyChange)) {
+                    result.first = wtx.GetHash();
+                    nTransactions++;
+                } else
+                    result.second = "Transaction commit failed";
             }
-            wtxNew.RelayWalletTransaction();
+            for (size_t i = nFirst; i < nFirst + nCount; i++)
+                vResult[vIndex[i]] = result;
+            nFirst += nCount;
         }
     }
-    return true;
+    return nTransactions;
 }
 
 CAmount CWallet::GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarget, const CTxMemPool& pool)
@@ -2985,6 +3479,19 @@ void CWallet::ViewKeyPool(std::vector<CPubKey>& keys)
     }
 }
 
+void CWallet::ViewKeyPool(int64_t nAfter, unsigned int nMax, std::vector<std::pair<int64_t, CPubKey> >& keys)
+{
+    LOCK(cs_wallet);
+    CWalletDB walletdb(strWalletFile);
+
+    for (set<int64_t>::iterator it = setKeyPool.upper_bound(nAfter); it != setKeyPool.end() && keys.size() < nMax; it++) {
+        CKeyPool keypool;
+        if (!walletdb.ReadPool(*it, keypool))
+            throw runtime_error(_(__func__) + "() : read failed");
+        keys.push_back(make_pair(*it, keypool.vchPubKey));
+    }
+}
+
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
 {
     nIndex = -1;
@@ -3676,6 +4183,15 @@ bool CWallet::HDAddHDChain(const std::string& chainPathIn, bool generateMaster,
     return true;
 }
 
+/** Derive the children of extKey at the indices in vKeys, every nStride-th key starting at nStart */
+static void ThreadDeriveHDPubKeys(const CExtPubKey& extKey, std::vector<CHDPubKey>& vKeys, size_t nStart, size_t nStride)
+{
+    CExtPubKey childKey;
+    for (size_t i = nStart; i < vKeys.size(); i += nStride)
+        if (extKey.Derive(childKey, vKeys[i].nChild))
+            vKeys[i].pubkey = childKey.pubkey;
+}
+
 bool CWallet::HDGetChildPubKeyAtIndex(const HDChainID& chainID, CPubKey &pubKeyOut, unsigned int nIndex, bool internal)
 {
     AssertLockHeld(cs_wallet);
@@ -3722,6 +4238,130 @@ bool CWallet::HDGetNextChildPubKey(const HDChainID& chainIDIn, CPubKey &pubKeyOu
     return true;
 }
 
+void CWallet::GetUsedHDChildIndices(const HDChainID& chainID, bool internal, std::set<unsigned int>& setUsed)
+{
+    LOCK(cs_KeyStore);
+    for (std::map<CKeyID, CHDPubKey>::const_iterator it = mapHDPubKeys.begin(); it != mapHDPubKeys.end(); ++it)
+        if (it->second.chainHash == chainID && it->second.internal == internal)
+            setUsed.insert(it->second.nChild);
+}
+
+/** Set up hdPubKey for the first child index from nIndex on that is in neither setUsed nor setTaken */
+static void NextFreeHDChild(CHDPubKey& hdPubKey, unsigned int& nIndex, const std::set<unsigned int>& setUsed, const std::set<unsigned int>& setTaken,
+                            const HDChainID& chainID, const std::string& strChainPath, bool internal)
+{
+    while (setUsed.count(nIndex) || setTaken.count(nIndex))
+        nIndex++;
+    if (nIndex >= 0x80000000)
+        throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): No more available keys!");
+    hdPubKey.nChild = nIndex;
+    hdPubKey.chainHash = chainID;
+    hdPubKey.chainPath = strChainPath + "/" + itostr(nIndex);
+    hdPubKey.internal = internal;
+    hdPubKey.pubkey = CPubKey();
+}
+
+bool CWallet::HDGetNextChildPubKeys(const HDChainID& chainIDIn, unsigned int nCount, std::vector<CPubKey>& vPubKeyOut, const std::string& strAccount, bool internal)
+{
+    CHDChain chain;
+    HDChainID chainID = chainIDIn;
+    // Take the free child indices in one pass instead of searching the keystore for each key
+    std::set<unsigned int> setUsed;
+    {
+        LOCK(cs_wallet);
+        if (chainID.IsNull())
+            chainID = activeHDChain;
+
+        if (!GetChain(chainID, chain) || !chain.IsValid())
+            throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Selected chain is not vailid!");
+
+        if ( (internal && !chain.internalPubKey.pubkey.IsValid()) || !chain.externalPubKey.pubkey.IsValid())
+            throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Missing HD extended pubkey!");
+
+        GetUsedHDChildIndices(chainID, internal, setUsed);
+    }
+
+    std::string strChainPath = chain.chainPath;
+    boost::replace_all(strChainPath, "c", itostr(internal)); //replace the chain switch index
+
+    std::vector<CHDPubKey> vKeys(nCount);
+    std::set<unsigned int> setTaken;
+    unsigned int nIndex = 0;
+    BOOST_FOREACH(CHDPubKey& hdPubKey, vKeys) {
+        NextFreeHDChild(hdPubKey, nIndex, setUsed, setTaken, chainID, strChainPath, internal);
+        nIndex++;
+    }
+
+    // Derive the keys across threads without the wallet lock, each one taking every nThreads-th key
+    const CExtPubKey& extKey = internal ? chain.internalPubKey : chain.externalPubKey;
+    size_t nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), (int)vKeys.size()));
+    boost::thread_group threads;
+    for (size_t i = 1; i < nThreads; i++)
+        threads.create_thread(boost::bind(&ThreadDeriveHDPubKeys, boost::cref(extKey), boost::ref(vKeys), i, nThreads));
+    ThreadDeriveHDPubKeys(extKey, vKeys, 0, nThreads);
+    threads.join_all();
+
+    BOOST_FOREACH(const CHDPubKey& hdPubKey, vKeys)
+        if (!hdPubKey.pubkey.IsValid())
+            throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Key deriving failed!");
+
+    LOCK(cs_wallet);
+
+    // Other callers may have taken some of the indices meanwhile, derive those keys again at free ones
+    std::set<unsigned int> setNowUsed;
+    GetUsedHDChildIndices(chainID, internal, setNowUsed);
+    BOOST_FOREACH(const CHDPubKey& hdPubKey, vKeys)
+        if (!setNowUsed.count(hdPubKey.nChild))
+            setTaken.insert(hdPubKey.nChild);
+    BOOST_FOREACH(CHDPubKey& hdPubKey, vKeys) {
+        if (!setNowUsed.count(hdPubKey.nChild))
+            continue;
+        NextFreeHDChild(hdPubKey, nIndex, setNowUsed, setTaken, chainID, strChainPath, internal);
+        setTaken.insert(nIndex);
+        CExtPubKey childKey;
+        if (!extKey.Derive(childKey, hdPubKey.nChild))
+            throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Key deriving failed!");
+        hdPubKey.pubkey = childKey.pubkey;
+    }
+
+    // Write the keys and their address book entries in one database transaction
+    int64_t nCreationTime = GetTime();
+    CKeyMetadata meta(nCreationTime);
+    if (fFileBacked) {
+        CWalletDB walletdb(strWalletFile);
+        if (!walletdb.TxnBegin())
+            throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Starting the database transaction failed!");
+        BOOST_FOREACH(const CHDPubKey& hdPubKey, vKeys) {
+            std::string strAddress = CBitcoinAddress(hdPubKey.pubkey.GetID()).ToString();
+            if (!walletdb.WriteHDPubKey(hdPubKey, meta) ||
+                !walletdb.WritePurpose(strAddress, "receive") ||
+                !walletdb.WriteName(strAddress, strAccount)) {
+                walletdb.TxnAbort();
+                throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Writing pubkey failed!");
+            }
+        }
+        if (!walletdb.TxnCommit())
+            throw std::runtime_error("CWallet::HDGetNextChildPubKeys(): Committing the database transaction failed!");
+    }
+
+    if (!nTimeFirstKey || nCreationTime < nTimeFirstKey)
+        nTimeFirstKey = nCreationTime;
+
+    vPubKeyOut.clear();
+    vPubKeyOut.reserve(vKeys.size());
+    BOOST_FOREACH(const CHDPubKey& hdPubKey, vKeys) {
+        CKeyID keyID = hdPubKey.pubkey.GetID();
+        mapKeyMetadata[keyID] = meta;
+        LoadHDPubKey(hdPubKey);
+        bool fUpdated = mapAddressBook.count(keyID) > 0;
+        mapAddressBook[keyID].name = strAccount;
+        mapAddressBook[keyID].purpose = "receive";
+        NotifyAddressBookChanged(this, keyID, strAccount, true, "receive", (fUpdated ? CT_UPDATED : CT_NEW));
+        vPubKeyOut.push_back(hdPubKey.pubkey);
+    }
+    return true;
+}
+
 bool CWallet::EncryptHDSeeds(CKeyingMaterial& vMasterKeyIn)
 {
     EncryptSeeds();
@@ -3822,24 +4462,33 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(const CBlockIndex* &pindexRet) const
         return 0;
     AssertLockHeld(cs_main);
 
-    // Find the block it claims to be in
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi == mapBlockIndex.end())
-        return 0;
-    CBlockIndex* pindex = (*mi).second;
-    if (!pindex || !chainActive.Contains(pindex))
-        return 0;
+    // Extending the chain keeps the cached block, taking blocks off it does not
+    if (nConfirmEpochCached != chainActive.GetDisconnectEpoch()) {
+        pindexConfirmCached = NULL;
+        nConfirmEpochCached = chainActive.GetDisconnectEpoch();
 
-    // Make sure the merkle branch connects to this block
-    if (!fMerkleVerified)
-    {
-        if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->hashMerkleRoot)
+        // Find the block it claims to be in
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
             return 0;
-        fMerkleVerified = true;
+        CBlockIndex* pindex = (*mi).second;
+        if (!pindex || !chainActive.Contains(pindex))
+            return 0;
+
+        // Make sure the merkle branch connects to this block
+        if (!fMerkleVerified)
+        {
+            if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->hashMerkleRoot)
+                return 0;
+            fMerkleVerified = true;
+        }
+        pindexConfirmCached = pindex;
     }
+    if (!pindexConfirmCached)
+        return 0;
 
-    pindexRet = pindex;
-    return chainActive.Height() - pindex->nHeight + 1;
+    pindexRet = pindexConfirmCached;
+    return chainActive.Height() - pindexConfirmCached->nHeight + 1;
 }
 
 int CMerkleTx::GetDepthInMainChain(const CBlockIndex* &pindexRet) const
@@ -3885,6 +4534,72 @@ string CWallet::MatchOrder(vector<pair<uint256, uint256> >& matchlist, vector<ui
     return "";
 }
 
+// The output an ORDER transaction buys, which its MATCH pays out
+static bool GetOrderPayout(const uint256& hash, CTxOut& out)
+{
+    const CCoins* coins = pcoinsTip->AccessCoins(hash);
+    if (coins && coins->IsAvailable(1)) {
+        out = coins->vout[1];
+        return true;
+    }
+    CTransaction order;
+    uint256 hashBlock;
+    if (!GetTransaction(hash, order, hashBlock, NULL, true) || order.vout.size() < 2)
+        return false;
+    out = order.vout[1];
+    return true;
+}
+
+// Whether a MATCH or CANCEL in the mempool already spends the order, mempool.cs is held by the caller
+static bool IsOrderSpentInMempool(const uint256& hash)
+{
+    return mempool.mapNextTx.count(COutPoint(hash, 0)) > 0;
+}
+
+// find the crossing orders of a color pair, then create and broadcast all their match transactions
+void CWallet::MatchOrderBook(const type_Color& colorA, const type_Color& colorB, size_t nMax,
+                             vector<pair<uint256, uint256> >& matchlist, vector<uint256>& txid,
+                             vector<MatchOrderResult>& vResult)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    {
+        LOCK(mempool.cs);
+        matchlist = porder->FindMatches(colorA, colorB, IsOrderSpentInMempool, nMax);
+    }
+
+    // The matches spend distinct orders, so each one is accepted or rejected on its own
+    CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile, "r+") : NULL;
+    txid.assign(matchlist.size(), uint256());
+    vResult.assign(matchlist.size(), MATCH_SENT);
+    for (size_t i = 0; i < matchlist.size(); i++) {
+        CMutableTransaction txNew;
+        txNew.type = MATCH;
+        CTxOut out1, out2;
+        if (!GetOrderPayout(matchlist[i].first, out1) || !GetOrderPayout(matchlist[i].second, out2)) {
+            LogPrintf("%s(): order of match of %s and %s not found\n", __func__, matchlist[i].first.ToString(), matchlist[i].second.ToString());
+            vResult[i] = MATCH_ORDER_NOT_FOUND;
+            continue;
+        }
+        txNew.vout.push_back(out1);
+        txNew.vout.push_back(out2);
+        txNew.vin.push_back(CTxIn(matchlist[i].first, 0));
+        txNew.vin.push_back(CTxIn(matchlist[i].second, 0));
+
+        CWalletTx wtxNew(this, CTransaction(txNew));
+        wtxNew.fTimeReceivedIsTxTime = true;
+        wtxNew.fFromMe = true;
+        if (!CommitWalletTx(wtxNew, pwalletdb, true)) {
+            LogPrintf("%s(): match of %s and %s rejected\n", __func__, matchlist[i].first.ToString(), matchlist[i].second.ToString());
+            vResult[i] = MATCH_REJECTED;
+            continue;
+        }
+        txid[i] = wtxNew.GetHash();
+    }
+    if (fFileBacked)
+        delete pwalletdb;
+}
+
 // create and broadcast cancel transaction
 string CWallet::CancelOrder(CWalletTx& wtxNew, uint256& txid)
 {
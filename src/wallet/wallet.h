@@ -53,6 +53,10 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 2;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Number of blocks a rescan reads ahead and then adds to the wallet under one lock
+static const unsigned int RESCAN_BATCH_SIZE = 100;
+//! Largest number of HD keys hdgennewaddress derives at once
+static const unsigned int MAX_HD_BULK_KEYS = 100000;
 
 class CAccountingEntry;
 class CBlockIndex;
@@ -74,6 +78,21 @@ enum WalletFeature
     FEATURE_LATEST = 60000
 };
 
+/** Failures of CWallet::CreateTransaction() which callers tell apart from the others */
+enum CreateTxFailure
+{
+    CREATE_TX_FAILED = 0,
+    CREATE_TX_TOO_LARGE, // over the standard size or the fee policy, fewer recipients may fit
+};
+
+/** Outcome of each match of CWallet::MatchOrderBook() */
+enum MatchOrderResult
+{
+    MATCH_SENT = 0,
+    MATCH_ORDER_NOT_FOUND, // the transaction of one of the orders could not be read
+    MATCH_REJECTED,        // CommitWalletTx() failed
+};
+
 
 /** A key pool entry */
 class CKeyPool
@@ -119,6 +138,14 @@ struct CRecipient
     bool fSubtractFeeFromAmount;
 };
 
+//! A payment of CWallet::SendBatch(), sent from strFromAddress, or any address if it is empty
+struct CBatchPayment
+{
+    std::string strFromAddress;
+    type_Color color;
+    CRecipient recipient;
+};
+
 typedef std::map<std::string, std::string> mapValue_t;
 
 
@@ -161,6 +188,10 @@ public:
 
     // memory only
     mutable bool fMerkleVerified;
+    //! Block found for hashBlock, NULL if it is not in the active chain, valid while no block left the active chain
+    //! since chainActive.GetDisconnectEpoch() was nConfirmEpochCached
+    mutable const CBlockIndex* pindexConfirmCached;
+    mutable unsigned int nConfirmEpochCached;
 
 
     CMerkleTx()
@@ -178,6 +209,13 @@ public:
         hashBlock = uint256();
         nIndex = -1;
         fMerkleVerified = false;
+        MarkConfirmDirty();
+    }
+
+    void MarkConfirmDirty() const
+    {
+        pindexConfirmCached = NULL;
+        nConfirmEpochCached = 0;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -342,17 +380,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -443,6 +471,86 @@ public:
 
 
 
+/**
+ * Unspent wallet outputs summed by address, state and color. Each transaction
+ * contributes a set of entries, which are replaced when it changes, so that
+ * the balances need not be summed over all the wallet transactions.
+ */
+class CBalanceLedger
+{
+public:
+    enum State
+    {
+        CONFIRMED,          //! outputs of trusted transactions (GetColorBalance)
+        UNCONFIRMED,        //! outputs of untrusted transactions (GetUnconfirmedColorBalance)
+        IMMATURE,           //! credit of immature mint transactions (GetImmatureBalance)
+        ADDRESS_CONFIRMED,  //! outputs of an address in a block (GetAddressBalance)
+        ADDRESS_PENDING,    //! outputs of an address of trusted transactions not in a block
+    };
+
+    struct Entry
+    {
+        std::string strAddress; //! empty for the wallet totals
+        State state;
+        type_Color color;
+        CAmount nValue;
+
+        Entry(const std::string& strAddressIn, State stateIn, type_Color colorIn, CAmount nValueIn) :
+            strAddress(strAddressIn), state(stateIn), color(colorIn), nValue(nValueIn) {}
+    };
+
+private:
+    typedef std::pair<std::string, std::pair<int, type_Color> > Key;
+    //! Sum and number of the entries of each key
+    std::map<Key, std::pair<CAmount, int> > mapTotal;
+    std::map<uint256, std::vector<Entry> > mapEntries;
+
+    void Add(const Entry& entry, int nSign);
+
+public:
+    //! Replace the entries of a transaction
+    void Set(const uint256& hash, const std::vector<Entry>& entries);
+    void Erase(const uint256& hash);
+    void Clear();
+
+    CAmount Get(const std::string& strAddress, State state, type_Color color) const;
+    //! Add the totals of all the colors with entries
+    void Get(const std::string& strAddress, State state, std::map<type_Color, CAmount>& color_amount) const;
+
+    bool operator==(const CBalanceLedger& other) const { return mapTotal == other.mapTotal; }
+};
+
+/**
+ * Unspent wallet outputs by color, ordered by value, so that the coin
+ * selection only visits the outputs of the color it is looking for. Whether
+ * an output can be spent now is still checked when it is selected.
+ */
+class CWalletCoinIndex
+{
+public:
+    typedef std::pair<CAmount, COutPoint> Coin;
+
+private:
+    std::map<type_Color, std::set<Coin> > mapColorCoins;
+    std::map<uint256, std::vector<std::pair<type_Color, Coin> > > mapEntries;
+
+public:
+    //! Replace the outputs of a transaction
+    void Set(const uint256& hash, const std::vector<std::pair<type_Color, Coin> >& coins);
+    void Erase(const uint256& hash);
+    void Clear();
+
+    //! Outputs of a color, NULL if there is none
+    const std::set<Coin>* Get(type_Color color) const;
+    //! Add up to nMax outputs following pos, ordered by color, and move pos to the last one; return whether more follow
+    bool GetAfter(std::pair<type_Color, Coin>& pos, unsigned int nMax, std::vector<std::pair<type_Color, Coin> >& coins) const;
+    //! Add the transactions with outputs of a color
+    void GetTransactions(type_Color color, std::set<uint256>& setTx) const;
+
+    bool operator==(const CWalletCoinIndex& other) const { return mapColorCoins == other.mapColorCoins; }
+};
+
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -479,6 +587,28 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Balances and unspent outputs, updated from the transactions marked dirty
+     * and, when the chain tip or the mempool changes, from the ones whose state
+     * depends on their depth.
+     */
+    mutable CBalanceLedger balanceLedger;
+    mutable CWalletCoinIndex coinIndex;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable std::set<uint256> setBalanceDepth;
+    mutable const CBlockIndex* pindexBalance;
+    mutable unsigned int nBalanceMempoolUpdated;
+
+    //! Get the ledger entries of a transaction, return whether they may change with the chain tip
+    bool GetBalanceEntries(const CWalletTx& wtx, std::vector<CBalanceLedger::Entry>& entries) const;
+    void GetUnspentCoins(const CWalletTx& wtx, std::vector<std::pair<type_Color, CWalletCoinIndex::Coin> >& coins) const;
+    void UpdateBalanceLedger() const;
+    void AddAvailableCoin(std::vector<COutput>& vCoins, const COutPoint& outpoint, bool fOnlyConfirmed, const CCoinControl *coinControl,
+                          bool fIncludeZeroValue) const;
+    //! Add a signed transaction to the wallet and broadcast it, the part of CommitTransaction() after the key is kept.
+    //! With fDropRejected a transaction the mempool rejects is not added either.
+    bool CommitWalletTx(CWalletTx& wtxNew, CWalletDB* pwalletdb, bool fDropRejected);
+
     //! state: current active hd chain
     HDChainID activeHDChain;
 
@@ -533,6 +663,8 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        pindexBalance = NULL;
+        nBalanceMempoolUpdated = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -557,6 +689,8 @@ public:
     void AvailableCoinsForType(std::vector<COutput>& vCoins, const type_Color& send_color, int type, bool fOnlyConfirmed = true, bool fIncludeZeroValue = false) const;
     void AvailableCoins(std::vector<COutput>& vCoins, const type_Color& color, bool fOnlyConfirmed = true, const CCoinControl *coinControl = NULL,
                         bool fIncludeZeroValue = false, const std::string& strFromAddress = "") const;
+    //! Available coins of up to nMax indexed outputs following pos, see CWalletCoinIndex::GetAfter()
+    bool AvailableCoinsAfter(std::vector<COutput>& vCoins, std::pair<type_Color, CWalletCoinIndex::Coin>& pos, unsigned int nMax, bool fOnlyConfirmed = true) const;
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
@@ -627,11 +761,17 @@ public:
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
     void MarkDirty();
+    void MarkBalanceDirty(const uint256& hash) const { setBalanceDirty.insert(hash); }
+    //! Compare the balance ledger and the coin index with ones rebuilt from all the wallet transactions
+    bool CheckBalanceLedger() const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256 &hash);
+    //! Must be called without cs_wallet held
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    //! Scripts of the outputs paying to the wallet, to look up in the block filters
+    void GetFilterScripts(std::vector<std::vector<unsigned char> >& vScripts) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime);
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime);
@@ -653,8 +793,9 @@ public:
 
     virtual bool CreateTypeTransaction(const std::vector<CRecipient>& vecSend, const type_Color& send_color, int type, CWalletTx& wtxNew,
                                        std::string& strFailReason, const std::string& misc = "");
-    bool CreateTransaction(const std::vector<CRecipient>& vecSend, const type_Color& send_color, CWalletTx& wtxNew,
-                            CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosRet, std::string& strFailReason, const CCoinControl *coinControl = NULL, const std::string& strFromAddress = "", const std::string& feeFromAddress = "");
+    virtual bool CreateTransaction(const std::vector<CRecipient>& vecSend, const type_Color& send_color, CWalletTx& wtxNew,
+                            CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosRet, std::string& strFailReason, const CCoinControl *coinControl = NULL, const std::string& strFromAddress = "", const std::string& feeFromAddress = "",
+                            CreateTxFailure* pFailureRet = NULL);
     bool CreateOrder(const int64_t sell_Amount, const type_Color sell_color, const int64_t buy_Amount, const type_Color buy_color, CWalletTx& wtxNew,
                      CReserveKey& reservekey, int64_t& nFeeRet, std::string& strFailReason, const CCoinControl* coinControl = NULL);
 
@@ -663,6 +804,10 @@ public:
     bool CreateCancel(uint256& txhash, CWalletTx& wtxNew, std::string& strFailReason);
 
     virtual bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey);
+    //! Send the payments from the same address and of the same color together, in as few transactions as
+    //! the size and fee limits allow. vResult has the txid of each payment, or the reason it was not sent.
+    //! Return the number of transactions sent.
+    int SendBatch(const std::vector<CBatchPayment>& vPayment, std::vector<std::pair<uint256, std::string> >& vResult);
 
     static CFeeRate minTxFee;
     static CAmount GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarget, const CTxMemPool& pool);
@@ -685,6 +830,8 @@ public:
     bool AddKeyPool(CPubKey& key);
     bool EraseKeyPool();
     void ViewKeyPool(std::vector<CPubKey>& keys);
+    //! Add up to nMax keys of the pool with an index above nAfter
+    void ViewKeyPool(int64_t nAfter, unsigned int nMax, std::vector<std::pair<int64_t, CPubKey> >& keys);
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
@@ -787,6 +934,11 @@ public:
     std::string MintMoney(const CAmount& nValue, const type_Color& color, CWalletTx& wtxNew);
     std::string SendOrder(CWalletTx& wtxNew, const int64_t sell_amount, const type_Color sell_color, const int64_t buy_amount, const type_Color buy_color);
     std::string MatchOrder(std::vector<std::pair<uint256, uint256> >& matchlist, std::vector<uint256>& txid);
+    //! Match the crossing orders of two colors, at most nMax pairs, see order_list::OrderList::FindMatches();
+    //! vResult has the outcome of each pair and txid its match, null unless it was sent
+    void MatchOrderBook(const type_Color& colorA, const type_Color& colorB, size_t nMax,
+                        std::vector<std::pair<uint256, uint256> >& matchlist, std::vector<uint256>& txid,
+                        std::vector<MatchOrderResult>& vResult);
     std::string CancelOrder(CWalletTx& wtxNew, uint256& txid);
 
     //!adds a hd chain of keys to the wallet
@@ -798,6 +950,13 @@ public:
     //!get next free child key
     bool HDGetNextChildPubKey(const HDChainID& chainId, CPubKey &pubKeyOut, std::string& newKeysChainpathOut, bool internal = false);
 
+    //!collect the child indices of the chain that are already in the keystore
+    void GetUsedHDChildIndices(const HDChainID& chainID, bool internal, std::set<unsigned int>& setUsed);
+
+    //!derive the next nCount free child keys across threads and store them, labeled with strAccount, in one database transaction;
+    //!takes cs_wallet only to pick the indices and to store the keys, call it without holding cs_wallet
+    bool HDGetNextChildPubKeys(const HDChainID& chainId, unsigned int nCount, std::vector<CPubKey>& vPubKeyOut, const std::string& strAccount, bool internal = false);
+
     //!encrypt your master seeds
     bool EncryptHDSeeds(CKeyingMaterial& vMasterKeyIn);
 